@@ -0,0 +1,499 @@
+// Generates a synthetic repository and measures the helper against the
+// local wallet stand-in: object collection, serialization, push and fetch
+#include <git2.h>
+#include <boost/filesystem.hpp>
+#include <boost/json.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "git_utils.h"
+#include "mock_wallet_server.h"
+#include "object_collector.h"
+#include "remote_helper.h"
+#include "wallet_client.h"
+
+namespace po = boost::program_options;
+namespace json = boost::json;
+using namespace std;
+using namespace sourc3;
+
+namespace {
+using Clock = chrono::steady_clock;
+using TreeBuilder = Holder<git_treebuilder, git_treebuilder_free>;
+
+struct RepoShape {
+    uint32_t commits = 100;
+    uint32_t fanOut = 8;   // entries of every tree
+    uint32_t depth = 3;    // levels of trees, files are in the last one
+    uint32_t changes = 8;  // files modified by every commit
+    uint32_t minBlobSize = 64;
+    uint32_t maxBlobSize = 64 * 1024;  // sizes are log-uniform
+    double binaryRatio = 0.1;
+    uint32_t seed = 1;
+};
+
+struct PhaseResult {
+    string name;
+    size_t objects = 0;
+    size_t bytes = 0;
+    Clock::duration time{};
+    uint64_t rpc = 0;
+    size_t peakRss = 0;
+};
+
+size_t GetPeakRss() {
+#ifdef WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);  // bytes
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Builds history on top of a full tree of fan_out^depth files, every commit
+// rewrites some of the files and the trees above them
+class RepoGenerator {
+public:
+    RepoGenerator(git_repository* repo, const RepoShape& shape)
+        : repo_(repo), shape_(shape), random_(shape.seed) {
+        size_t nodes = 1;
+        for (uint32_t level = 0; level < shape_.depth; ++level) {
+            trees_.emplace_back(nodes);
+            dirty_.emplace_back(nodes, true);
+            nodes *= shape_.fanOut;
+        }
+        files_.resize(nodes);
+        if (git_repository_odb(odb_.Addr(), repo_) < 0) {
+            throw runtime_error("failed to open object database");
+        }
+    }
+
+    void Generate() {
+        for (size_t i = 0; i < files_.size(); ++i) {
+            WriteFile(i);
+        }
+        Commit();
+        uniform_int_distribution<size_t> file(0, files_.size() - 1);
+        for (uint32_t i = 1; i < shape_.commits; ++i) {
+            for (uint32_t j = 0; j < shape_.changes; ++j) {
+                WriteFile(file(random_));
+            }
+            Commit();
+        }
+    }
+
+    size_t GetObjectCount() const {
+        return objects_;
+    }
+
+    size_t GetSize() const {
+        return bytes_;
+    }
+
+private:
+    void WriteFile(size_t index) {
+        auto blob_size =
+            static_cast<size_t>(exp(uniform_real_distribution<double>(
+                log(double(shape_.minBlobSize)),
+                log(double(shape_.maxBlobSize)))(random_)));
+        bool binary = uniform_real_distribution<double>(0, 1)(random_) <
+                      shape_.binaryRatio;
+        string data;
+        data.reserve(blob_size);
+        if (binary) {
+            uniform_int_distribution<int> byte(0, 255);
+            while (data.size() < blob_size) {
+                data.push_back(static_cast<char>(byte(random_)));
+            }
+        } else {
+            static const char* words[] = {"git",    "remote", "helper",
+                                          "object", "commit", "tree",
+                                          "blob",   "push",   "fetch",
+                                          "wallet", "sourc3", "contract"};
+            uniform_int_distribution<size_t> word(0, size(words) - 1);
+            size_t line = 0;
+            while (data.size() < blob_size) {
+                data.append(words[word(random_)]);
+                line += 1;
+                data.push_back(line % 10 == 0 ? '\n' : ' ');
+            }
+        }
+        data.resize(blob_size);
+        Write(&files_[index], data.data(), data.size(), GIT_OBJECT_BLOB);
+
+        // mark the trees above the file
+        for (size_t level = shape_.depth; level-- > 0;) {
+            index /= shape_.fanOut;
+            dirty_[level][index] = true;
+        }
+    }
+
+    const git_oid& WriteTree(size_t level, size_t index) {
+        auto& oid = trees_[level][index];
+        if (!dirty_[level][index]) {
+            return oid;
+        }
+        TreeBuilder builder;
+        if (git_treebuilder_new(builder.Addr(), repo_, nullptr) < 0) {
+            throw runtime_error("failed to create tree builder");
+        }
+        bool leaf = level + 1 == shape_.depth;
+        for (size_t i = 0; i < shape_.fanOut; ++i) {
+            auto child = index * shape_.fanOut + i;
+            auto name = (leaf ? "file" : "dir") + to_string(i);
+            const auto& child_oid =
+                leaf ? files_[child] : WriteTree(level + 1, child);
+            if (git_treebuilder_insert(nullptr, *builder, name.c_str(),
+                                       &child_oid,
+                                       leaf ? GIT_FILEMODE_BLOB
+                                            : GIT_FILEMODE_TREE) < 0) {
+                throw runtime_error("failed to insert tree entry");
+            }
+        }
+        if (git_treebuilder_write(&oid, *builder) < 0) {
+            throw runtime_error("failed to write tree");
+        }
+        ++objects_;
+        dirty_[level][index] = false;
+        return oid;
+    }
+
+    void Commit() {
+        git::Tree tree;
+        if (git_tree_lookup(tree.Addr(), repo_, &WriteTree(0, 0)) < 0) {
+            throw runtime_error("failed to read tree");
+        }
+        // fixed time keeps the ids reproducible
+        git::Signature sig;
+        if (git_signature_new(sig.Addr(), "benchmark", "benchmark@sourc3.io",
+                              1600000000 + commits_.size(), 0) < 0) {
+            throw runtime_error("failed to create signature");
+        }
+        git::Commit parent;
+        if (!commits_.empty() &&
+            git_commit_lookup(parent.Addr(), repo_, &commits_.back()) < 0) {
+            throw runtime_error("failed to read commit");
+        }
+        auto message = "Commit " + to_string(commits_.size());
+        auto& oid = commits_.emplace_back();
+        if (git_commit_create_v(&oid, repo_, "refs/heads/master", *sig, *sig,
+                                nullptr, message.c_str(), *tree,
+                                parent ? 1 : 0, *parent) < 0) {
+            throw runtime_error("failed to create commit");
+        }
+        ++objects_;
+    }
+
+    void Write(git_oid* oid, const void* data, size_t size,
+               git_object_t type) {
+        if (git_odb_write(oid, *odb_, data, size, type) < 0) {
+            throw runtime_error("failed to write object");
+        }
+        ++objects_;
+        bytes_ += size;
+    }
+
+private:
+    git_repository* repo_;
+    git::ObjectDB odb_;
+    RepoShape shape_;
+    mt19937 random_;
+    vector<vector<git_oid>> trees_;
+    vector<vector<bool>> dirty_;
+    vector<git_oid> files_;
+    vector<git_oid> commits_;
+    size_t objects_ = 0;
+    size_t bytes_ = 0;
+};
+
+// Keeps the replies of the helper away from the report
+class CaptureOutput {
+public:
+    CaptureOutput() : old_(cout.rdbuf(out_.rdbuf())) {
+    }
+
+    ~CaptureOutput() {
+        cout.rdbuf(old_);
+    }
+
+    string Get() const {
+        return out_.str();
+    }
+
+private:
+    stringstream out_;
+    streambuf* old_;
+};
+
+uint64_t GetRpcCount(const MockWalletServer& server) {
+    uint64_t count = 0;
+    for (const auto& [method, n] : server.GetRequestCounts()) {
+        count += n;
+    }
+    return count;
+}
+
+void PrintReport(const vector<PhaseResult>& results) {
+    cout << left << setw(10) << "phase" << right << setw(10) << "objects"
+         << setw(12) << "MB" << setw(10) << "time, s" << setw(12)
+         << "objects/s" << setw(10) << "MB/s" << setw(8) << "RPC"
+         << setw(14) << "peak RSS, MB" << '\n';
+    for (const auto& r : results) {
+        auto seconds = chrono::duration<double>(r.time).count();
+        auto mb = r.bytes / 1048576.0;
+        cout << left << setw(10) << r.name << right << setw(10) << r.objects
+             << fixed << setprecision(2) << setw(12) << mb << setw(10)
+             << seconds << setw(12) << setprecision(0)
+             << (seconds > 0 ? r.objects / seconds : 0) << setw(10)
+             << setprecision(2) << (seconds > 0 ? mb / seconds : 0)
+             << setw(8) << r.rpc << setw(14) << r.peakRss / 1048576.0
+             << '\n';
+    }
+}
+
+void WriteJsonReport(const string& path, const RepoShape& shape,
+                     const vector<PhaseResult>& results) {
+    json::array phases;
+    for (const auto& r : results) {
+        phases.push_back(json::object{
+            {"name", r.name},
+            {"objects", r.objects},
+            {"bytes", r.bytes},
+            {"time_us",
+             chrono::duration_cast<chrono::microseconds>(r.time).count()},
+            {"rpc", r.rpc},
+            {"peak_rss", r.peakRss}});
+    }
+    json::object root{{"shape", json::object{{"commits", shape.commits},
+                                             {"fan_out", shape.fanOut},
+                                             {"depth", shape.depth},
+                                             {"changes", shape.changes},
+                                             {"min_blob_size",
+                                              shape.minBlobSize},
+                                             {"max_blob_size",
+                                              shape.maxBlobSize},
+                                             {"binary_ratio",
+                                              shape.binaryRatio},
+                                             {"seed", shape.seed}}},
+                      {"phases", std::move(phases)}};
+    ofstream file(path, ios::trunc);
+    if (!file) {
+        throw runtime_error("cannot open " + path);
+    }
+    file << json::serialize(root) << '\n';
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        RepoShape shape;
+        MockWalletServer::Options server_options;
+        SimpleWalletClient::Options options;
+        unsigned latency = 0;
+        unsigned ipfs_latency = 0;
+        string work_dir;
+        string report;
+        po::options_description desc("SOURC3 helper benchmark options");
+        desc.add_options()("help", "Print this message")(
+            "commits", po::value<uint32_t>(&shape.commits)->default_value(100),
+            "Number of commits")(
+            "fan-out", po::value<uint32_t>(&shape.fanOut)->default_value(8),
+            "Entries of every tree")(
+            "depth", po::value<uint32_t>(&shape.depth)->default_value(3),
+            "Levels of trees")(
+            "changes", po::value<uint32_t>(&shape.changes)->default_value(8),
+            "Files modified by every commit")(
+            "min-blob-size",
+            po::value<uint32_t>(&shape.minBlobSize)->default_value(64),
+            "Minimal size of a file")(
+            "max-blob-size",
+            po::value<uint32_t>(&shape.maxBlobSize)->default_value(64 * 1024),
+            "Maximal size of a file, sizes are log-uniform")(
+            "binary-ratio",
+            po::value<double>(&shape.binaryRatio)->default_value(0.1),
+            "Share of binary files")(
+            "seed", po::value<uint32_t>(&shape.seed)->default_value(1),
+            "Random seed")(
+            "latency", po::value<unsigned>(&latency)->default_value(0),
+            "Delay of every wallet response, ms")(
+            "ipfs-latency", po::value<unsigned>(&ipfs_latency)->default_value(0),
+            "Additional delay of IPFS responses, ms")(
+            "api-connections",
+            po::value<size_t>(&options.apiConnections)->default_value(4),
+            "Number of connections to the wallet")(
+            "use-ipfs", po::value<bool>(&options.useIPFS)->default_value(true),
+            "Use IPFS to store large blobs")(
+            "object-storage",
+            po::value<string>(&options.objectStorage)->default_value("repo"),
+            "How pushed objects are stored: repo, pack or shared")(
+            "work-dir",
+            po::value<string>(&work_dir)->default_value("./temp/benchmark"),
+            "Directory for the generated repositories, it is cleaned")(
+            "report", po::value<string>(&report),
+            "Write the results to a JSON file");
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help") != 0) {
+            cout << desc << endl;
+            return 0;
+        }
+        vm.notify();
+        if (shape.fanOut == 0 || shape.depth == 0 || shape.commits == 0 ||
+            shape.minBlobSize == 0 || shape.minBlobSize > shape.maxBlobSize) {
+            cerr << "Invalid repository shape" << endl;
+            return -1;
+        }
+        server_options.latency = chrono::milliseconds(latency);
+        server_options.ipfsLatency = chrono::milliseconds(ipfs_latency);
+
+        git::Init init;
+        boost::filesystem::remove_all(work_dir);
+        auto source_dir = work_dir + "/source.git";
+        auto clone_dir = work_dir + "/clone.git";
+        vector<PhaseResult> results;
+        size_t total_objects = 0;  // reachable from the head
+        size_t total_bytes = 0;
+
+        {
+            auto& r = results.emplace_back();
+            r.name = "generate";
+            git::Repository repo;
+            if (git_repository_init(repo.Addr(), source_dir.c_str(), true) <
+                0) {
+                throw runtime_error("failed to create " + source_dir);
+            }
+            RepoGenerator generator(*repo, shape);
+            auto start = Clock::now();
+            generator.Generate();
+            r.time = Clock::now() - start;
+            r.objects = generator.GetObjectCount();
+            r.bytes = generator.GetSize();
+            r.peakRss = GetPeakRss();
+        }
+
+        {
+            ObjectCollector collector(source_dir);
+            auto& traverse = results.emplace_back();
+            traverse.name = "traverse";
+            auto start = Clock::now();
+            collector.Traverse({{"refs/heads/master", "refs/heads/master"}},
+                               {});
+            traverse.time = Clock::now() - start;
+            traverse.objects = collector.m_objects.size();
+            for (const auto& obj : collector.m_objects) {
+                traverse.bytes += obj.GetSize();
+            }
+            traverse.peakRss = GetPeakRss();
+            total_objects = traverse.objects;
+            total_bytes = traverse.bytes;
+
+            auto& serialize = results.emplace_back();
+            serialize.name = "serialize";
+            start = Clock::now();
+            collector.Serialize([&](const auto& buf, size_t done) {
+                serialize.bytes += buf.size();
+                serialize.objects = done;
+            });
+            serialize.time = Clock::now() - start;
+            serialize.peakRss = GetPeakRss();
+        }
+
+        MockWalletServer server(server_options);
+        server.CreateRepo(server.GetUserKey(), "benchmark");
+        server.Start();
+        options.apiHost = "127.0.0.1";
+        options.apiPort = to_string(server.GetPort());
+        options.repoOwner = server.GetUserKey();
+        options.repoName = "benchmark";
+
+        auto run = [&](const string& name, const string& repo_dir,
+                       vector<string_view> args) {
+            auto& r = results.emplace_back();
+            r.name = name;
+            options.repoPath = repo_dir;
+            SimpleWalletClient client(options);
+            RemoteHelper helper(client);
+            auto rpc = GetRpcCount(server);
+            auto start = Clock::now();
+            string out;
+            {
+                CaptureOutput capture;
+                vector<string_view> progress = {"option", "progress", "false"};
+                helper.DoCommand(progress[0], progress);
+                if (helper.DoCommand(args[0], args) ==
+                    RemoteHelper::CommandResult::Failed) {
+                    throw runtime_error(name + " failed");
+                }
+                out = capture.Get();
+            }
+            r.time = Clock::now() - start;
+            r.rpc = GetRpcCount(server) - rpc;
+            r.peakRss = GetPeakRss();
+            return out;
+        };
+
+        auto out = run("push", source_dir,
+                       {"push", "refs/heads/master:refs/heads/master"});
+        if (out.find("ok refs/heads/master") == string::npos) {
+            throw runtime_error("push failed: " + out);
+        }
+        results.back().objects = total_objects;
+        results.back().bytes = total_bytes;
+
+        git_oid head;
+        {
+            git::Repository repo;
+            if (git_repository_open(repo.Addr(), source_dir.c_str()) < 0 ||
+                git_reference_name_to_id(&head, *repo, "refs/heads/master") <
+                    0) {
+                throw runtime_error("failed to read refs/heads/master");
+            }
+            git::Repository clone;
+            if (git_repository_init(clone.Addr(), clone_dir.c_str(), true) <
+                0) {
+                throw runtime_error("failed to create " + clone_dir);
+            }
+        }
+        auto head_str = ToString(head);
+        run("fetch", clone_dir, {"fetch", head_str, "refs/heads/master"});
+        {
+            git::RepoAccessor clone(clone_dir);
+            if (git_odb_exists(*clone.m_odb, &head) == 0) {
+                throw runtime_error("fetched repository is incomplete");
+            }
+        }
+        results.back().objects = total_objects;
+        results.back().bytes = total_bytes;
+
+        PrintReport(results);
+        if (!report.empty()) {
+            WriteJsonReport(report, shape, results);
+        }
+    } catch (const exception& ex) {
+        cerr << "Error: " << ex.what() << endl;
+        return -1;
+    }
+    return 0;
+}
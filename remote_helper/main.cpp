@@ -0,0 +1,161 @@
+﻿
+#define _CRT_SECURE_NO_WARNINGS  // getenv
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "git_utils.h"
+#include "remote_helper.h"
+#include "version.h"
+#include "wallet_client.h"
+
+namespace po = boost::program_options;
+using namespace std;
+using namespace sourc3;
+
+#define PROTO_NAME "sourc3"
+
+namespace {
+vector<string_view> ParseArgs(std::string_view args_sv) {
+    vector<string_view> args;
+    while (!args_sv.empty()) {
+        auto p = args_sv.find(' ');
+        auto ss = args_sv.substr(0, p);
+        args_sv.remove_prefix(p == string_view::npos ? ss.size()
+                                                     : ss.size() + 1);
+        if (!ss.empty()) {
+            args.emplace_back(ss);
+        }
+    }
+    return args;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        cerr << "USAGE: git-remote-sourc3 <remote> <url>" << endl;
+        return -1;
+    }
+    try {
+        SimpleWalletClient::Options options;
+        po::options_description desc("SOURC3 config options");
+#ifdef WIN32
+        const auto* home_dir = std::getenv("USERPROFILE");
+#else
+        const auto* home_dir = std::getenv("HOME");
+#endif
+        const auto* metrics_output = std::getenv("SOURC3_METRICS");
+        std::string session_cache_path;
+        if (home_dir != nullptr) {
+            session_cache_path =
+                std::string(home_dir) + "/." PROTO_NAME "/session-cache.json";
+        }
+
+        desc.add_options()("api-host",
+                           po::value<std::string>(&options.apiHost)
+                               ->default_value("localhost"),
+                           "Wallet API host")(
+            "api-port",
+            po::value<std::string>(&options.apiPort)->default_value("10000"),
+            "Wallet API port")("api-target",
+                               po::value<std::string>(&options.apiTarget)
+                                   ->default_value("/api/wallet"),
+                               "Wallet API target")(
+            "api-connections",
+            po::value<size_t>(&options.apiConnections)->default_value(4),
+            "Number of connections to the wallet API")(
+            "api-transport",
+            po::value<std::string>(&options.apiTransport)->default_value("tcp"),
+            "Wallet API transport: tcp or http (uses api-target)")(
+            "app-shader-file",
+            po::value<string>(&options.appPath)->default_value("app.wasm"),
+            "Path to the app shader file")(
+            "use-ipfs", po::value<bool>(&options.useIPFS)->default_value(true),
+            "Use IPFS to store large blobs")(
+            "object-storage",
+            po::value<std::string>(&options.objectStorage)
+                ->default_value("repo"),
+            "How pushed objects are stored: repo, pack or shared")(
+            "verify-objects",
+            po::value<bool>(&options.verifyObjects)->default_value(false),
+            "Recalculate ids of local objects before pushing them")(
+            "session-cache",
+            po::value<std::string>(&options.sessionCachePath)
+                ->default_value(session_cache_path),
+            "File to keep contract and repo ids between runs, empty to "
+            "disable")(
+            "metrics",
+            po::value<std::string>(&options.metricsOutput)
+                ->default_value(metrics_output ? metrics_output : ""),
+            "Write timings at exit to stderr, a .json or a Prometheus file, "
+            "SOURC3_METRICS sets the default");
+        po::variables_map vm;
+        std::string config_path = PROTO_NAME "-remote.cfg";
+        if (home_dir != nullptr) {
+            config_path =
+                std::string(home_dir) + "/." PROTO_NAME "/" + config_path;
+        }
+        cerr << "Reading config from: " << config_path << "..." << endl;
+        const auto full_path =
+            boost::filesystem::system_complete(config_path).string();
+        std::ifstream cfg(full_path);
+        if (cfg) {
+            po::store(po::parse_config_file(cfg, desc), vm);
+        }
+        vm.notify();
+        string_view sv(argv[2]);
+        const string_view schema = PROTO_NAME "://";
+        sv = sv.substr(schema.size());
+        auto delimiter_owner_name_pos = sv.find('/');
+        options.repoOwner = sv.substr(0, delimiter_owner_name_pos);
+        options.repoName = sv.substr(delimiter_owner_name_pos + 1);
+        auto* git_dir = std::getenv("GIT_DIR");  // set during clone
+        if (git_dir != nullptr) {
+            options.repoPath = git_dir;
+        }
+        cerr << "     Remote: " << argv[1] << "\n        URL: " << argv[2]
+             << "\nWorking dir: " << boost::filesystem::current_path()
+             << "\nRepo folder: " << options.repoPath << endl;
+        SimpleWalletClient wallet_client{options};
+        RemoteHelper helper{wallet_client};
+        git::Init init;
+        string input;
+        auto res = RemoteHelper::CommandResult::Ok;
+        while (getline(cin, input, '\n')) {
+            if (input.empty()) {
+                if (res == RemoteHelper::CommandResult::Batch) {
+                    cout << endl;
+                    continue;
+                } else {
+                    cerr << "Unexpected blank line" << endl;
+                    return -1;
+                }
+            }
+
+            string_view args_sv(input.data(), input.size());
+            vector<string_view> args = ParseArgs(args_sv);
+            if (args.empty()) {
+                return -1;
+            }
+
+            cerr << "Command: " << input << endl;
+            res = helper.DoCommand(args[0], args);
+
+            if (res == RemoteHelper::CommandResult::Failed) {
+                return -1;
+            } else if (res == RemoteHelper::CommandResult::Ok) {
+                cout << endl;
+            }
+        }
+    } catch (const exception& ex) {
+        cerr << "Error: " << ex.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
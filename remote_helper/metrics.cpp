@@ -0,0 +1,185 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <boost/json.hpp>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+namespace sourc3 {
+namespace json = boost::json;
+
+namespace {
+std::string_view GetExtension(std::string_view path) {
+    auto p = path.find_last_of("./\\");
+    if (p == std::string_view::npos || path[p] != '.') {
+        return {};
+    }
+    return path.substr(p);
+}
+
+// Prometheus metric names allow only [a-zA-Z0-9_:]
+std::string ToMetricName(std::string_view name) {
+    std::string res = "sourc3_";
+    for (auto c : name) {
+        bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                     (c >= '0' && c <= '9') || c == '_';
+        res.push_back(valid ? c : '_');
+    }
+    return res;
+}
+
+void PrintDuration(std::ostream& os, uint64_t us) {
+    if (us < 1000) {
+        os << us << "us";
+    } else if (us < 1000000) {
+        os << std::fixed << std::setprecision(2) << us / 1000.0 << "ms";
+    } else {
+        os << std::fixed << std::setprecision(2) << us / 1000000.0 << "s";
+    }
+}
+}  // namespace
+
+void Histogram::Add(std::chrono::microseconds value) {
+    auto us = static_cast<uint64_t>(std::max<int64_t>(value.count(), 0));
+    size_t i = 0;
+    while (i < kBuckets && (uint64_t(1) << i) <= us) {
+        ++i;
+    }
+    ++buckets_[i];
+    ++count_;
+    sum_ += us;
+    max_ = std::max(max_, us);
+}
+
+uint64_t Histogram::GetPercentile(double p) const {
+    auto rank = static_cast<uint64_t>(p * static_cast<double>(count_));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += buckets_[i];
+        if (seen > rank) {
+            return std::min(uint64_t(1) << i, max_);
+        }
+    }
+    return max_;
+}
+
+Metrics::Metrics(std::string output) : output_(std::move(output)) {
+}
+
+Metrics::~Metrics() {
+    if (!IsEnabled()) {
+        return;
+    }
+    try {
+        Report();
+    } catch (const std::exception& ex) {
+        std::cerr << "Failed to write metrics: " << ex.what() << std::endl;
+    }
+}
+
+void Metrics::AddLatency(std::string_view name, Clock::duration duration) {
+    auto it = latencies_.find(name);
+    if (it == latencies_.end()) {
+        it = latencies_.emplace(std::string(name), Histogram{}).first;
+    }
+    it->second.Add(
+        std::chrono::duration_cast<std::chrono::microseconds>(duration));
+}
+
+void Metrics::AddCounter(std::string_view name, uint64_t value) {
+    auto it = counters_.find(name);
+    if (it == counters_.end()) {
+        it = counters_.emplace(std::string(name), 0).first;
+    }
+    it->second += value;
+}
+
+void Metrics::WriteText(std::ostream& os) const {
+    os << "Metrics:\n";
+    for (const auto& [name, h] : latencies_) {
+        os << "  " << name << ": count=" << h.GetCount() << " total=";
+        PrintDuration(os, h.GetSum());
+        os << " avg=";
+        PrintDuration(os, h.GetSum() / std::max<uint64_t>(h.GetCount(), 1));
+        os << " p50<=";
+        PrintDuration(os, h.GetPercentile(0.5));
+        os << " p99<=";
+        PrintDuration(os, h.GetPercentile(0.99));
+        os << " max=";
+        PrintDuration(os, h.GetMax());
+        os << '\n';
+    }
+    for (const auto& [name, value] : counters_) {
+        os << "  " << name << ": " << value << '\n';
+    }
+}
+
+void Metrics::WriteJson(std::ostream& os) const {
+    json::object latencies;
+    for (const auto& [name, h] : latencies_) {
+        json::array buckets;
+        for (size_t i = 0; i < Histogram::kBuckets; ++i) {
+            if (h.GetBucket(i) != 0) {
+                buckets.push_back(json::object{
+                    {"le_us", uint64_t(1) << i}, {"count", h.GetBucket(i)}});
+            }
+        }
+        latencies[name] = json::object{{"count", h.GetCount()},
+                                       {"sum_us", h.GetSum()},
+                                       {"max_us", h.GetMax()},
+                                       {"buckets", std::move(buckets)}};
+    }
+    json::object counters;
+    for (const auto& [name, value] : counters_) {
+        counters[name] = value;
+    }
+    json::object root;
+    root["latencies"] = std::move(latencies);
+    root["counters"] = std::move(counters);
+    os << json::serialize(root) << '\n';
+}
+
+void Metrics::WritePrometheus(std::ostream& os) const {
+    if (!latencies_.empty()) {
+        os << "# TYPE sourc3_latency_seconds histogram\n";
+    }
+    for (const auto& [name, h] : latencies_) {
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < Histogram::kBuckets; ++i) {
+            cumulative += h.GetBucket(i);
+            os << "sourc3_latency_seconds_bucket{name=\"" << name
+               << "\",le=\"" << (uint64_t(1) << i) / 1e6 << "\"} "
+               << cumulative << '\n';
+        }
+        os << "sourc3_latency_seconds_bucket{name=\"" << name
+           << "\",le=\"+Inf\"} " << h.GetCount() << '\n';
+        os << "sourc3_latency_seconds_sum{name=\"" << name << "\"} "
+           << h.GetSum() / 1e6 << '\n';
+        os << "sourc3_latency_seconds_count{name=\"" << name << "\"} "
+           << h.GetCount() << '\n';
+    }
+    for (const auto& [name, value] : counters_) {
+        auto metric = ToMetricName(name);
+        os << "# TYPE " << metric << " counter\n"
+           << metric << ' ' << value << '\n';
+    }
+}
+
+void Metrics::Report() const {
+    if (output_ == "stderr") {
+        WriteText(std::cerr);
+        return;
+    }
+    std::ofstream file(output_, std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("cannot open " + output_);
+    }
+    if (GetExtension(output_) == ".json") {
+        WriteJson(file);
+    } else {
+        WritePrometheus(file);
+    }
+}
+}  // namespace sourc3
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace sourc3 {
+// Latency histogram, bucket i counts values below 2^i microseconds
+class Histogram {
+public:
+    static constexpr size_t kBuckets = 32;
+
+    void Add(std::chrono::microseconds value);
+
+    uint64_t GetCount() const {
+        return count_;
+    }
+
+    uint64_t GetSum() const {  // microseconds
+        return sum_;
+    }
+
+    uint64_t GetMax() const {  // microseconds
+        return max_;
+    }
+
+    uint64_t GetBucket(size_t i) const {
+        return buckets_[i];
+    }
+
+    // Upper bound of the bucket containing the percentile, microseconds
+    uint64_t GetPercentile(double p) const;
+
+private:
+    uint64_t buckets_[kBuckets + 1] = {};  // the last one is for overflow
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+// Collects latencies and counters of the helper. The output is "stderr",
+// a JSON file if the name ends with ".json" or a Prometheus text file
+// otherwise. Empty output disables the collection and the report is
+// written when the object is destroyed
+class Metrics {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Metrics(std::string output = {});
+    ~Metrics();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    bool IsEnabled() const {
+        return !output_.empty();
+    }
+
+    void AddLatency(std::string_view name, Clock::duration duration);
+    void AddCounter(std::string_view name, uint64_t value = 1);
+
+    void WriteText(std::ostream& os) const;
+    void WriteJson(std::ostream& os) const;
+    void WritePrometheus(std::ostream& os) const;
+
+    // Measures the time until the end of the scope
+    class ScopedTimer {
+    public:
+        ScopedTimer(Metrics& metrics, std::string_view name)
+            : metrics_(metrics.IsEnabled() ? &metrics : nullptr), name_(name) {
+            if (metrics_ != nullptr) {
+                start_ = Clock::now();
+            }
+        }
+
+        ~ScopedTimer() {
+            if (metrics_ != nullptr) {
+                metrics_->AddLatency(name_, Clock::now() - start_);
+            }
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Metrics* metrics_;
+        std::string_view name_;
+        Clock::time_point start_;
+    };
+
+private:
+    void Report() const;
+
+private:
+    std::string output_;
+    std::map<std::string, Histogram, std::less<>> latencies_;
+    std::map<std::string, uint64_t, std::less<>> counters_;
+};
+}  // namespace sourc3
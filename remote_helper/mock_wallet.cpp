@@ -0,0 +1,64 @@
+// Local stand-in for the wallet API, see MockWalletServer
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mock_wallet_server.h"
+
+namespace po = boost::program_options;
+using namespace std;
+using namespace sourc3;
+
+int main(int argc, char* argv[]) {
+    try {
+        MockWalletServer::Options options;
+        unsigned latency = 0;
+        unsigned ipfs_latency = 0;
+        unsigned tx_latency = 0;
+        vector<string> repos;
+        po::options_description desc("SOURC3 mock wallet options");
+        desc.add_options()("help", "Print this message")(
+            "port", po::value<uint16_t>(&options.port)->default_value(10000),
+            "Port to listen on, 0 picks a free one")(
+            "latency", po::value<unsigned>(&latency)->default_value(0),
+            "Delay of every response, ms")(
+            "ipfs-latency", po::value<unsigned>(&ipfs_latency)->default_value(0),
+            "Additional delay of IPFS responses, ms")(
+            "tx-latency", po::value<unsigned>(&tx_latency)->default_value(0),
+            "Delay until a transaction is completed, ms")(
+            "http", po::bool_switch(&options.http),
+            "Reply with HTTP responses to POST requests, for "
+            "--api-transport=http of the helper")(
+            "repo", po::value<vector<string>>(&repos),
+            "Name of a repo to create for the wallet user, may be repeated");
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help") != 0) {
+            cout << desc << endl;
+            return 0;
+        }
+        vm.notify();
+        options.latency = chrono::milliseconds(latency);
+        options.ipfsLatency = chrono::milliseconds(ipfs_latency);
+        options.txLatency = chrono::milliseconds(tx_latency);
+
+        MockWalletServer server(options);
+        for (const auto& name : repos) {
+            server.CreateRepo(server.GetUserKey(), name);
+        }
+        cerr << "Listening on port " << server.GetPort()
+             << (options.http ? " (HTTP)" : "")
+             << "\n   User key: " << server.GetUserKey() << endl;
+        for (const auto& name : repos) {
+            cerr << "       Repo: sourc3://" << server.GetUserKey() << '/'
+                 << name << endl;
+        }
+        server.Run();
+    } catch (const exception& ex) {
+        cerr << "Error: " << ex.what() << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,1357 @@
+#include "mock_wallet_server.h"
+
+#include <boost/algorithm/hex.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/json.hpp>
+#include <array>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace sourc3 {
+namespace json = boost::json;
+namespace net = boost::asio;
+namespace http = boost::beast::http;
+using tcp = net::ip::tcp;
+
+namespace {
+// Mirrors shaders/contract.h, size_t fields of the contract are 32 bit
+enum Tag : uint8_t {
+    kRepo,
+    kObjects,
+    kRefs,
+    kOrganization,
+    kProject,
+    kRepoMember,
+    kOrganizationMember,
+    kProjectMember,
+    kSharedObjectData,
+    kSharedObjectRefs,
+    kSharedObjectMember,
+    kPackIndex,
+    kPackData,
+    kProjectRepo,
+    kOwnerRepo,
+    kOrganizationName,
+    kProjectName,
+    kRemovedRepo,
+    kObjectChunk,
+    kChunkedObject,
+    kObjectType,
+    kLegacyState,
+    kLegacyObjects,
+    kPackedObject,
+    kRepoMemberIndex,
+};
+
+constexpr size_t kOidSize = 20;
+constexpr size_t kHashSize = 32;
+constexpr size_t kPubKeySize = 33;
+constexpr uint8_t kPushPermission = 0b01000;
+constexpr uint8_t kAllRepoPermissions = 0b11111;
+constexpr size_t kIpfsHashSize = 46;
+constexpr size_t kMaxChunkSize = 100000;
+
+using Hash256 = std::array<uint8_t, kHashSize>;
+
+// The contract uses SHA-256 for the name hashes
+Hash256 Sha256(std::string_view s) {
+    static constexpr uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+        0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
+        0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+        0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+        0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
+        0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+        0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+        0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+        0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
+        0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+        0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                     0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    auto rotr = [](uint32_t x, int n) {
+        return (x >> n) | (x << (32 - n));
+    };
+
+    std::string msg(s);
+    msg.push_back('\x80');
+    while (msg.size() % 64 != 56) {
+        msg.push_back('\0');
+    }
+    uint64_t bits = static_cast<uint64_t>(s.size()) * 8;
+    for (int i = 7; i >= 0; --i) {
+        msg.push_back(static_cast<char>(bits >> (i * 8)));
+    }
+
+    for (size_t chunk = 0; chunk < msg.size(); chunk += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            const auto* p =
+                reinterpret_cast<const uint8_t*>(msg.data() + chunk + i * 4);
+            w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+                   (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+        }
+        for (int i = 16; i < 64; ++i) {
+            auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^
+                      (w[i - 15] >> 3);
+            auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^
+                      (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a[8];
+        std::copy(h, h + 8, a);
+        for (int i = 0; i < 64; ++i) {
+            auto s1 = rotr(a[4], 6) ^ rotr(a[4], 11) ^ rotr(a[4], 25);
+            auto ch = (a[4] & a[5]) ^ (~a[4] & a[6]);
+            auto t1 = a[7] + s1 + ch + k[i] + w[i];
+            auto s0 = rotr(a[0], 2) ^ rotr(a[0], 13) ^ rotr(a[0], 22);
+            auto maj = (a[0] & a[1]) ^ (a[0] & a[2]) ^ (a[1] & a[2]);
+            std::copy_backward(a, a + 7, a + 8);
+            a[4] += t1;
+            a[0] = t1 + s0 + maj;
+        }
+        for (int i = 0; i < 8; ++i) {
+            h[i] += a[i];
+        }
+    }
+
+    Hash256 res;
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            res[i * 4 + j] = static_cast<uint8_t>(h[i] >> (24 - j * 8));
+        }
+    }
+    return res;
+}
+
+template <typename T>
+void Put(ByteBuffer& buf, T value) {
+    const auto* p = reinterpret_cast<const uint8_t*>(&value);
+    buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+void Put(ByteBuffer& buf, const void* data, size_t size) {
+    const auto* p = static_cast<const uint8_t*>(data);
+    buf.insert(buf.end(), p, p + size);
+}
+
+template <typename T>
+T Get(const uint8_t* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+// Repo::BaseKey, the repo id is big-endian
+ByteBuffer MakeRepoKey(Tag tag, uint64_t repo_id) {
+    ByteBuffer key{tag};
+    for (int i = 7; i >= 0; --i) {
+        key.push_back(static_cast<uint8_t>(repo_id >> (i * 8)));
+    }
+    return key;
+}
+
+ByteBuffer MakeMetaKey(uint64_t repo_id, uint64_t obj_id) {
+    auto key = MakeRepoKey(kObjects, repo_id);
+    Put(key, obj_id);
+    return key;
+}
+
+ByteBuffer MakeDataKey(uint64_t repo_id, const uint8_t* oid) {
+    auto key = MakeRepoKey(kObjects, repo_id);
+    Put(key, oid, kOidSize);
+    return key;
+}
+
+// GitObject::Shared::DataKey and RefsKey
+ByteBuffer MakeSharedKey(Tag tag, const uint8_t* oid) {
+    ByteBuffer key{tag};
+    Put(key, oid, kOidSize);
+    return key;
+}
+
+ByteBuffer MakeSharedMemberKey(uint64_t repo_id, const uint8_t* oid) {
+    auto key = MakeRepoKey(kSharedObjectMember, repo_id);
+    Put(key, oid, kOidSize);
+    return key;
+}
+
+// Pack::IndexKey and DataKey, the id is big-endian
+ByteBuffer MakePackKey(Tag tag, uint64_t repo_id, uint64_t first_id) {
+    auto key = MakeRepoKey(tag, repo_id);
+    for (int i = 7; i >= 0; --i) {
+        key.push_back(static_cast<uint8_t>(first_id >> (i * 8)));
+    }
+    return key;
+}
+
+// Pack::BucketKey, the value is Pack::Slot[] sorted by the oid bytes after
+// the prefix
+constexpr size_t kSlotHashSize = 4;
+constexpr size_t kSlotSize =
+    kSlotHashSize + sizeof(uint64_t) + sizeof(uint32_t);
+
+ByteBuffer MakeBucketKey(uint64_t repo_id, const uint8_t* oid) {
+    auto key = MakeRepoKey(kPackedObject, repo_id);
+    key.push_back(oid[0]);
+    return key;
+}
+
+// GitObject::Chunked::ChunkKey, the index is big-endian
+ByteBuffer MakeChunkKey(uint64_t repo_id, const uint8_t* oid, uint32_t index) {
+    auto key = MakeRepoKey(kObjectChunk, repo_id);
+    Put(key, oid, kOidSize);
+    for (int i = 3; i >= 0; --i) {
+        key.push_back(static_cast<uint8_t>(index >> (i * 8)));
+    }
+    return key;
+}
+
+ByteBuffer MakeChunkMarkerKey(uint64_t repo_id, const uint8_t* oid) {
+    auto key = MakeRepoKey(kChunkedObject, repo_id);
+    Put(key, oid, kOidSize);
+    return key;
+}
+
+ByteBuffer MakeRefKey(uint64_t repo_id, const Hash256& name_hash) {
+    auto key = MakeRepoKey(kRefs, repo_id);
+    Put(key, name_hash.data(), name_hash.size());
+    return key;
+}
+
+ByteBuffer MakeNameKey(const ByteBuffer& owner, const Hash256& name_hash) {
+    auto key = owner;
+    Put(key, name_hash.data(), name_hash.size());
+    return key;
+}
+
+ByteBuffer MakeMemberKey(const ByteBuffer& user, uint64_t repo_id) {
+    ByteBuffer key{kRepoMember};
+    Put(key, user.data(), user.size());
+    Put(key, repo_id);
+    return key;
+}
+
+struct RepoRecord {
+    uint64_t project_id = 0;
+    Hash256 name_hash{};
+    uint64_t repo_id = 0;
+    uint32_t cur_objs_number = 0;
+    ByteBuffer owner;
+    std::string name;
+
+    ByteBuffer Encode() const {
+        ByteBuffer buf;
+        Put(buf, project_id);
+        Put(buf, name_hash.data(), name_hash.size());
+        Put(buf, repo_id);
+        Put(buf, cur_objs_number);
+        Put(buf, owner.data(), owner.size());
+        Put(buf, static_cast<uint32_t>(name.size()));
+        Put(buf, name.data(), name.size());
+        return buf;
+    }
+
+    static RepoRecord Decode(const ByteBuffer& buf) {
+        RepoRecord repo;
+        const auto* p = buf.data();
+        repo.project_id = Get<uint64_t>(p);
+        p += sizeof(uint64_t);
+        std::copy_n(p, kHashSize, repo.name_hash.begin());
+        p += kHashSize;
+        repo.repo_id = Get<uint64_t>(p);
+        p += sizeof(uint64_t);
+        repo.cur_objs_number = Get<uint32_t>(p);
+        p += sizeof(uint32_t);
+        repo.owner.assign(p, p + kPubKeySize);
+        p += kPubKeySize;
+        auto name_len = Get<uint32_t>(p);
+        p += sizeof(uint32_t);
+        repo.name.assign(reinterpret_cast<const char*>(p), name_len);
+        return repo;
+    }
+};
+
+// GitObject::Meta
+struct MetaRecord {
+    int8_t type;
+    uint64_t id;
+    uint8_t hash[kOidSize];
+    uint32_t data_size;
+
+    static constexpr size_t kSize = 1 + 8 + kOidSize + 4;
+};
+
+ByteBuffer FromHex(std::string_view hex) {
+    ByteBuffer res;
+    res.reserve(hex.size() / 2);
+    boost::algorithm::unhex(hex.begin(), hex.end(), std::back_inserter(res));
+    return res;
+}
+
+// Cursor pagination of the listings, as done by the app shader
+class Page {
+public:
+    static constexpr uint32_t kMaxLimit = 1000;
+
+    template <typename Args>
+    explicit Page(const Args& args) {
+        if (auto it = args.find("start_key"); it != args.end()) {
+            start_ = FromHex(it->second);
+        }
+        if (auto it = args.find("limit"); it != args.end()) {
+            std::istringstream(it->second) >> limit_;
+        }
+        if (limit_ == 0 || limit_ > kMaxLimit) {
+            limit_ = kMaxLimit;
+        }
+    }
+
+    // Keys before the first key of the listing are ignored
+    ByteBuffer GetStart(const ByteBuffer& first) const {
+        return start_.size() == first.size() && first < start_ ? start_
+                                                               : first;
+    }
+
+    bool Add(const ByteBuffer& key, uint32_t count = 1) {
+        if (count_ != 0 && count_ + count > limit_) {
+            next_ = key;
+            return false;
+        }
+        count_ += count;
+        return true;
+    }
+
+    bool HasNext() const {
+        return !next_.empty();
+    }
+
+    void AddNext(json::object& page) const {
+        if (HasNext()) {
+            page["next"] = ToHex(next_.data(), next_.size());
+        }
+    }
+
+private:
+    ByteBuffer start_;
+    ByteBuffer next_;
+    uint32_t limit_ = 0;
+    uint32_t count_ = 0;
+};
+
+std::string MakeError(std::string_view message) {
+    return json::serialize(json::object{{"error", message}});
+}
+
+json::object MakeRpcError(int code, std::string_view message,
+                          std::string_view data = {}) {
+    return json::object{{"code", code}, {"message", message}, {"data", data}};
+}
+}  // namespace
+
+class MockWalletServer::Session
+    : public std::enable_shared_from_this<MockWalletServer::Session> {
+public:
+    Session(MockWalletServer& server, tcp::socket socket)
+        : server_(server),
+          socket_(std::move(socket)),
+          flush_timer_(socket_.get_executor()) {
+    }
+
+    ~Session() {
+        std::lock_guard<std::mutex> lock(server_.counts_mutex_);
+        server_.subscribers_.erase(this);
+    }
+
+    void Start() {
+        if (server_.options_.http) {
+            DoReadHttp();
+        } else {
+            DoRead();
+        }
+    }
+
+    void Reply(std::string message, std::chrono::milliseconds delay) {
+        if (delay.count() == 0) {
+            Send(std::move(message));
+            return;
+        }
+        auto timer =
+            std::make_shared<net::steady_timer>(socket_.get_executor(), delay);
+        timer->async_wait([self = shared_from_this(), timer,
+                           message = std::move(message)](
+                              const boost::system::error_code&) mutable {
+            self->Send(std::move(message));
+        });
+    }
+
+    void Write(std::string message) {
+        if (server_.options_.http) {
+            http::response<http::string_body> response{http::status::ok,
+                                                       request_.version()};
+            response.set(http::field::content_type, "application/json");
+            response.keep_alive(request_.keep_alive());
+            response.body() = std::move(message);
+            response.prepare_payload();
+            std::ostringstream os;
+            os << response;
+            message = os.str();
+        } else {
+            message.push_back('\n');
+        }
+        queue_.push_back(std::move(message));
+        if (queue_.size() == 1) {
+            DoWrite();
+        }
+    }
+
+private:
+    void Send(std::string message) {
+        const auto& options = server_.options_;
+        if (options.http) {
+            // the next request is read once this one is answered
+            Write(std::move(message));
+            if (request_.keep_alive()) {
+                DoReadHttp();
+            }
+            return;
+        }
+        if (options.eventsBetweenReplies) {
+            Write(server_.MakeSystemStateEvent());
+        }
+        if (options.reorderReplies < 2) {
+            Write(std::move(message));
+            return;
+        }
+        held_.push_back(std::move(message));
+        if (held_.size() >= options.reorderReplies) {
+            Flush();
+        } else if (held_.size() == 1) {
+            flush_timer_.expires_after(options.latency);
+            flush_timer_.async_wait([self = shared_from_this()](
+                                        const boost::system::error_code& ec) {
+                if (!ec) {
+                    self->Flush();
+                }
+            });
+        }
+    }
+
+    void Flush() {
+        flush_timer_.cancel();
+        for (; !held_.empty(); held_.pop_back()) {
+            Write(std::move(held_.back()));
+        }
+    }
+
+    void DoRead() {
+        net::async_read_until(
+            socket_, net::dynamic_buffer(buffer_), '\n',
+            [self = shared_from_this()](const boost::system::error_code& ec,
+                                        size_t n) {
+                if (ec) {
+                    return;
+                }
+                auto request = self->buffer_.substr(0, n);
+                self->buffer_.erase(0, n);
+                std::chrono::milliseconds delay{0};
+                auto response =
+                    self->server_.HandleRequest(*self, request, delay);
+                if (++self->requests_ == self->server_.options_.dropAfter) {
+                    boost::system::error_code ignored;
+                    self->socket_.close(ignored);
+                    return;
+                }
+                self->Reply(std::move(response), delay);
+                self->DoRead();
+            });
+    }
+
+    void DoReadHttp() {
+        request_ = {};
+        http::async_read(
+            socket_, http_buffer_, request_,
+            [self = shared_from_this()](const boost::system::error_code& ec,
+                                        size_t) {
+                if (ec) {
+                    return;
+                }
+                std::chrono::milliseconds delay{0};
+                auto response = self->server_.HandleRequest(
+                    *self, self->request_.body(), delay);
+                if (++self->requests_ == self->server_.options_.dropAfter) {
+                    boost::system::error_code ignored;
+                    self->socket_.close(ignored);
+                    return;
+                }
+                self->Reply(std::move(response), delay);
+            });
+    }
+
+    void DoWrite() {
+        net::async_write(
+            socket_, net::buffer(queue_.front()),
+            [self = shared_from_this()](const boost::system::error_code& ec,
+                                        size_t) {
+                if (ec) {
+                    return;
+                }
+                self->queue_.pop_front();
+                if (!self->queue_.empty()) {
+                    self->DoWrite();
+                }
+            });
+    }
+
+private:
+    MockWalletServer& server_;
+    tcp::socket socket_;
+    std::string buffer_;
+    boost::beast::flat_buffer http_buffer_;
+    http::request<http::string_body> request_;
+    std::deque<std::string> queue_;
+    std::vector<std::string> held_;
+    net::steady_timer flush_timer_;
+    size_t requests_ = 0;
+};
+
+MockWalletServer::MockWalletServer(const Options& options)
+    : options_(options), acceptor_(ioc_) {
+    tcp::endpoint endpoint(net::ip::address_v4::loopback(), options_.port);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+
+    auto cid = Sha256("sourc3 mock contract");
+    cid_ = ToHex(cid.data(), cid.size());
+    auto key = Sha256("sourc3 mock user");
+    user_key_ = ToHex(key.data(), key.size()) + "00";
+    DoAccept();
+}
+
+MockWalletServer::~MockWalletServer() {
+    Stop();
+}
+
+uint64_t MockWalletServer::CreateRepo(const std::string& owner,
+                                      const std::string& name) {
+    auto owner_key = FromHex(owner);
+    if (owner_key.size() != kPubKeySize) {
+        throw std::invalid_argument("invalid owner key: " + owner);
+    }
+    auto name_key = MakeNameKey(owner_key, Sha256(name));
+    if (store_.count(name_key) != 0) {
+        throw std::runtime_error("repo exists");
+    }
+
+    RepoRecord repo;
+    repo.name_hash = Sha256(name);
+    repo.repo_id = ++last_repo_id_;
+    repo.owner = owner_key;
+    repo.name = name;
+    store_[MakeRepoKey(kRepo, repo.repo_id)] = repo.Encode();
+    ByteBuffer id;
+    Put(id, repo.repo_id);
+    store_[name_key] = std::move(id);
+    store_[MakeMemberKey(owner_key, repo.repo_id)] = {kAllRepoPermissions};
+    return repo.repo_id;
+}
+
+void MockWalletServer::Start() {
+    thread_ = std::thread([this] {
+        Run();
+    });
+}
+
+void MockWalletServer::Run() {
+    ioc_.run();
+}
+
+void MockWalletServer::Stop() {
+    ioc_.stop();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+uint16_t MockWalletServer::GetPort() const {
+    return acceptor_.local_endpoint().port();
+}
+
+std::map<std::string, uint64_t> MockWalletServer::GetRequestCounts() const {
+    std::lock_guard<std::mutex> lock(counts_mutex_);
+    return request_counts_;
+}
+
+size_t MockWalletServer::GetSubscriberCount() const {
+    std::lock_guard<std::mutex> lock(counts_mutex_);
+    return subscribers_.size();
+}
+
+void MockWalletServer::DoAccept() {
+    acceptor_.async_accept([this](const boost::system::error_code& ec,
+                                  tcp::socket socket) {
+        if (ec) {
+            return;
+        }
+        socket.set_option(tcp::no_delay(true));
+        std::make_shared<Session>(*this, std::move(socket))->Start();
+        DoAccept();
+    });
+}
+
+std::string MockWalletServer::HandleRequest(Session& session,
+                                            const std::string& request,
+                                            std::chrono::milliseconds& delay) {
+    json::object response{{"jsonrpc", "2.0"}};
+    json::error_code ec;
+    auto root = json::parse(request, ec);
+    if (ec || !root.is_object()) {
+        response["id"] = nullptr;
+        response["error"] = MakeRpcError(-32700, "Parse error");
+        return json::serialize(response);
+    }
+
+    auto& r = root.as_object();
+    if (auto* id = r.if_contains("id"); id != nullptr) {
+        response["id"] = *id;
+    }
+    std::string method;
+    if (auto* m = r.if_contains("method"); m != nullptr && m->is_string()) {
+        method = m->as_string().c_str();
+    }
+    json::object params;
+    if (auto* p = r.if_contains("params"); p != nullptr && p->is_object()) {
+        params = p->as_object();
+    }
+    {
+        std::lock_guard<std::mutex> lock(counts_mutex_);
+        ++request_counts_[method];
+    }
+
+    delay = options_.latency;
+    if (method == "invoke_contract") {
+        Args args;
+        if (auto* a = params.if_contains("args"); a != nullptr && a->is_string()) {
+            std::string_view sv = a->as_string();
+            while (!sv.empty()) {
+                auto item = sv.substr(0, sv.find(','));
+                sv.remove_prefix(std::min(sv.size(), item.size() + 1));
+                auto p = item.find('=');
+                if (p != std::string_view::npos) {
+                    args.emplace(item.substr(0, p), item.substr(p + 1));
+                }
+            }
+        }
+        std::string txid;
+        json::object result{{"output", InvokeContract(args, txid)}};
+        if (!txid.empty()) {
+            result["txid"] = txid;
+        }
+        response["result"] = std::move(result);
+    } else if (method == "ipfs_add") {
+        delay += options_.ipfsLatency;
+        ByteBuffer data;
+        if (auto* d = params.if_contains("data"); d != nullptr && d->is_array()) {
+            data.reserve(d->as_array().size());
+            for (const auto& v : d->as_array()) {
+                data.push_back(v.to_number<uint8_t>());
+            }
+        }
+        auto hash = Sha256(std::string_view(
+            reinterpret_cast<const char*>(data.data()), data.size()));
+        // same length as CIDv0 the helper stores in the contract
+        auto address = "Qm" + ToHex(hash.data(), hash.size())
+                                  .substr(0, kIpfsHashSize - 2);
+        ipfs_[address] = std::move(data);
+        response["result"] = json::object{{"hash", address}};
+    } else if (method == "ipfs_get") {
+        delay += options_.ipfsLatency;
+        std::string hash;
+        if (auto* h = params.if_contains("hash"); h != nullptr && h->is_string()) {
+            hash = h->as_string().c_str();
+        }
+        if (auto it = ipfs_.find(hash); it != ipfs_.end()) {
+            response["result"] = json::object{
+                {"hash", hash},
+                {"data", json::array(it->second.begin(), it->second.end())}};
+        } else {
+            response["error"] =
+                MakeRpcError(-32603, "IPFS object not found", hash);
+        }
+    } else if (method == "ev_subunsub") {
+        if (auto* sub = params.if_contains("ev_txs_changed");
+            sub != nullptr && sub->is_bool()) {
+            std::lock_guard<std::mutex> lock(counts_mutex_);
+            if (sub->as_bool()) {
+                subscribers_.insert(&session);
+            } else {
+                subscribers_.erase(&session);
+            }
+        }
+        response["result"] = json::object{{"result", true}};
+    } else if (method == "tx_status") {
+        std::string txid;
+        if (auto* t = params.if_contains("txId"); t != nullptr && t->is_string()) {
+            txid = t->as_string().c_str();
+        }
+        if (auto it = transactions_.find(txid); it != transactions_.end()) {
+            json::object result{{"txId", txid},
+                                {"status", it->second.status}};
+            if (!it->second.failure_reason.empty()) {
+                result["failure_reason"] = it->second.failure_reason;
+            }
+            response["result"] = std::move(result);
+        } else {
+            response["error"] = MakeRpcError(-32602, "Unknown transaction", txid);
+        }
+    } else {
+        response["error"] = MakeRpcError(-32601, "Method not found", method);
+    }
+    return json::serialize(response);
+}
+
+std::string MockWalletServer::InvokeContract(const Args& args,
+                                             std::string& txid) {
+    auto get = [&](std::string_view name) -> std::string_view {
+        auto it = args.find(name);
+        return it == args.end() ? std::string_view{} : it->second;
+    };
+    auto role = get("role");
+    auto action = get("action");
+    if (role == "manager" && action == "view_contracts") {
+        return ViewContracts();
+    }
+    if (role != "user") {
+        return MakeError("unknown role");
+    }
+    if (action == "get_key") {
+        return json::serialize(json::object{{"key", user_key_}});
+    }
+    if (action == "repo_id_by_name") {
+        return GetRepoId(args);
+    }
+    if (action == "create_repo") {
+        return CreateRepoAction(args, txid);
+    }
+
+    uint64_t repo_id = 0;
+    auto id = get("repo_id");
+    if (id.empty() || !(std::istringstream(std::string(id)) >> repo_id)) {
+        return MakeError("failed to read 'repo_id'");
+    }
+    if ((action == "repo_get_meta" || action == "list_refs") &&
+        store_.count(MakeRepoKey(kRepo, repo_id)) == 0) {
+        return MakeError("repo not found");
+    }
+    if (action == "repo_get_meta") {
+        return GetRepoMeta(repo_id, args);
+    }
+    if (action == "repo_get_data") {
+        uint32_t chunk = 0;
+        std::istringstream(std::string(get("chunk"))) >> chunk;
+        return GetRepoData(repo_id, std::string(get("obj_id")), chunk);
+    }
+    if (action == "list_refs") {
+        return ListRefs(repo_id, args);
+    }
+    if (action == "push_refs") {
+        return PushRefs(repo_id, args, txid);
+    }
+    if (action == "push_objects") {
+        return PushObjects(repo_id, args, txid);
+    }
+    if (action == "push_object_chunk") {
+        return PushObjectChunk(repo_id, args, txid);
+    }
+    return MakeError("unknown action");
+}
+
+std::string MockWalletServer::ViewContracts() const {
+    json::array contracts{json::object{{"cid", cid_}, {"Height", 1}}};
+    return json::serialize(json::object{{"contracts", std::move(contracts)}});
+}
+
+std::string MockWalletServer::GetRepoId(const Args& args) const {
+    auto name = args.find("repo_name");
+    auto owner = args.find("repo_owner");
+    if (name == args.end() || name->second.empty()) {
+        return MakeError("'repo_name' required");
+    }
+    auto owner_key =
+        owner == args.end() ? ByteBuffer{} : FromHex(owner->second);
+    owner_key.resize(kPubKeySize);
+    auto it = store_.find(MakeNameKey(owner_key, Sha256(name->second)));
+    if (it == store_.end()) {
+        return MakeError("Failed to read repo ids");
+    }
+    return json::serialize(
+        json::object{{"repo_id", Get<uint64_t>(it->second.data())}});
+}
+
+std::string MockWalletServer::GetRepoMeta(uint64_t repo_id,
+                                          const Args& args) const {
+    constexpr size_t kEntrySize = 1 + kOidSize + sizeof(uint32_t);
+    constexpr auto kMaxId = std::numeric_limits<uint64_t>::max();
+    Page page(args);
+    // the meta records are listed before the packs, the keys have the same
+    // layout
+    auto start = page.GetStart(MakeMetaKey(repo_id, 0));
+    json::array objects;
+    auto add_object = [&objects](int8_t type, const uint8_t* hash,
+                                 uint32_t size) {
+        objects.push_back(json::object{
+            {"object_hash", ToHex(hash, kOidSize)},
+            {"object_type", static_cast<uint32_t>(type)},
+            {"object_size", size}});
+    };
+    if (start[0] == kObjects) {
+        auto end = MakeMetaKey(repo_id, kMaxId);
+        for (auto it = store_.lower_bound(start);
+             it != store_.end() && it->first <= end; ++it) {
+            // data keys share the prefix, only meta values are read
+            if (it->first.size() != start.size() ||
+                it->second.size() != MetaRecord::kSize) {
+                continue;
+            }
+            if (!page.Add(it->first)) {
+                break;
+            }
+            const auto* p = it->second.data();
+            const auto* hash = p + 1 + sizeof(uint64_t);
+            add_object(static_cast<int8_t>(p[0]), hash,
+                       Get<uint32_t>(hash + kOidSize));
+        }
+    }
+    if (!page.HasNext() && (start[0] == kObjects || start[0] == kPackIndex)) {
+        if (start[0] == kObjects) {
+            start = MakePackKey(kPackIndex, repo_id, 0);
+        }
+        auto end = MakePackKey(kPackIndex, repo_id, kMaxId);
+        for (auto it = store_.lower_bound(start);
+             it != store_.end() && it->first <= end; ++it) {
+            const auto& index = it->second;
+            if (!page.Add(it->first,
+                          static_cast<uint32_t>(index.size() / kEntrySize))) {
+                break;
+            }
+            for (size_t i = 0; i + kEntrySize <= index.size();
+                 i += kEntrySize) {
+                const auto* entry = index.data() + i;
+                add_object(static_cast<int8_t>(entry[0]), entry + 1,
+                           Get<uint32_t>(entry + 1 + kOidSize));
+            }
+        }
+    }
+    json::object res{{"objects", std::move(objects)}};
+    page.AddNext(res);
+    return json::serialize(res);
+}
+
+std::string MockWalletServer::GetRepoData(uint64_t repo_id,
+                                          const std::string& obj_id,
+                                          uint32_t chunk) const {
+    auto oid = FromHex(obj_id);
+    oid.resize(kOidSize);
+    // chunked objects are streamed one chunk per call
+    if (auto marker = store_.find(MakeChunkMarkerKey(repo_id, oid.data()));
+        marker != store_.end()) {
+        auto chunk_it = store_.find(MakeChunkKey(repo_id, oid.data(), chunk));
+        std::string data;
+        if (chunk_it != store_.end()) {
+            data = ToHex(chunk_it->second.data(), chunk_it->second.size());
+        }
+        auto chunks_number = Get<uint32_t>(marker->second.data());
+        return json::serialize(json::object{{"chunks_number", chunks_number},
+                                            {"object_data", data}});
+    }
+    auto it = store_.find(MakeDataKey(repo_id, oid.data()));
+    if (it == store_.end() &&
+        store_.count(MakeSharedMemberKey(repo_id, oid.data())) != 0) {
+        it = store_.find(MakeSharedKey(kSharedObjectData, oid.data()));
+    }
+    std::string data;
+    uint64_t first_id = 0;
+    uint32_t offset = 0, size = 0;
+    if (it != store_.end()) {
+        data = ToHex(it->second.data(), it->second.size());
+    } else if (FindPackedObject(repo_id, oid.data(), first_id, offset,
+                                size)) {
+        const auto& pack =
+            store_.at(MakePackKey(kPackData, repo_id, first_id));
+        data = ToHex(pack.data() + offset, size);
+    }
+    return json::serialize(json::object{{"object_data", data}});
+}
+
+std::string MockWalletServer::ListRefs(uint64_t repo_id,
+                                       const Args& args) const {
+    Hash256 min_hash{};
+    Hash256 max_hash;
+    max_hash.fill(0xff);
+    Page page(args);
+    auto start = page.GetStart(MakeRefKey(repo_id, min_hash));
+    auto end = MakeRefKey(repo_id, max_hash);
+    json::array refs;
+    for (auto it = store_.lower_bound(start);
+         it != store_.end() && it->first <= end && page.Add(it->first);
+         ++it) {
+        // GitRef
+        const auto* p = it->second.data();
+        auto name_len = Get<uint32_t>(p + kOidSize);
+        std::string name(
+            reinterpret_cast<const char*>(p + kOidSize + sizeof(uint32_t)),
+            name_len);
+        refs.push_back(json::object{{"name", name},
+                                    {"commit_hash", ToHex(p, kOidSize)}});
+    }
+    json::object res{{"refs", std::move(refs)}};
+    page.AddNext(res);
+    return json::serialize(res);
+}
+
+std::string MockWalletServer::CreateRepoAction(const Args& args,
+                                               std::string& txid) {
+    auto name = args.find("repo_name");
+    if (name == args.end() || name->second.empty()) {
+        return MakeError("'repo_name' required");
+    }
+    txid = AddTransaction([this, name = name->second] {
+        CreateRepo(user_key_, name);
+    });
+    return "{}";
+}
+
+std::string MockWalletServer::PushObjects(uint64_t repo_id, const Args& args,
+                                          std::string& txid) {
+    auto data = args.find("data");
+    if (data == args.end()) {
+        return MakeError("failed to read 'data'");
+    }
+    auto buf = FromHex(data->second);
+
+    // ObjectsInfo followed by PackedObject{type, hash, data_size} and data
+    constexpr size_t kHeaderSize = 1 + kOidSize + sizeof(uint32_t);
+    if (buf.size() < sizeof(uint32_t)) {
+        return MakeError("failed to read 'data'");
+    }
+    auto count = Get<uint32_t>(buf.data());
+    size_t offset = sizeof(uint32_t);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (buf.size() - offset < kHeaderSize ||
+            buf.size() - offset - kHeaderSize <
+                Get<uint32_t>(buf.data() + offset + 1 + kOidSize)) {
+            return MakeError("failed to read 'data'");
+        }
+        offset += kHeaderSize +
+                  Get<uint32_t>(buf.data() + offset + 1 + kOidSize);
+    }
+
+    ByteBuffer ref_value;
+    Hash256 ref_hash{};
+    if (auto ref = args.find("ref"); ref != args.end()) {
+        auto target = args.find("ref_target");
+        if (target == args.end()) {
+            return MakeError("failed to read 'ref_target'");
+        }
+        auto oid = FromHex(target->second);
+        oid.resize(kOidSize);
+        Put(ref_value, oid.data(), oid.size());
+        Put(ref_value, static_cast<uint32_t>(ref->second.size()));
+        Put(ref_value, ref->second.data(), ref->second.size());
+        ref_hash = Sha256(ref->second);
+    }
+
+    // PushObjectsIfMissing skips stored objects instead of failing,
+    // PushSharedObjects does it too and references the shared data if it
+    // has the same bytes, PushObjectPack gets only the missing objects
+    auto is_set = [&args](std::string_view name) {
+        auto it = args.find(name);
+        return it != args.end() && it->second != "0";
+    };
+    bool shared = is_set("shared");
+    bool pack = is_set("pack");
+    bool skip_existing = shared || pack || is_set("skip_existing");
+    uint32_t new_objects = 0;
+    uint32_t shared_objects = 0;
+    if (skip_existing) {
+        offset = sizeof(uint32_t);
+        for (uint32_t i = 0; i < count; ++i) {
+            const auto* hash = buf.data() + offset + 1;
+            new_objects += !HasObject(repo_id, hash);
+            auto size = Get<uint32_t>(hash + kOidSize);
+            if (shared) {
+                auto data = store_.find(MakeSharedKey(kSharedObjectData, hash));
+                shared_objects +=
+                    data != store_.end() &&
+                    data->second ==
+                        ByteBuffer(hash + kOidSize + sizeof(uint32_t),
+                                   hash + kOidSize + sizeof(uint32_t) + size);
+            }
+            offset += kHeaderSize + size;
+        }
+    }
+
+    // the contract halts the whole transaction on failure, everything is
+    // checked before the first write
+    txid = AddTransaction([this, repo_id, count, skip_existing, shared, pack,
+                           buf = std::move(buf),
+                           ref_value = std::move(ref_value), ref_hash] {
+        auto repo_it = store_.find(MakeRepoKey(kRepo, repo_id));
+        if (repo_it == store_.end()) {
+            throw std::runtime_error("repo not found");
+        }
+        auto member = store_.find(MakeMemberKey(FromHex(user_key_), repo_id));
+        if (member == store_.end() || member->second.empty() ||
+            (member->second[0] & kPushPermission) == 0) {
+            throw std::runtime_error("no permissions");
+        }
+        auto repo = RepoRecord::Decode(repo_it->second);
+
+        std::set<ByteBuffer> new_keys;
+        std::vector<bool> skipped(count);
+        size_t offset = sizeof(uint32_t);
+        for (uint32_t i = 0; i < count; ++i) {
+            const auto* hash = buf.data() + offset + 1;
+            auto key = MakeDataKey(repo_id, hash);
+            if (HasObject(repo_id, hash) || !new_keys.insert(key).second) {
+                if (!skip_existing) {
+                    throw std::runtime_error("object exists");
+                }
+                skipped[i] = true;
+            }
+            offset += kHeaderSize + Get<uint32_t>(hash + kOidSize);
+        }
+
+        if (!ref_value.empty()) {
+            store_[MakeRefKey(repo_id, ref_hash)] = ref_value;
+        }
+        offset = sizeof(uint32_t);
+        if (pack) {
+            uint64_t first_id = repo.cur_objs_number;
+            ByteBuffer index;
+            ByteBuffer pack_data;
+            for (uint32_t i = 0; i < count; ++i) {
+                const auto* p = buf.data() + offset;
+                auto size = Get<uint32_t>(p + 1 + kOidSize);
+                if (!skipped[i]) {
+                    ByteBuffer slot(p + 2, p + 2 + kSlotHashSize);
+                    Put(slot, first_id);
+                    Put(slot, static_cast<uint32_t>(index.size() /
+                                                    kHeaderSize));
+                    auto& bucket = store_[MakeBucketKey(repo_id, p + 1)];
+                    auto pos = bucket.begin();
+                    while (pos != bucket.end() &&
+                           std::memcmp(&*pos, slot.data(), kSlotHashSize) <
+                               0) {
+                        pos += kSlotSize;
+                    }
+                    bucket.insert(pos, slot.begin(), slot.end());
+                    Put(index, p, kHeaderSize);
+                    Put(pack_data, p + kHeaderSize, size);
+                }
+                offset += kHeaderSize + size;
+            }
+            if (!index.empty()) {
+                store_[MakePackKey(kPackIndex, repo_id, first_id)] = index;
+                store_[MakePackKey(kPackData, repo_id, first_id)] = pack_data;
+                repo.cur_objs_number +=
+                    static_cast<uint32_t>(index.size() / kHeaderSize);
+            }
+            store_[MakeRepoKey(kRepo, repo_id)] = repo.Encode();
+            return;
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            const auto* p = buf.data() + offset;
+            const auto* hash = p + 1;
+            auto size = Get<uint32_t>(hash + kOidSize);
+            const auto* obj_data = hash + kOidSize + sizeof(uint32_t);
+            offset += kHeaderSize + size;
+            if (skipped[i]) {
+                continue;
+            }
+            ByteBuffer data(obj_data, obj_data + size);
+            auto shared_data =
+                store_.find(MakeSharedKey(kSharedObjectData, hash));
+            // different bytes under the oid stay with the repo
+            if (shared && (shared_data == store_.end() ||
+                           shared_data->second == data)) {
+                auto& refs = store_[MakeSharedKey(kSharedObjectRefs, hash)];
+                uint32_t ref_count = 0;
+                if (refs.empty()) {
+                    store_[MakeSharedKey(kSharedObjectData, hash)] =
+                        std::move(data);
+                } else {
+                    ref_count = Get<uint32_t>(refs.data());
+                }
+                refs.clear();
+                Put(refs, ref_count + 1);
+                ByteBuffer member;
+                Put(member, static_cast<uint64_t>(repo.cur_objs_number));
+                store_[MakeSharedMemberKey(repo_id, hash)] = member;
+            } else {
+                store_[MakeDataKey(repo_id, hash)] = std::move(data);
+            }
+
+            ByteBuffer meta;
+            Put(meta, static_cast<int8_t>(p[0]));
+            Put(meta, static_cast<uint64_t>(repo.cur_objs_number));
+            Put(meta, hash, kOidSize);
+            Put(meta, size);
+            store_[MakeMetaKey(repo_id, repo.cur_objs_number++)] =
+                std::move(meta);
+        }
+        store_[MakeRepoKey(kRepo, repo_id)] = repo.Encode();
+    });
+    json::object objects{{"count", count}};
+    if (skip_existing) {
+        objects["new_count"] = new_objects;
+    }
+    if (shared) {
+        objects["shared_count"] = shared_objects;
+    }
+    return json::serialize(
+        json::object{{"repo_id", repo_id}, {"objects", std::move(objects)}});
+}
+
+std::string MockWalletServer::PushRefs(uint64_t repo_id, const Args& args,
+                                       std::string& txid) {
+    auto ref = args.find("ref");
+    if (ref == args.end() || ref->second.empty()) {
+        return MakeError("failed to read 'ref'");
+    }
+    auto target = args.find("ref_target");
+    if (target == args.end()) {
+        return MakeError("failed to read 'ref_target'");
+    }
+    auto new_target = FromHex(target->second);
+    new_target.resize(kOidSize);
+    // PushRefsIfUnchanged, without the old target the ref must not exist
+    ByteBuffer old_target(kOidSize);
+    if (auto old = args.find("ref_old_target"); old != args.end()) {
+        old_target = FromHex(old->second);
+        old_target.resize(kOidSize);
+    }
+
+    ByteBuffer ref_value = new_target;
+    Put(ref_value, static_cast<uint32_t>(ref->second.size()));
+    Put(ref_value, ref->second.data(), ref->second.size());
+    txid = AddTransaction([this, repo_id, ref_key = MakeRefKey(
+                                              repo_id, Sha256(ref->second)),
+                           ref_value = std::move(ref_value),
+                           old_target = std::move(old_target)] {
+        auto member = store_.find(MakeMemberKey(FromHex(user_key_), repo_id));
+        if (member == store_.end() || member->second.empty() ||
+            (member->second[0] & kPushPermission) == 0) {
+            throw std::runtime_error("no permissions");
+        }
+        ByteBuffer current(kOidSize);
+        if (auto it = store_.find(ref_key); it != store_.end()) {
+            current.assign(it->second.begin(),
+                           it->second.begin() + kOidSize);
+        }
+        if (current != old_target) {
+            throw std::runtime_error("ref has been changed");
+        }
+        store_[ref_key] = ref_value;
+    });
+    return "{}";
+}
+
+std::string MockWalletServer::PushObjectChunk(uint64_t repo_id,
+                                              const Args& args,
+                                              std::string& txid) {
+    auto get_number = [&args](std::string_view name, uint32_t& value) {
+        auto it = args.find(name);
+        return it != args.end() &&
+               static_cast<bool>(std::istringstream(it->second) >> value);
+    };
+    auto data = args.find("data");
+    if (data == args.end() || data->second.empty()) {
+        return MakeError("there is no data to push");
+    }
+    auto chunk = FromHex(data->second);
+    if (chunk.size() > kMaxChunkSize) {
+        return MakeError("the chunk is too large");
+    }
+    auto obj_id = args.find("obj_id");
+    if (obj_id == args.end() || obj_id->second.size() != 2 * kOidSize) {
+        return MakeError("failed to read 'obj_id'");
+    }
+    auto oid = FromHex(obj_id->second);
+    uint32_t type = 0;
+    uint32_t data_size = 0;
+    uint32_t chunks_number = 0;
+    uint32_t index = 0;
+    if (!get_number("obj_type", type)) {
+        return MakeError("failed to read 'obj_type'");
+    }
+    if (!get_number("obj_size", data_size)) {
+        return MakeError("failed to read 'obj_size'");
+    }
+    if (!get_number("chunks", chunks_number)) {
+        return MakeError("failed to read 'chunks'");
+    }
+    if (!get_number("chunk", index) || index >= chunks_number) {
+        return MakeError("failed to read 'chunk'");
+    }
+
+    // PushObjectChunk, the last chunk completes the object if all the
+    // chunks are stored
+    txid = AddTransaction([this, repo_id, oid = std::move(oid),
+                           chunk = std::move(chunk), type, data_size,
+                           chunks_number, index] {
+        auto repo_it = store_.find(MakeRepoKey(kRepo, repo_id));
+        if (repo_it == store_.end()) {
+            throw std::runtime_error("repo not found");
+        }
+        auto member = store_.find(MakeMemberKey(FromHex(user_key_), repo_id));
+        if (member == store_.end() || member->second.empty() ||
+            (member->second[0] & kPushPermission) == 0) {
+            throw std::runtime_error("no permissions");
+        }
+        if (HasObject(repo_id, oid.data())) {
+            return;
+        }
+        auto chunk_key = MakeChunkKey(repo_id, oid.data(), index);
+        if (index + 1 != chunks_number) {
+            store_[chunk_key] = chunk;
+            return;
+        }
+        size_t total = chunk.size();
+        for (uint32_t i = 0; i < index; ++i) {
+            auto it = store_.find(MakeChunkKey(repo_id, oid.data(), i));
+            if (it == store_.end()) {
+                throw std::runtime_error("chunk is missing");
+            }
+            total += it->second.size();
+        }
+        if (total != data_size) {
+            throw std::runtime_error("invalid object size");
+        }
+        store_[chunk_key] = chunk;
+        ByteBuffer marker;
+        Put(marker, chunks_number);
+        store_[MakeChunkMarkerKey(repo_id, oid.data())] = std::move(marker);
+
+        auto repo = RepoRecord::Decode(repo_it->second);
+        ByteBuffer meta;
+        Put(meta, static_cast<int8_t>(type));
+        Put(meta, static_cast<uint64_t>(repo.cur_objs_number));
+        Put(meta, oid.data(), kOidSize);
+        Put(meta, data_size);
+        store_[MakeMetaKey(repo_id, repo.cur_objs_number++)] = std::move(meta);
+        store_[MakeRepoKey(kRepo, repo_id)] = repo.Encode();
+    });
+    return "{}";
+}
+
+bool MockWalletServer::HasObject(uint64_t repo_id,
+                                 const uint8_t* oid) const {
+    uint64_t first_id = 0;
+    uint32_t offset = 0, size = 0;
+    return store_.count(MakeDataKey(repo_id, oid)) != 0 ||
+           store_.count(MakeSharedMemberKey(repo_id, oid)) != 0 ||
+           store_.count(MakeChunkMarkerKey(repo_id, oid)) != 0 ||
+           FindPackedObject(repo_id, oid, first_id, offset, size);
+}
+
+bool MockWalletServer::FindPackedObject(uint64_t repo_id, const uint8_t* oid,
+                                        uint64_t& first_id, uint32_t& offset,
+                                        uint32_t& size) const {
+    auto bucket = store_.find(MakeBucketKey(repo_id, oid));
+    if (bucket == store_.end()) {
+        return false;
+    }
+    const auto& slots = bucket->second;
+    for (size_t i = 0; i < slots.size(); i += kSlotSize) {
+        const auto* slot = slots.data() + i;
+        if (std::memcmp(slot, oid + 1, kSlotHashSize) != 0) {
+            continue;
+        }
+        first_id = Get<uint64_t>(slot + kSlotHashSize);
+        auto entry = Get<uint32_t>(slot + kSlotHashSize + sizeof(uint64_t));
+        const auto& index =
+            store_.at(MakePackKey(kPackIndex, repo_id, first_id));
+        // Pack::Entry{type, hash, data_size}
+        constexpr size_t kEntrySize = 1 + kOidSize + sizeof(uint32_t);
+        const auto* p = index.data() + entry * kEntrySize;
+        if (std::memcmp(p + 1, oid, kOidSize) != 0) {
+            continue;
+        }
+        offset = 0;
+        for (const auto* e = index.data(); e != p; e += kEntrySize) {
+            offset += Get<uint32_t>(e + 1 + kOidSize);
+        }
+        size = Get<uint32_t>(p + 1 + kOidSize);
+        return true;
+    }
+    return false;
+}
+
+std::string MockWalletServer::AddTransaction(std::function<void()> apply) {
+    std::ostringstream ss;
+    ss << std::hex << std::setw(32) << std::setfill('0') << ++last_tx_;
+    auto txid = ss.str();
+    transactions_[txid].apply = std::move(apply);
+
+    auto timer = std::make_shared<net::steady_timer>(ioc_, options_.txLatency);
+    timer->async_wait(
+        [this, timer, txid](const boost::system::error_code& ec) {
+            if (!ec) {
+                CompleteTransaction(txid);
+            }
+        });
+    return txid;
+}
+
+void MockWalletServer::CompleteTransaction(const std::string& txid) {
+    auto& tx = transactions_[txid];
+    try {
+        tx.apply();
+        tx.status = 3;  // completed
+    } catch (const std::exception& ex) {
+        tx.status = 4;  // failed
+        tx.failure_reason = ex.what();
+    }
+    tx.apply = nullptr;
+    Notify(txid);
+}
+
+void MockWalletServer::Notify(const std::string& txid) {
+    const auto& tx = transactions_[txid];
+    json::object status{{"txId", txid}, {"status", tx.status}};
+    if (!tx.failure_reason.empty()) {
+        status["failure_reason"] = tx.failure_reason;
+    }
+    json::object event{
+        {"jsonrpc", "2.0"},
+        {"id", "ev_txs_changed"},
+        {"result", json::object{{"txs", json::array{std::move(status)}}}}};
+    auto message = json::serialize(event);
+    for (auto* session : subscribers_) {
+        session->Write(message);
+    }
+}
+
+std::string MockWalletServer::MakeSystemStateEvent() {
+    json::object event{
+        {"jsonrpc", "2.0"},
+        {"id", "ev_system_state"},
+        {"result", json::object{{"current_height", ++height_},
+                                {"is_in_sync", true}}}};
+    return json::serialize(event);
+}
+}  // namespace sourc3
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "utils.h"
+
+namespace sourc3 {
+// Local stand-in for the wallet API. It speaks newline delimited JSON-RPC
+// or JSON-RPC over HTTP (invoke_contract, ipfs_add, ipfs_get, ev_subunsub
+// and tx_status) and executes the sourc3 actions against an in-memory
+// key-value store which uses the key layout of the contract. Transactions
+// are applied and reported through ev_txs_changed after the configured
+// delay
+class MockWalletServer {
+public:
+    struct Options {
+        uint16_t port = 0;  // 0 picks a free port
+        std::chrono::milliseconds latency{0};      // added to every response
+        std::chrono::milliseconds ipfsLatency{0};  // added to IPFS responses
+        std::chrono::milliseconds txLatency{0};    // until a tx is completed
+        // replies of a connection are held until this many are ready, or
+        // no other comes within the latency, and sent in reverse order
+        size_t reorderReplies = 0;
+        // the replies are sent as HTTP responses to POST requests, one at a
+        // time and without events. The two options below are ignored then
+        bool http = false;
+        // every reply is preceded by an ev_system_state event
+        bool eventsBetweenReplies = false;
+        // every connection is closed after it receives this many requests,
+        // the last one is executed and its reply is lost
+        size_t dropAfter = 0;
+    };
+
+    explicit MockWalletServer(const Options& options);
+    ~MockWalletServer();
+
+    MockWalletServer(const MockWalletServer&) = delete;
+    MockWalletServer& operator=(const MockWalletServer&) = delete;
+
+    // Creates a repo of the owner (hex encoded public key) and returns its
+    // id. Must be called before the server is started
+    uint64_t CreateRepo(const std::string& owner, const std::string& name);
+
+    void Start();  // serves in a background thread
+    void Run();    // serves in the calling thread until Stop()
+    void Stop();
+
+    uint16_t GetPort() const;
+
+    // Public key of the wallet, used as the owner of created repos
+    const std::string& GetUserKey() const {
+        return user_key_;
+    }
+
+    // Number of processed requests by method
+    std::map<std::string, uint64_t> GetRequestCounts() const;
+    // Number of connections subscribed to ev_txs_changed
+    size_t GetSubscriberCount() const;
+
+private:
+    class Session;
+    using Store = std::map<ByteBuffer, ByteBuffer>;
+    using Args = std::map<std::string, std::string, std::less<>>;
+
+    void DoAccept();
+    std::string HandleRequest(Session& session, const std::string& request,
+                              std::chrono::milliseconds& delay);
+    std::string InvokeContract(const Args& args, std::string& txid);
+
+    std::string ViewContracts() const;
+    std::string GetRepoId(const Args& args) const;
+    // listings take the 'start_key' and 'limit' of the page
+    std::string GetRepoMeta(uint64_t repo_id, const Args& args) const;
+    std::string GetRepoData(uint64_t repo_id, const std::string& obj_id,
+                            uint32_t chunk) const;
+    std::string ListRefs(uint64_t repo_id, const Args& args) const;
+    std::string CreateRepoAction(const Args& args, std::string& txid);
+    std::string PushObjects(uint64_t repo_id, const Args& args,
+                            std::string& txid);
+    std::string PushRefs(uint64_t repo_id, const Args& args,
+                         std::string& txid);
+    std::string PushObjectChunk(uint64_t repo_id, const Args& args,
+                                std::string& txid);
+    // the object is stored by the repo, in chunks, in a pack or referenced
+    // in the shared store
+    bool HasObject(uint64_t repo_id, const uint8_t* oid) const;
+    // looks the object up through the bucket of its oid like the app
+    // shader, the offset and the size are of the pack data
+    bool FindPackedObject(uint64_t repo_id, const uint8_t* oid,
+                          uint64_t& first_id, uint32_t& offset,
+                          uint32_t& size) const;
+    // apply throws on failure, the message becomes the failure reason
+    std::string AddTransaction(std::function<void()> apply);
+    void CompleteTransaction(const std::string& txid);
+    void Notify(const std::string& txid);
+    std::string MakeSystemStateEvent();
+
+private:
+    Options options_;
+    std::string user_key_;
+    std::string cid_;
+
+    Store store_;
+    std::map<std::string, ByteBuffer> ipfs_;
+    uint64_t last_repo_id_ = 0;
+
+    struct Transaction {
+        std::function<void()> apply;
+        int status = 1;  // in progress
+        std::string failure_reason;
+    };
+    std::map<std::string, Transaction> transactions_;
+    uint64_t last_tx_ = 0;
+    uint64_t height_ = 0;
+
+    std::set<Session*> subscribers_;
+    std::map<std::string, uint64_t> request_counts_;
+    // guards the counts and the subscribers, which tests read
+    mutable std::mutex counts_mutex_;
+
+    // sessions are owned by the pending handlers, the context is declared
+    // last to destroy them while the state above is alive
+    boost::asio::io_context ioc_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    std::thread thread_;
+};
+}  // namespace sourc3
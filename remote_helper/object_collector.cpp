@@ -1,4 +1,5 @@
 #include "object_collector.h"
+#include "object_hasher.h"
 #include "utils.h"
 #include <stdexcept>
 #include <utility>
@@ -185,12 +186,30 @@ ObjectInfo& ObjectCollector::CollectObject(const git_oid& oid) {
     git_odb_object* dbobj = nullptr;
     git_odb_read(&dbobj, *m_odb, &oid);
 
-    auto obj_size = git_odb_object_size(dbobj);
-    auto& obj = m_objects.emplace_back(oid, git_odb_object_type(dbobj), dbobj);
-    git_oid r;
-    git_odb_hash(&r, git_odb_object_data(dbobj), obj_size,
-                 git_odb_object_type(dbobj));
+    return m_objects.emplace_back(oid, git_odb_object_type(dbobj), dbobj);
+}
+
+bool ObjectCollector::VerifyObjects() const {
+    std::vector<git_oid> hashes(m_objects.size());
+    std::vector<ObjectHashRequest> requests(m_objects.size());
+    for (size_t i = 0; i < m_objects.size(); ++i) {
+        const auto& obj = m_objects[i];
+        auto& request = requests[i];
+        request.type = git_object_type2string(obj.type);
+        request.data =
+            static_cast<const uint8_t*>(git_odb_object_data(obj.object));
+        request.size = git_odb_object_size(obj.object);
+        request.digest = hashes[i].id;
+    }
+    HashObjects(requests.data(), requests.size());
 
-    return obj;
+    for (size_t i = 0; i < m_objects.size(); ++i) {
+        if (hashes[i] != m_objects[i].oid) {
+            std::cerr << "Object " << ToString(m_objects[i].oid)
+                      << " is corrupted" << std::endl;
+            return false;
+        }
+    }
+    return true;
 }
 }  // namespace sourc3
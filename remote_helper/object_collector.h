@@ -78,13 +78,19 @@ struct Ref {
 
 class ObjectCollector : public git::RepoAccessor {
 public:
+    // Objects which don't fit a batch are left unselected by Serialize, they
+    // are pushed in chunks of this size
+    static constexpr size_t kSizeThreshold = 100000;
+
     using git::RepoAccessor::RepoAccessor;
     void Traverse(const std::vector<Refs>& refs,
                   const std::vector<git_oid>& hidden);
+    // Recalculates ids of all collected objects, returns false if the local
+    // database contains corrupted objects
+    bool VerifyObjects() const;
     template <typename Func>
     void Serialize(Func func) {
         // TODO: replace code below with calling serializer
-        constexpr size_t kSizeThreshold = 100000;
         size_t done = 0;
 
         while (true) {
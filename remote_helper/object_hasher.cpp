@@ -0,0 +1,517 @@
+#include "object_hasher.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define SOURC3_HASH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SOURC3_TARGET(x) __attribute__((target(x)))
+#else
+#define SOURC3_TARGET(x)
+#endif
+
+namespace sourc3 {
+namespace {
+constexpr size_t kBlockSize = 64;
+constexpr uint32_t kInitialState[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE,
+                                       0x10325476, 0xC3D2E1F0};
+
+inline uint32_t LoadBE32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+           (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline void StoreBE32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+inline uint32_t Rol(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+// Splits "<type> <size>\0<data>" followed by SHA-1 padding into 64-byte
+// blocks. Blocks which lie entirely inside the data are not copied
+class MessageCursor {
+public:
+    MessageCursor() = default;
+
+    explicit MessageCursor(const ObjectHashRequest& request)
+        : data_(request.data), size_(request.size) {
+        auto type_size = std::min(request.type.size(), size_t(8));
+        std::memcpy(header_, request.type.data(), type_size);
+        header_size_ = type_size;
+        header_[header_size_++] = ' ';
+        auto res = std::to_chars(header_ + header_size_,
+                                 header_ + sizeof(header_) - 1, size_);
+        header_size_ = static_cast<size_t>(res.ptr - header_);
+        header_[header_size_++] = '\0';
+        total_ = header_size_ + size_;
+        blocks_ = (total_ + 8) / kBlockSize + 1;
+    }
+
+    bool Empty() const {
+        return next_ == blocks_;
+    }
+
+    const uint8_t* Next(uint8_t* scratch) {
+        size_t begin = next_++ * kBlockSize;
+        size_t end = begin + kBlockSize;
+        if (begin >= header_size_ && end <= total_) {
+            return data_ + (begin - header_size_);
+        }
+
+        std::memset(scratch, 0, kBlockSize);
+        if (begin < header_size_) {
+            std::memcpy(scratch, header_ + begin,
+                        std::min(header_size_, end) - begin);
+        }
+        auto data_begin = std::max(begin, header_size_);
+        auto data_end = std::min(end, total_);
+        if (data_begin < data_end) {
+            std::memcpy(scratch + (data_begin - begin),
+                        data_ + (data_begin - header_size_),
+                        data_end - data_begin);
+        }
+        if (total_ >= begin && total_ < end) {
+            scratch[total_ - begin] = 0x80;
+        }
+        if (Empty()) {
+            uint64_t bits = uint64_t(total_) * 8;
+            StoreBE32(scratch + 56, static_cast<uint32_t>(bits >> 32));
+            StoreBE32(scratch + 60, static_cast<uint32_t>(bits));
+        }
+        return scratch;
+    }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    char header_[32] = {};
+    size_t header_size_ = 0;
+    size_t total_ = 0;
+    size_t blocks_ = 0;
+    size_t next_ = 0;
+};
+
+void StoreDigest(const uint32_t (&state)[5], uint8_t* digest) {
+    for (size_t i = 0; i < 5; ++i) {
+        StoreBE32(digest + i * 4, state[i]);
+    }
+}
+
+/////////////////////////////////////////////////////
+// Portable implementation
+
+void CompressScalar(uint32_t (&state)[5], const uint8_t* block) {
+    uint32_t w[16];
+    for (size_t t = 0; t < 16; ++t) {
+        w[t] = LoadBE32(block + t * 4);
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+             e = state[4];
+    for (size_t t = 0; t < 80; ++t) {
+        if (t >= 16) {
+            w[t & 15] = Rol(w[(t - 3) & 15] ^ w[(t - 8) & 15] ^
+                                w[(t - 14) & 15] ^ w[t & 15],
+                            1);
+        }
+        uint32_t f, k;
+        if (t < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (t < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (t < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t temp = Rol(a, 5) + f + e + k + w[t & 15];
+        e = d;
+        d = c;
+        c = Rol(b, 30);
+        b = a;
+        a = temp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void HashScalar(ObjectHashRequest& request) {
+    uint32_t state[5];
+    std::copy(std::begin(kInitialState), std::end(kInitialState), state);
+    uint8_t scratch[kBlockSize];
+    MessageCursor cursor(request);
+    while (!cursor.Empty()) {
+        CompressScalar(state, cursor.Next(scratch));
+    }
+    StoreDigest(state, request.digest);
+}
+
+#ifdef SOURC3_HASH_X86
+/////////////////////////////////////////////////////
+// CPU features
+
+struct CpuFeatures {
+    bool avx2 = false;
+    bool sha = false;
+
+    CpuFeatures() {
+        uint32_t regs1[4] = {};
+        uint32_t regs7[4] = {};
+        if (!Cpuid(1, regs1) || !Cpuid(7, regs7)) {
+            return;
+        }
+        bool ssse3 = (regs1[2] & (1u << 9)) != 0;
+        bool sse41 = (regs1[2] & (1u << 19)) != 0;
+        bool osxsave = (regs1[2] & (1u << 27)) != 0;
+        bool avx = (regs1[2] & (1u << 28)) != 0;
+        bool ymm_enabled = osxsave && avx && (GetXcr0() & 0x6) == 0x6;
+
+        avx2 = ymm_enabled && (regs7[1] & (1u << 5)) != 0;
+        sha = ssse3 && sse41 && (regs7[1] & (1u << 29)) != 0;
+    }
+
+private:
+    static bool Cpuid(uint32_t leaf, uint32_t (&regs)[4]) {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (static_cast<uint32_t>(info[0]) < leaf) {
+            return false;
+        }
+        __cpuidex(info, static_cast<int>(leaf), 0);
+        for (size_t i = 0; i < 4; ++i) {
+            regs[i] = static_cast<uint32_t>(info[i]);
+        }
+        return true;
+#else
+        return __get_cpuid_count(leaf, 0, &regs[0], &regs[1], &regs[2],
+                                 &regs[3]) != 0;
+#endif
+    }
+
+    static uint64_t GetXcr0() {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (uint64_t(edx) << 32) | eax;
+#endif
+    }
+};
+
+const CpuFeatures& GetCpuFeatures() {
+    static const CpuFeatures features;
+    return features;
+}
+
+/////////////////////////////////////////////////////
+// SHA extensions, one buffer at a time
+
+// Processes 4 rounds, message schedule is kept in 4 registers
+// holding words [4G, 4G + 16)
+template <int G>
+SOURC3_TARGET("sha,sse4.1")
+inline void ShaNiRounds(__m128i& abcd, __m128i (&e)[2], __m128i (&msg)[4]) {
+    if constexpr (G == 0) {
+        e[0] = _mm_add_epi32(e[0], msg[0]);
+    } else {
+        e[G % 2] = _mm_sha1nexte_epu32(e[G % 2], msg[G % 4]);
+    }
+    e[(G + 1) % 2] = abcd;
+    if constexpr (G >= 3 && G <= 18) {
+        msg[(G + 1) % 4] = _mm_sha1msg2_epu32(msg[(G + 1) % 4], msg[G % 4]);
+    }
+    abcd = _mm_sha1rnds4_epu32(abcd, e[G % 2], G / 5);
+    if constexpr (G >= 1 && G <= 16) {
+        msg[(G + 3) % 4] = _mm_sha1msg1_epu32(msg[(G + 3) % 4], msg[G % 4]);
+    }
+    if constexpr (G >= 2 && G <= 17) {
+        msg[(G + 2) % 4] = _mm_xor_si128(msg[(G + 2) % 4], msg[G % 4]);
+    }
+}
+
+template <int... G>
+SOURC3_TARGET("sha,sse4.1")
+inline void ShaNiAllRounds(__m128i& abcd, __m128i (&e)[2], __m128i (&msg)[4],
+                           std::integer_sequence<int, G...>) {
+    (ShaNiRounds<G>(abcd, e, msg), ...);
+}
+
+SOURC3_TARGET("sha,sse4.1")
+void HashShaNi(ObjectHashRequest& request) {
+    const __m128i mask =
+        _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd = _mm_shuffle_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(kInitialState)),
+        0x1B);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(kInitialState[4]), 0, 0, 0);
+
+    uint8_t scratch[kBlockSize];
+    MessageCursor cursor(request);
+    while (!cursor.Empty()) {
+        const auto* block = cursor.Next(scratch);
+        __m128i abcd_save = abcd;
+        __m128i e0_save = e0;
+        __m128i msg[4];
+        for (size_t i = 0; i < 4; ++i) {
+            msg[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(block + i * 16)),
+                mask);
+        }
+        __m128i e[2] = {e0, e0};
+        ShaNiAllRounds(abcd, e, msg, std::make_integer_sequence<int, 20>{});
+        // after the last 4 rounds e[0] holds the value of abcd before them
+        e0 = _mm_sha1nexte_epu32(e[0], e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    uint32_t state[5];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                     _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+    StoreDigest(state, request.digest);
+}
+
+/////////////////////////////////////////////////////
+// AVX2, 8 independent buffers at once
+
+constexpr size_t kLanes = 8;
+// below this number of busy lanes the scalar code is faster
+constexpr size_t kMinBusyLanes = 3;
+
+template <int N>
+SOURC3_TARGET("avx2")
+inline __m256i Rol256(__m256i v) {
+    return _mm256_or_si256(_mm256_slli_epi32(v, N),
+                           _mm256_srli_epi32(v, 32 - N));
+}
+
+SOURC3_TARGET("avx2")
+void CompressAvx2(uint32_t (&state)[5][kLanes],
+                  const uint8_t* const (&blocks)[kLanes]) {
+    __m256i w[16];
+    for (size_t t = 0; t < 16; ++t) {
+        alignas(32) uint32_t words[kLanes];
+        for (size_t l = 0; l < kLanes; ++l) {
+            words[l] = LoadBE32(blocks[l] + t * 4);
+        }
+        w[t] = _mm256_load_si256(reinterpret_cast<const __m256i*>(words));
+    }
+
+    __m256i v[5];
+    for (size_t i = 0; i < 5; ++i) {
+        v[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(state[i]));
+    }
+    __m256i a = v[0], b = v[1], c = v[2], d = v[3], e = v[4];
+    const __m256i k[4] = {
+        _mm256_set1_epi32(0x5A827999), _mm256_set1_epi32(0x6ED9EBA1),
+        _mm256_set1_epi32(static_cast<int>(0x8F1BBCDC)),
+        _mm256_set1_epi32(static_cast<int>(0xCA62C1D6))};
+
+    for (size_t t = 0; t < 80; ++t) {
+        if (t >= 16) {
+            w[t & 15] = Rol256<1>(_mm256_xor_si256(
+                _mm256_xor_si256(w[(t - 3) & 15], w[(t - 8) & 15]),
+                _mm256_xor_si256(w[(t - 14) & 15], w[t & 15])));
+        }
+        __m256i f;
+        if (t < 20) {
+            f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+        } else if (t < 40 || t >= 60) {
+            f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+        } else {
+            f = _mm256_or_si256(_mm256_and_si256(b, c),
+                                _mm256_and_si256(d, _mm256_or_si256(b, c)));
+        }
+        __m256i temp = _mm256_add_epi32(
+            _mm256_add_epi32(Rol256<5>(a), f),
+            _mm256_add_epi32(_mm256_add_epi32(e, k[t / 20]), w[t & 15]));
+        e = d;
+        d = c;
+        c = Rol256<30>(b);
+        b = a;
+        a = temp;
+    }
+
+    v[0] = _mm256_add_epi32(v[0], a);
+    v[1] = _mm256_add_epi32(v[1], b);
+    v[2] = _mm256_add_epi32(v[2], c);
+    v[3] = _mm256_add_epi32(v[3], d);
+    v[4] = _mm256_add_epi32(v[4], e);
+    for (size_t i = 0; i < 5; ++i) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(state[i]), v[i]);
+    }
+}
+
+void HashAvx2(ObjectHashRequest* requests, size_t count) {
+    // longest first, so lanes run out of work at approximately the same time
+    std::vector<ObjectHashRequest*> queue(count);
+    for (size_t i = 0; i < count; ++i) {
+        queue[i] = &requests[i];
+    }
+    std::sort(queue.begin(), queue.end(), [](const auto* l, const auto* r) {
+        return l->size > r->size;
+    });
+
+    struct Lane {
+        ObjectHashRequest* request = nullptr;
+        MessageCursor cursor;
+        uint8_t scratch[kBlockSize];
+    };
+    static const uint8_t kIdleBlock[kBlockSize] = {};
+    Lane lanes[kLanes];
+    alignas(32) uint32_t state[5][kLanes];
+    size_t next = 0;
+    size_t busy = 0;
+
+    auto assign = [&](size_t l) {
+        auto& lane = lanes[l];
+        if (next == queue.size()) {
+            lane.request = nullptr;
+            return false;
+        }
+        lane.request = queue[next++];
+        lane.cursor = MessageCursor(*lane.request);
+        for (size_t i = 0; i < 5; ++i) {
+            state[i][l] = kInitialState[i];
+        }
+        return true;
+    };
+    for (size_t l = 0; l < kLanes; ++l) {
+        if (assign(l)) {
+            ++busy;
+        }
+    }
+
+    while (busy >= kMinBusyLanes) {
+        const uint8_t* blocks[kLanes];
+        for (size_t l = 0; l < kLanes; ++l) {
+            auto& lane = lanes[l];
+            blocks[l] = lane.request ? lane.cursor.Next(lane.scratch)
+                                     : kIdleBlock;
+        }
+        CompressAvx2(state, blocks);
+        for (size_t l = 0; l < kLanes; ++l) {
+            auto& lane = lanes[l];
+            if (lane.request == nullptr || !lane.cursor.Empty()) {
+                continue;
+            }
+            uint32_t digest[5];
+            for (size_t i = 0; i < 5; ++i) {
+                digest[i] = state[i][l];
+            }
+            StoreDigest(digest, lane.request->digest);
+            if (!assign(l)) {
+                --busy;
+            }
+        }
+    }
+
+    // finish the tail one by one
+    for (size_t l = 0; l < kLanes; ++l) {
+        auto& lane = lanes[l];
+        if (lane.request == nullptr) {
+            continue;
+        }
+        uint32_t lane_state[5];
+        for (size_t i = 0; i < 5; ++i) {
+            lane_state[i] = state[i][l];
+        }
+        while (!lane.cursor.Empty()) {
+            CompressScalar(lane_state, lane.cursor.Next(lane.scratch));
+        }
+        StoreDigest(lane_state, lane.request->digest);
+    }
+}
+#endif  // SOURC3_HASH_X86
+
+HashEngine ResolveEngine(HashEngine engine) {
+    if (engine != HashEngine::Auto) {
+        return engine;
+    }
+    if (IsHashEngineSupported(HashEngine::ShaNi)) {
+        return HashEngine::ShaNi;
+    }
+    if (IsHashEngineSupported(HashEngine::Avx2)) {
+        return HashEngine::Avx2;
+    }
+    return HashEngine::Scalar;
+}
+}  // namespace
+
+void HashObjects(ObjectHashRequest* requests, size_t count,
+                 HashEngine engine) {
+    switch (ResolveEngine(engine)) {
+#ifdef SOURC3_HASH_X86
+        case HashEngine::ShaNi:
+            if (GetCpuFeatures().sha) {
+                std::for_each(requests, requests + count, HashShaNi);
+                return;
+            }
+            break;
+        case HashEngine::Avx2:
+            if (GetCpuFeatures().avx2) {
+                HashAvx2(requests, count);
+                return;
+            }
+            break;
+#endif
+        default:
+            break;
+    }
+    std::for_each(requests, requests + count, HashScalar);
+}
+
+bool IsHashEngineSupported(HashEngine engine) {
+    switch (engine) {
+        case HashEngine::Auto:
+        case HashEngine::Scalar:
+            return true;
+#ifdef SOURC3_HASH_X86
+        case HashEngine::Avx2:
+            return GetCpuFeatures().avx2;
+        case HashEngine::ShaNi:
+            return GetCpuFeatures().sha;
+#endif
+        default:
+            return false;
+    }
+}
+
+std::string_view GetHashEngineName(HashEngine engine) {
+    switch (ResolveEngine(engine)) {
+        case HashEngine::Avx2:
+            return "avx2";
+        case HashEngine::ShaNi:
+            return "sha-ni";
+        default:
+            return "scalar";
+    }
+}
+}  // namespace sourc3
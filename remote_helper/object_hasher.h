@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace sourc3 {
+constexpr size_t kSha1Size = 20;
+
+enum struct HashEngine {
+    Auto,    // the fastest engine supported by the CPU
+    Scalar,  // portable implementation
+    Avx2,    // 8 buffers at once using AVX2
+    ShaNi,   // SHA extensions, one buffer at a time
+};
+
+// Describes single git object which id should be calculated.
+// Id is the SHA-1 of "<type> <size>\0<data>"
+struct ObjectHashRequest {
+    std::string_view type;  // "commit", "tree", "blob" or "tag"
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    uint8_t* digest = nullptr;  // kSha1Size bytes
+};
+
+// Calculates ids for all requested objects
+void HashObjects(ObjectHashRequest* requests, size_t count,
+                 HashEngine engine = HashEngine::Auto);
+
+bool IsHashEngineSupported(HashEngine engine);
+std::string_view GetHashEngineName(HashEngine engine = HashEngine::Auto);
+}  // namespace sourc3
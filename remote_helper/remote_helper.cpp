@@ -1,35 +1,55 @@
-﻿
-#define _CRT_SECURE_NO_WARNINGS  // getenv
+﻿#include "remote_helper.h"
+
 #include <algorithm>
 #include <boost/algorithm/hex.hpp>
-#include <boost/filesystem.hpp>
-#include <boost/json.hpp>
-#include <boost/program_options.hpp>
-#include <cstdlib>
-#include <fstream>
 #include <iostream>
 #include <map>
-#include <optional>
+#include <memory>
 #include <sstream>
 #include <stack>
 #include <string>
-#include <string_view>
-#include <vector>
 
-#include "object_collector.h"
-#include "utils.h"
-#include "version.h"
-#include "wallet_client.h"
+#include "metrics.h"
+#include "object_hasher.h"
 
-namespace po = boost::program_options;
 namespace json = boost::json;
 using namespace std;
-using namespace sourc3;
-
-#define PROTO_NAME "sourc3"
 
+namespace sourc3 {
 namespace {
 constexpr size_t kIpfsAddressSize = 46;
+constexpr size_t kFetchBatchSize = 256;
+
+template <typename String>
+ByteBuffer FromHex(const String& s) {
+    ByteBuffer res;
+    res.reserve(s.size() / 2);
+    boost::algorithm::unhex(s.begin(), s.end(), std::back_inserter(res));
+    return res;
+}
+
+// Calls handler(item) for the items of the listing, the pages are requested
+// one by one while the wallet returns the cursor of the next page
+template <typename Handler>
+void ForEachListed(SimpleWalletClient& client, const std::string& args,
+                   std::string_view name, Handler&& handler) {
+    std::string start_key;
+    do {
+        auto res = client.InvokeWallet(
+            start_key.empty() ? args : args + ",start_key=" + start_key);
+        if (res.empty()) {
+            return;
+        }
+        auto root = json::parse(res);
+        auto& page = root.as_object();
+        for (auto& item : page[name].as_array()) {
+            handler(item.as_object());
+        }
+        const json::value* next = page.if_contains("next");
+        start_key = next != nullptr ? next->as_string().c_str() : "";
+    } while (!start_key.empty());
+}
+}  // namespace
 
 class ProgressReporter {
 public:
@@ -88,99 +108,74 @@ private:
     size_t total_;
 };
 
-template <typename String>
-ByteBuffer FromHex(const String& s) {
-    ByteBuffer res;
-    res.reserve(s.size() / 2);
-    boost::algorithm::unhex(s.begin(), s.end(), std::back_inserter(res));
-    return res;
+RemoteHelper::RemoteHelper(SimpleWalletClient& wc) : wallet_client_{wc} {
 }
 
-vector<string_view> ParseArgs(std::string_view args_sv) {
-    vector<string_view> args;
-    while (!args_sv.empty()) {
-        auto p = args_sv.find(' ');
-        auto ss = args_sv.substr(0, p);
-        args_sv.remove_prefix(p == string_view::npos ? ss.size()
-                                                     : ss.size() + 1);
-        if (!ss.empty()) {
-            args.emplace_back(ss);
-        }
+RemoteHelper::CommandResult RemoteHelper::DoCommand(
+    string_view command, vector<string_view>& args) {
+    auto it = find_if(begin(commands_), end(commands_), [&](const auto& c) {
+        return command == c.command;
+    });
+    if (it == end(commands_)) {
+        cerr << "Unknown command: " << command << endl;
+        return CommandResult::Failed;
     }
-    return args;
+    return std::invoke(it->action, this, args);
 }
 
-}  // namespace
+RemoteHelper::CommandResult RemoteHelper::DoList(
+    [[maybe_unused]] const vector<string_view>& args) {
+    auto refs = RequestRefs();
 
-class RemoteHelper {
-public:
-    enum struct CommandResult { Ok, Failed, Batch };
-    explicit RemoteHelper(SimpleWalletClient& wc) : wallet_client_{wc} {
+    for (const auto& r : refs) {
+        cout << ToString(r.target) << " " << r.name << '\n';
     }
-
-    CommandResult DoCommand(string_view command, vector<string_view>& args) {
-        auto it = find_if(begin(commands_), end(commands_), [&](const auto& c) {
-            return command == c.command;
-        });
-        if (it == end(commands_)) {
-            cerr << "Unknown command: " << command << endl;
-            return CommandResult::Failed;
-        }
-        return std::invoke(it->action, this, args);
+    if (!refs.empty()) {
+        cout << "@" << refs.back().name << " HEAD\n";
     }
 
-    CommandResult DoList([[maybe_unused]] const vector<string_view>& args) {
-        auto refs = RequestRefs();
-
-        for (const auto& r : refs) {
-            cout << ToString(r.target) << " " << r.name << '\n';
-        }
-        if (!refs.empty()) {
-            cout << "@" << refs.back().name << " HEAD\n";
-        }
-
-        return CommandResult::Ok;
-    }
+    return CommandResult::Ok;
+}
 
-    CommandResult DoOption([[maybe_unused]] const vector<string_view>& args) {
-        static string_view results[] = {"error invalid value", "ok",
-                                        "unsupported"};
+RemoteHelper::CommandResult RemoteHelper::DoOption(
+    [[maybe_unused]] const vector<string_view>& args) {
+    static string_view results[] = {"error invalid value", "ok",
+                                    "unsupported"};
 
-        auto res = options_.Set(args[1], args[2]);
+    auto res = options_.Set(args[1], args[2]);
 
-        cout << results[size_t(res)];
-        return CommandResult::Ok;
-    }
+    cout << results[size_t(res)];
+    return CommandResult::Ok;
+}
 
-    CommandResult DoFetch(const vector<string_view>& args) {
-        std::set<std::string> object_hashes;
-        object_hashes.emplace(args[1].data(), args[1].size());
-        size_t depth = 1;
-        std::set<std::string> received_objects;
+RemoteHelper::CommandResult RemoteHelper::DoFetch(
+    const vector<string_view>& args) {
+    Metrics::ScopedTimer fetch_timer(wallet_client_.GetMetrics(), "fetch");
+    std::set<std::string> object_hashes;
+    object_hashes.emplace(args[1].data(), args[1].size());
+    size_t depth = 1;
+    std::set<std::string> received_objects;
+
+    auto enuque_object = [&](const std::string& oid) {
+        if (received_objects.find(oid) == received_objects.end()) {
+            object_hashes.insert(oid);
+        }
+    };
 
-        auto enuque_object = [&](const std::string& oid) {
-            if (received_objects.find(oid) == received_objects.end()) {
-                object_hashes.insert(oid);
-            }
-        };
-
-        git::RepoAccessor accessor(wallet_client_.GetRepoDir());
-        size_t total_objects = 0;
-        std::vector<GitObject> objects;
-        {
-            auto progress = MakeProgress("Enumerating objects", 0);
-            // hack Collect objects metainfo
-            auto res =
-                wallet_client_.InvokeWallet("role=user,action=repo_get_meta");
-            auto root = json::parse(res);
-
-            for (auto& obj_val : root.as_object()["objects"].as_array()) {
+    git::RepoAccessor accessor(wallet_client_.GetRepoDir());
+    size_t total_objects = 0;
+    std::vector<GitObject> objects;
+    {
+        auto progress = MakeProgress("Enumerating objects", 0);
+        // hack Collect objects metainfo
+        ForEachListed(
+            wallet_client_, "role=user,action=repo_get_meta", "objects",
+            [&](json::object& obj) {
                 if (progress) {
                     progress->UpdateProgress(++total_objects);
                 }
 
                 auto& o = objects.emplace_back();
-                auto& obj = obj_val.as_object();
                 o.data_size = obj["object_size"].to_number<uint32_t>();
                 o.type = static_cast<int8_t>(
                     obj["object_type"].to_number<uint32_t>());
@@ -189,76 +184,88 @@ public:
                 if (git_odb_exists(*accessor.m_odb, &o.hash) != 0) {
                     received_objects.insert(s);
                 }
-            }
-        }
-
-        auto progress = MakeProgress("Receiving objects",
-                                     total_objects - received_objects.size());
-
-        size_t done = 0;
-        while (!object_hashes.empty()) {
-            auto it_to_receive = object_hashes.begin();
-            const auto& object_to_receive = *it_to_receive;
-            std::stringstream ss;
-            ss << "role=user,action=repo_get_data,obj_id=" << object_to_receive;
+            });
+    }
 
-            auto res = wallet_client_.InvokeWallet(ss.str());
-            auto root = json::parse(res);
+    auto progress = MakeProgress("Receiving objects",
+                                 total_objects - received_objects.size());
+
+    size_t done = 0;
+    while (!object_hashes.empty()) {
+        // requests of the batch are pipelined, objects are added to the
+        // batch in the order of responses
+        std::vector<ReceivedObject> batch;
+        size_t requested = 0;
+        bool failed = false;
+        while (!object_hashes.empty() && requested < kFetchBatchSize) {
+            auto object_to_receive =
+                std::move(object_hashes.extract(object_hashes.begin())
+                              .value());
+            received_objects.insert(object_to_receive);
             git_oid oid;
             git_oid_fromstr(&oid, object_to_receive.data());
 
-            auto it =
-                std::find_if(objects.begin(), objects.end(), [&](auto&& o) {
+            auto it = std::find_if(
+                objects.begin(), objects.end(), [&](auto&& o) {
                     return o.hash == oid;
                 });
             if (it == objects.end()) {
-                received_objects.insert(object_to_receive);  // move to received
-                object_hashes.erase(it_to_receive);
-
                 continue;
             }
-            received_objects.insert(object_to_receive);
 
-            auto data = root.as_object()["object_data"].as_string();
-
-            ByteBuffer buf;
-            if (it->IsIPFSObject()) {
-                auto hash = FromHex(data);
-                auto responce = wallet_client_.LoadObjectFromIPFS(
-                    std::string(hash.cbegin(), hash.cend()));
-                auto r = json::parse(responce);
-                if (r.as_object().find("result") == r.as_object().end()) {
-                    cerr << "message: "
-                         << r.as_object()["error"]
-                                .as_object()["message"]
-                                .as_string()
-                         << "\ndata:    "
-                         << r.as_object()["error"]
-                                .as_object()["data"]
-                                .as_string()
-                         << endl;
-                    return CommandResult::Failed;
-                }
-                auto d = r.as_object()["result"].as_object()["data"].as_array();
-                buf.reserve(d.size());
-                for (auto&& v : d) {
-                    buf.emplace_back(static_cast<uint8_t>(v.get_int64()));
-                }
-            } else {
-                buf = FromHex(data);
-            }
+            ++requested;
+            std::stringstream ss;
+            ss << "role=user,action=repo_get_data,obj_id="
+               << object_to_receive;
+            wallet_client_.PostInvokeWallet(
+                ss.str(), [&, oid, type = it->GetObjectType(),
+                           is_ipfs = it->IsIPFSObject()](auto&& res) {
+                    auto root = json::parse(res);
+                    auto data =
+                        root.as_object()["object_data"].as_string();
+                    if (!is_ipfs) {
+                        auto& received = batch.emplace_back();
+                        received.oid = oid;
+                        received.type = type;
+                        received.data = FromHex(data);
+                        const json::value* chunks =
+                            root.as_object().if_contains("chunks_number");
+                        if (chunks != nullptr) {
+                            ReceiveChunks(oid,
+                                          chunks->to_number<uint32_t>(),
+                                          batch);
+                        }
+                        return;
+                    }
+                    auto hash = FromHex(data);
+                    wallet_client_.PostLoadObjectFromIPFS(
+                        std::string(hash.cbegin(), hash.cend()),
+                        [&, oid, type](auto&& r) {
+                            if (!ReadIPFSObject(r, oid, type, batch)) {
+                                failed = true;
+                            }
+                        });
+                },
+                true);
+        }
+        wallet_client_.Wait();
 
+        if (failed || !VerifyReceivedObjects(batch)) {
+            return CommandResult::Failed;
+        }
+
+        for (const auto& received : batch) {
+            const auto& oid = received.oid;
+            const auto& buf = received.data;
+            auto type = received.type;
             git_oid res_oid;
-            auto type = it->GetObjectType();
-            git_oid r;
-            git_odb_hash(&r, buf.data(), buf.size(), type);
-            if (r != oid) {
-                // invalid hash
-                return CommandResult::Failed;
-            }
-            if (git_odb_write(&res_oid, *accessor.m_odb, buf.data(), buf.size(),
-                              type) < 0) {
-                return CommandResult::Failed;
+            {
+                Metrics::ScopedTimer timer(wallet_client_.GetMetrics(),
+                                           "odb_write");
+                if (git_odb_write(&res_oid, *accessor.m_odb, buf.data(),
+                                  buf.size(), type) < 0) {
+                    return CommandResult::Failed;
+                }
             }
             if (type == GIT_OBJECT_TREE) {
                 git::Tree tree;
@@ -288,374 +295,396 @@ public:
             if (progress) {
                 progress->UpdateProgress(++done);
             }
-
-            object_hashes.erase(it_to_receive);
         }
-        return CommandResult::Batch;
     }
+    return CommandResult::Batch;
+}
 
-    CommandResult DoPush(const vector<string_view>& args) {
-        ObjectCollector collector(wallet_client_.GetRepoDir());
-        std::vector<Refs> refs;
-        std::vector<git_oid> local_refs;
-        for (size_t i = 1; i < args.size(); ++i) {
-            auto& arg = args[i];
-            auto p = arg.find(':');
-            auto& r = refs.emplace_back();
-            r.localRef = arg.substr(0, p);
-            r.remoteRef = arg.substr(p + 1);
-            git::Reference local_ref;
-            if (git_reference_lookup(local_ref.Addr(), *collector.m_repo,
-                                     r.localRef.c_str()) < 0) {
-                cerr << "Local reference \'" << r.localRef << "\' doesn't exist"
-                     << endl;
-                return CommandResult::Failed;
-            }
-            auto& lr = local_refs.emplace_back();
-            git_oid_cpy(&lr, git_reference_target(*local_ref));
+RemoteHelper::CommandResult RemoteHelper::DoPush(
+    const vector<string_view>& args) {
+    Metrics::ScopedTimer push_timer(wallet_client_.GetMetrics(), "push");
+    ObjectCollector collector(wallet_client_.GetRepoDir());
+    std::vector<Refs> refs;
+    std::vector<git_oid> local_refs;
+    for (size_t i = 1; i < args.size(); ++i) {
+        auto& arg = args[i];
+        auto p = arg.find(':');
+        auto& r = refs.emplace_back();
+        r.localRef = arg.substr(0, p);
+        r.remoteRef = arg.substr(p + 1);
+        git::Reference local_ref;
+        if (git_reference_lookup(local_ref.Addr(), *collector.m_repo,
+                                 r.localRef.c_str()) < 0) {
+            cerr << "Local reference \'" << r.localRef << "\' doesn't exist"
+                 << endl;
+            return CommandResult::Failed;
         }
+        auto& lr = local_refs.emplace_back();
+        git_oid_cpy(&lr, git_reference_target(*local_ref));
+    }
 
-        auto uploaded_objects = GetUploadedObjects();
-        auto remote_refs = RequestRefs();
-        std::vector<git_oid> merge_bases;
-        for (const auto& remote_ref : remote_refs) {
-            for (const auto& local_ref : local_refs) {
-                auto& base = merge_bases.emplace_back();
-                git_merge_base(&base, *collector.m_repo, &remote_ref.target,
-                               &local_ref);
-            }
+    auto uploaded_objects = GetUploadedObjects();
+    auto remote_refs = RequestRefs();
+    std::vector<git_oid> merge_bases;
+    for (const auto& remote_ref : remote_refs) {
+        for (const auto& local_ref : local_refs) {
+            auto& base = merge_bases.emplace_back();
+            git_merge_base(&base, *collector.m_repo, &remote_ref.target,
+                           &local_ref);
         }
+    }
 
+    {
+        Metrics::ScopedTimer timer(wallet_client_.GetMetrics(),
+                                   "traverse");
         collector.Traverse(refs, merge_bases);
+    }
+    if (wallet_client_.GetOptions().verifyObjects) {
+        Metrics::ScopedTimer timer(wallet_client_.GetMetrics(), "hash");
+        if (!collector.VerifyObjects()) {
+            return CommandResult::Failed;
+        }
+    }
 
-        auto& objs = collector.m_objects;
-        std::sort(objs.begin(), objs.end(), [](auto&& left, auto&& right) {
-            return left.oid < right.oid;
-        });
-        {
-            auto it = std::unique(objs.begin(), objs.end(),
-                                  [](auto&& left, auto& right) {
-                                      return left.oid == right.oid;
-                                  });
-            objs.erase(it, objs.end());
+    auto& objs = collector.m_objects;
+    std::sort(objs.begin(), objs.end(), [](auto&& left, auto&& right) {
+        return left.oid < right.oid;
+    });
+    {
+        auto it = std::unique(objs.begin(), objs.end(),
+                              [](auto&& left, auto& right) {
+                                  return left.oid == right.oid;
+                              });
+        objs.erase(it, objs.end());
+    }
+
+    for (auto& obj : collector.m_objects) {
+        if (uploaded_objects.find(obj.oid) != uploaded_objects.end()) {
+            obj.selected = true;
         }
+    }
+
+    {
+        auto it =
+            std::remove_if(objs.begin(), objs.end(), [](const auto& o) {
+                return o.selected;
+            });
+        objs.erase(it, objs.end());
+    }
 
+    if (wallet_client_.GetOptions().useIPFS) {
+        auto progress = MakeProgress("Uploading objects to IPFS",
+                                     collector.m_objects.size());
+        size_t i = 0;
         for (auto& obj : collector.m_objects) {
-            if (uploaded_objects.find(obj.oid) != uploaded_objects.end()) {
-                obj.selected = true;
+            if (obj.selected) {
+                continue;
             }
-        }
 
-        {
-            auto it =
-                std::remove_if(objs.begin(), objs.end(), [](const auto& o) {
-                    return o.selected;
-                });
-            objs.erase(it, objs.end());
+            if (obj.GetSize() > kIpfsAddressSize) {
+                wallet_client_.PostSaveObjectToIPFS(
+                    obj.GetData(), obj.GetSize(),
+                    [&, o = &obj](auto&& r) {
+                        auto& hash_str = r.as_object()["result"]
+                                             .as_object()["hash"]
+                                             .as_string();
+                        o->ipfsHash =
+                            ByteBuffer(hash_str.cbegin(), hash_str.cend());
+                        if (progress) {
+                            progress->UpdateProgress(++i);
+                        }
+                    });
+            } else if (progress) {
+                progress->UpdateProgress(++i);
+            }
         }
+        wallet_client_.Wait();
+    }
 
-        {
-            auto progress = MakeProgress("Uploading objects to IPFS",
-                                         collector.m_objects.size());
-            size_t i = 0;
-            for (auto& obj : collector.m_objects) {
-                if (obj.selected) {
-                    continue;
-                }
+    std::sort(objs.begin(), objs.end(), [](auto&& left, auto&& right) {
+        return left.GetSize() > right.GetSize();
+    });
 
-                if (obj.GetSize() > kIpfsAddressSize) {
-                    auto res = wallet_client_.SaveObjectToIPFS(obj.GetData(),
-                                                               obj.GetSize());
-                    auto r = json::parse(res);
-                    auto hash_str =
-                        r.as_object()["result"].as_object()["hash"].as_string();
-                    obj.ipfsHash =
-                        ByteBuffer(hash_str.cbegin(), hash_str.cend());
-                }
-                if (progress) {
-                    progress->UpdateProgress(++i);
+    {
+        auto progress =
+            MakeProgress("Uploading metadata to blockchain", objs.size());
+        collector.Serialize([&](const auto& buf, size_t done) {
+            if (!buf.empty()) {
+                std::stringstream ss;
+                auto str_data = ToHex(buf.data(), buf.size());
+
+                // objects stored by an interrupted or concurrent push
+                // don't fail the transaction
+                ss << "role=user,action=push_objects,data=" << str_data
+                   << ",skip_existing=1";
+                const auto& storage =
+                    wallet_client_.GetOptions().objectStorage;
+                if (storage != "repo") {
+                    // the shared store keeps one copy of the data which
+                    // other repos have, a pack takes two vars per batch
+                    ss << ',' << storage << "=1";
                 }
+                wallet_client_.InvokeWallet(ss.str());
             }
-        }
 
-        std::sort(objs.begin(), objs.end(), [](auto&& left, auto&& right) {
-            return left.GetSize() > right.GetSize();
+            if (progress) {
+                progress->UpdateProgress(done);
+            }
         });
+    }
 
-        {
-            auto progress =
-                MakeProgress("Uploading metadata to blockchain", objs.size());
-            collector.Serialize([&](const auto& buf, size_t done) {
-                std::stringstream ss;
-                if (!buf.empty()) {
-                    // log
-                    //{
-                    //    const auto* p =
-                    //        reinterpret_cast<const ObjectsInfo*>(buf.data());
-                    //    const auto* cur =
-                    //        reinterpret_cast<const GitObject*>(p + 1);
-                    //    for (uint32_t i = 0; i < p->objects_number; ++i) {
-                    //        size_t s = cur->data_size;
-                    //        std::cerr << to_string(cur->hash) << '\t' << s
-                    //                  << '\t' << (int)cur->type << '\n';
-                    //        ++cur;
-                    //        cur = reinterpret_cast<const GitObject*>(
-                    //            reinterpret_cast<const uint8_t*>(cur) + s);
-                    //    }
-                    //    std::cerr << std::endl;
-                    //}
-                    auto str_data = ToHex(buf.data(), buf.size());
-
-                    ss << "role=user,action=push_objects,data=" << str_data;
-                }
+    // objects which don't fit a batch are stored in chunks, the last chunk
+    // completes an object and is pushed when the others are stored
+    std::vector<const ObjectInfo*> large_objects;
+    for (const auto& obj : objs) {
+        if (!obj.selected) {
+            large_objects.push_back(&obj);
+        }
+    }
+    auto chunks_number = [](const ObjectInfo& obj) {
+        return (obj.GetSize() + ObjectCollector::kSizeThreshold - 1) /
+               ObjectCollector::kSizeThreshold;
+    };
+    if (!large_objects.empty()) {
+        auto progress =
+            MakeProgress("Uploading large objects", large_objects.size());
+        size_t done = 0;
+        for (const auto* obj : large_objects) {
+            auto chunks = chunks_number(*obj);
+            for (size_t i = 0; i + 1 < chunks; ++i) {
+                PushObjectChunk(*obj, i, chunks);
+            }
+            if (progress) {
+                progress->UpdateProgress(++done);
+            }
+        }
+    }
 
-                if (progress) {
-                    progress->UpdateProgress(done);
-                }
+    auto wait = [&](bool stop_on_failure) {
+        auto progress =
+            MakeProgress("Waiting for the transaction completion",
+                         wallet_client_.GetTransactionCount());
 
-                bool last = (done == objs.size());
-                if (last) {
-                    ss << ',';
-                    for (const auto& r : collector.m_refs) {
-                        ss << "ref=" << r.name << ",ref_target="
-                           << ToHex(&r.target, sizeof(r.target));
+        return wallet_client_.WaitForCompletion(
+            [&](size_t d, const auto& error) {
+                if (progress) {
+                    if (error.empty()) {
+                        progress->UpdateProgress(d);
+                    } else {
+                        progress->Failed(error);
                     }
                 }
-                wallet_client_.InvokeWallet(ss.str());
-            });
-        }
-        {
-            auto progress =
-                MakeProgress("Waiting for the transaction completion",
-                             wallet_client_.GetTransactionCount());
-
-            auto res = wallet_client_.WaitForCompletion(
-                [&](size_t d, const auto& error) {
-                    if (progress) {
-                        if (error.empty()) {
-                            progress->UpdateProgress(d);
-                        } else {
-                            progress->Failed(error);
-                        }
-                    }
-                });
-            cout << (res ? "ok " : "error ") << refs[0].remoteRef << '\n';
+            },
+            stop_on_failure);
+    };
+    auto objects_failed = [&] {
+        for (const auto& r : collector.m_refs) {
+            cout << "error " << r.name << " failed to push objects\n";
         }
-
         return CommandResult::Batch;
+    };
+    if (!wait(true)) {
+        return objects_failed();
     }
-
-    CommandResult DoCapabilities(
-        [[maybe_unused]] const vector<string_view>& args) {
-        for (auto ib = begin(commands_) + 1, ie = end(commands_); ib != ie;
-             ++ib) {
-            cout << ib->command << '\n';
+    if (!large_objects.empty()) {
+        for (const auto* obj : large_objects) {
+            auto chunks = chunks_number(*obj);
+            PushObjectChunk(*obj, chunks - 1, chunks);
         }
-
-        return CommandResult::Ok;
-    }
-
-private:
-    std::optional<ProgressReporter> MakeProgress(std::string_view title,
-                                                 size_t total) {
-        if (options_.progress) {
-            return std::optional<ProgressReporter>(std::in_place, title, total);
+        if (!wait(true)) {
+            return objects_failed();
         }
-
-        return {};
     }
 
-    std::vector<Ref> RequestRefs() {
+    // every ref gets its own transaction, it fails if the ref has been
+    // moved since the refs were requested, pushes to other refs don't
+    // interfere
+    std::vector<std::string> ref_transactions;
+    for (const auto& r : collector.m_refs) {
         std::stringstream ss;
-        ss << "role=user,action=list_refs";
-
-        std::vector<Ref> refs;
-        auto res = wallet_client_.InvokeWallet(ss.str());
-        if (!res.empty()) {
-            auto root = json::parse(res);
-            for (auto& rv : root.as_object()["refs"].as_array()) {
-                auto& ref = refs.emplace_back();
-                auto& r = rv.as_object();
-                ref.name = r["name"].as_string().c_str();
-                git_oid_fromstr(&ref.target,
-                                r["commit_hash"].as_string().c_str());
+        ss << "role=user,action=push_refs,ref=" << r.name
+           << ",ref_target=" << ToHex(&r.target, sizeof(r.target));
+        auto remote = std::find_if(remote_refs.begin(), remote_refs.end(),
+                                   [&r](const auto& remote_ref) {
+                                       return remote_ref.name == r.name;
+                                   });
+        if (remote != remote_refs.end()) {
+            ss << ",ref_old_target="
+               << ToHex(&remote->target, sizeof(remote->target));
+        }
+        wallet_client_.InvokeWallet(ss.str());
+        ref_transactions.push_back(wallet_client_.GetLastTransaction());
+    }
+    wait(false);
+
+    const auto& failed = wallet_client_.GetFailedTransactions();
+    std::optional<std::vector<Ref>> current_refs;
+    for (size_t i = 0; i < collector.m_refs.size(); ++i) {
+        const auto& r = collector.m_refs[i];
+        const auto& txid = ref_transactions[i];
+        auto it = failed.find(txid);
+        if (txid.empty()) {
+            cout << "error " << r.name << " failed to update\n";
+        } else if (it == failed.end()) {
+            cout << "ok " << r.name << '\n';
+        } else {
+            if (!current_refs) {
+                current_refs = RequestRefs();
             }
+            auto is_same = [&r](const auto& ref) {
+                return ref.name == r.name;
+            };
+            auto current = std::find_if(current_refs->begin(),
+                                        current_refs->end(), is_same);
+            auto expected =
+                std::find_if(remote_refs.begin(), remote_refs.end(), is_same);
+            bool moved = (current == current_refs->end()) !=
+                             (expected == remote_refs.end()) ||
+                         (current != current_refs->end() &&
+                          current->target != expected->target);
+            cout << "error " << r.name << ' '
+                 << (moved ? "fetch first" : it->second) << '\n';
         }
-        return refs;
     }
 
-    std::set<git_oid> GetUploadedObjects() {
-        std::set<git_oid> uploaded_objects;
+    return CommandResult::Batch;
+}
 
-        auto progress = MakeProgress("Enumerating uploaded objects", 0);
-        // hack Collect objects metainfo
-        auto res =
-            wallet_client_.InvokeWallet("role=user,action=repo_get_meta");
-        auto root = json::parse(res);
-        for (auto& obj : root.as_object()["objects"].as_array()) {
-            auto s = obj.as_object()["object_hash"].as_string();
-            git_oid oid;
-            git_oid_fromstr(&oid, s.c_str());
-            uploaded_objects.insert(oid);
-            if (progress) {
-                progress->UpdateProgress(uploaded_objects.size());
-            }
-        }
-        return uploaded_objects;
+RemoteHelper::CommandResult RemoteHelper::DoCapabilities(
+    [[maybe_unused]] const vector<string_view>& args) {
+    for (auto ib = begin(commands_) + 1, ie = end(commands_); ib != ie;
+         ++ib) {
+        cout << ib->command << '\n';
     }
 
-private:
-    SimpleWalletClient& wallet_client_;
+    return CommandResult::Ok;
+}
 
-    typedef CommandResult (RemoteHelper::*Action)(
-        const vector<string_view>& args);
+bool RemoteHelper::ReadIPFSObject(json::value& r, const git_oid& oid,
+                                  git_object_t type,
+                                  std::vector<ReceivedObject>& batch) {
+    if (r.as_object().find("result") == r.as_object().end()) {
+        cerr << "message: "
+             << r.as_object()["error"].as_object()["message"].as_string()
+             << "\ndata:    "
+             << r.as_object()["error"].as_object()["data"].as_string()
+             << endl;
+        return false;
+    }
+    auto& received = batch.emplace_back();
+    received.oid = oid;
+    received.type = type;
+    auto& buf = received.data;
+    auto& d = r.as_object()["result"].as_object()["data"].as_array();
+    buf.reserve(d.size());
+    for (auto&& v : d) {
+        buf.emplace_back(static_cast<uint8_t>(v.get_int64()));
+    }
+    return true;
+}
 
-    struct Command {
-        string_view command;
-        Action action;
-    };
+void RemoteHelper::PushObjectChunk(const ObjectInfo& obj, size_t index,
+                                   size_t chunks_number) {
+    auto offset = index * ObjectCollector::kSizeThreshold;
+    auto size =
+        std::min(obj.GetSize() - offset, ObjectCollector::kSizeThreshold);
+    std::stringstream ss;
+    ss << "role=user,action=push_object_chunk,obj_id=" << ToString(obj.oid)
+       << ",obj_type=" << static_cast<uint32_t>(obj.type)
+       << ",obj_size=" << obj.GetSize() << ",chunks=" << chunks_number
+       << ",chunk=" << index
+       << ",data=" << ToHex(obj.GetData() + offset, size);
+    wallet_client_.InvokeWallet(ss.str());
+}
 
-    Command commands_[5] = {{"capabilities", &RemoteHelper::DoCapabilities},
-                            {"list", &RemoteHelper::DoList},
-                            {"option", &RemoteHelper::DoOption},
-                            {"fetch", &RemoteHelper::DoFetch},
-                            {"push", &RemoteHelper::DoPush}};
-
-    struct Options {
-        enum struct SetResult { InvalidValue, Ok, Unsupported };
-
-        static constexpr uint32_t kInfiniteDepth =
-            (uint32_t)std::numeric_limits<int32_t>::max();
-        bool progress = true;
-        int64_t verbosity = 0;
-        uint32_t depth = kInfiniteDepth;
-
-        SetResult Set(string_view option, string_view value) {
-            if (option == "progress") {
-                if (value == "true") {
-                    progress = true;
-                } else if (value == "false") {
-                    progress = false;
-                } else {
-                    return SetResult::InvalidValue;
+void RemoteHelper::ReceiveChunks(const git_oid& oid, uint32_t chunks_number,
+                                 std::vector<ReceivedObject>& batch) {
+    // the first chunk is received already, the rest are appended in order
+    // when all of them arrive
+    auto index = batch.size() - 1;
+    auto chunks = std::make_shared<std::vector<ByteBuffer>>(chunks_number);
+    auto remaining = std::make_shared<uint32_t>(chunks_number - 1);
+    for (uint32_t i = 1; i < chunks_number; ++i) {
+        std::stringstream ss;
+        ss << "role=user,action=repo_get_data,obj_id=" << ToString(oid)
+           << ",chunk=" << i;
+        wallet_client_.PostInvokeWallet(
+            ss.str(),
+            [&batch, index, chunks, remaining, i](auto&& res) {
+                auto root = json::parse(res);
+                (*chunks)[i] =
+                    FromHex(root.as_object()["object_data"].as_string());
+                if (--*remaining != 0) {
+                    return;
                 }
-                return SetResult::Ok;
-            } /* else if (option == "verbosity") {
-                 char* endPos;
-                 auto v = std::strtol(value.data(), &endPos, 10);
-                 if (endPos == value.data()) {
-                     return SetResult::InvalidValue;
-                 }
-                 verbosity = v;
-                 return SetResult::Ok;
-             } else if (option == "depth") {
-                 char* endPos;
-                 auto v = std::strtoul(value.data(), &endPos, 10);
-                 if (endPos == value.data()) {
-                     return SetResult::InvalidValue;
-                 }
-                 depth = v;
-                 return SetResult::Ok;
-             }*/
-
-            return SetResult::Unsupported;
-        }
-    };
-
-    Options options_;
-};
+                auto& data = batch[index].data;
+                for (const auto& chunk : *chunks) {
+                    data.insert(data.end(), chunk.begin(), chunk.end());
+                }
+            },
+            true);
+    }
+}
 
-int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        cerr << "USAGE: git-remote-sourc3 <remote> <url>" << endl;
-        return -1;
-    }
-    try {
-        SimpleWalletClient::Options options;
-        po::options_description desc("SOURC3 config options");
-
-        desc.add_options()("api-host",
-                           po::value<std::string>(&options.apiHost)
-                               ->default_value("localhost"),
-                           "Wallet API host")(
-            "api-port",
-            po::value<std::string>(&options.apiPort)->default_value("10000"),
-            "Wallet API port")("api-target",
-                               po::value<std::string>(&options.apiTarget)
-                                   ->default_value("/api/wallet"),
-                               "Wallet API target")(
-            "app-shader-file",
-            po::value<string>(&options.appPath)->default_value("app.wasm"),
-            "Path to the app shader file")(
-            "use-ipfs", po::value<bool>(&options.useIPFS)->default_value(true),
-            "Use IPFS to store large blobs");
-        po::variables_map vm;
-#ifdef WIN32
-        const auto* home_dir = std::getenv("USERPROFILE");
-#else
-        const auto* home_dir = std::getenv("HOME");
-#endif
-        std::string config_path = PROTO_NAME "-remote.cfg";
-        if (home_dir != nullptr) {
-            config_path =
-                std::string(home_dir) + "/." PROTO_NAME "/" + config_path;
-        }
-        cerr << "Reading config from: " << config_path << "..." << endl;
-        const auto full_path =
-            boost::filesystem::system_complete(config_path).string();
-        std::ifstream cfg(full_path);
-        if (cfg) {
-            po::store(po::parse_config_file(cfg, desc), vm);
-        }
-        vm.notify();
-        string_view sv(argv[2]);
-        const string_view schema = PROTO_NAME "://";
-        sv = sv.substr(schema.size());
-        auto delimiter_owner_name_pos = sv.find('/');
-        options.repoOwner = sv.substr(0, delimiter_owner_name_pos);
-        options.repoName = sv.substr(delimiter_owner_name_pos + 1);
-        auto* git_dir = std::getenv("GIT_DIR");  // set during clone
-        if (git_dir != nullptr) {
-            options.repoPath = git_dir;
+bool RemoteHelper::VerifyReceivedObjects(
+    const std::vector<ReceivedObject>& batch) {
+    Metrics::ScopedTimer timer(wallet_client_.GetMetrics(), "hash");
+    std::vector<git_oid> hashes(batch.size());
+    std::vector<ObjectHashRequest> requests(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        auto& request = requests[i];
+        request.type = git_object_type2string(batch[i].type);
+        request.data = batch[i].data.data();
+        request.size = batch[i].data.size();
+        request.digest = hashes[i].id;
+    }
+    HashObjects(requests.data(), requests.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (hashes[i] != batch[i].oid) {
+            cerr << "Invalid hash of the received object "
+                 << ToString(batch[i].oid) << endl;
+            return false;
         }
-        cerr << "     Remote: " << argv[1] << "\n        URL: " << argv[2]
-             << "\nWorking dir: " << boost::filesystem::current_path()
-             << "\nRepo folder: " << options.repoPath << endl;
-        SimpleWalletClient wallet_client{options};
-        RemoteHelper helper{wallet_client};
-        git::Init init;
-        string input;
-        auto res = RemoteHelper::CommandResult::Ok;
-        while (getline(cin, input, '\n')) {
-            if (input.empty()) {
-                if (res == RemoteHelper::CommandResult::Batch) {
-                    cout << endl;
-                    continue;
-                } else {
-                    cerr << "Unexpected blank line" << endl;
-                    return -1;
-                }
-            }
+    }
+    return true;
+}
 
-            string_view args_sv(input.data(), input.size());
-            vector<string_view> args = ParseArgs(args_sv);
-            if (args.empty()) {
-                return -1;
-            }
+std::optional<ProgressReporter> RemoteHelper::MakeProgress(
+    std::string_view title, size_t total) {
+    if (options_.progress) {
+        return std::optional<ProgressReporter>(std::in_place, title, total);
+    }
 
-            cerr << "Command: " << input << endl;
-            res = helper.DoCommand(args[0], args);
+    return {};
+}
 
-            if (res == RemoteHelper::CommandResult::Failed) {
-                return -1;
-            } else if (res == RemoteHelper::CommandResult::Ok) {
-                cout << endl;
-            }
-        }
-    } catch (const exception& ex) {
-        cerr << "Error: " << ex.what() << endl;
-        return -1;
-    }
+std::vector<Ref> RemoteHelper::RequestRefs() {
+    std::vector<Ref> refs;
+    ForEachListed(wallet_client_, "role=user,action=list_refs", "refs",
+                  [&](json::object& r) {
+                      auto& ref = refs.emplace_back();
+                      ref.name = r["name"].as_string().c_str();
+                      git_oid_fromstr(&ref.target,
+                                      r["commit_hash"].as_string().c_str());
+                  });
+    return refs;
+}
 
-    return 0;
+std::set<git_oid> RemoteHelper::GetUploadedObjects() {
+    std::set<git_oid> uploaded_objects;
+
+    auto progress = MakeProgress("Enumerating uploaded objects", 0);
+    // hack Collect objects metainfo
+    ForEachListed(wallet_client_, "role=user,action=repo_get_meta",
+                  "objects", [&](json::object& obj) {
+                      git_oid oid;
+                      git_oid_fromstr(&oid,
+                                      obj["object_hash"].as_string().c_str());
+                      uploaded_objects.insert(oid);
+                      if (progress) {
+                          progress->UpdateProgress(uploaded_objects.size());
+                      }
+                  });
+    return uploaded_objects;
 }
+}  // namespace sourc3
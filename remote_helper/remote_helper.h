@@ -0,0 +1,119 @@
+#pragma once
+
+#include <git2.h>
+#include <boost/json.hpp>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <vector>
+
+#include "git_utils.h"
+#include "object_collector.h"
+#include "utils.h"
+#include "wallet_client.h"
+
+namespace sourc3 {
+class ProgressReporter;
+
+// Handles commands of the git remote helper protocol, the replies are
+// written to std::cout
+class RemoteHelper {
+public:
+    enum struct CommandResult { Ok, Failed, Batch };
+    explicit RemoteHelper(SimpleWalletClient& wc);
+
+    CommandResult DoCommand(std::string_view command,
+                            std::vector<std::string_view>& args);
+    CommandResult DoList(const std::vector<std::string_view>& args);
+    CommandResult DoOption(const std::vector<std::string_view>& args);
+    CommandResult DoFetch(const std::vector<std::string_view>& args);
+    CommandResult DoPush(const std::vector<std::string_view>& args);
+    CommandResult DoCapabilities(const std::vector<std::string_view>& args);
+
+private:
+    struct ReceivedObject {
+        git_oid oid;
+        git_object_t type;
+        ByteBuffer data;
+    };
+
+    bool ReadIPFSObject(boost::json::value& r, const git_oid& oid,
+                        git_object_t type, std::vector<ReceivedObject>& batch);
+    // Pushes a chunk of an object which doesn't fit a transaction
+    void PushObjectChunk(const ObjectInfo& obj, size_t index,
+                         size_t chunks_number);
+    // Requests the rest chunks of a chunked object, the last element of the
+    // batch holds the first chunk
+    void ReceiveChunks(const git_oid& oid, uint32_t chunks_number,
+                       std::vector<ReceivedObject>& batch);
+    // Checks the whole batch at once, it is much cheaper than hashing
+    // objects one by one
+    bool VerifyReceivedObjects(const std::vector<ReceivedObject>& batch);
+    std::optional<ProgressReporter> MakeProgress(std::string_view title,
+                                                 size_t total);
+    std::vector<Ref> RequestRefs();
+    std::set<git_oid> GetUploadedObjects();
+
+private:
+    SimpleWalletClient& wallet_client_;
+
+    typedef CommandResult (RemoteHelper::*Action)(
+        const std::vector<std::string_view>& args);
+
+    struct Command {
+        std::string_view command;
+        Action action;
+    };
+
+    Command commands_[5] = {{"capabilities", &RemoteHelper::DoCapabilities},
+                            {"list", &RemoteHelper::DoList},
+                            {"option", &RemoteHelper::DoOption},
+                            {"fetch", &RemoteHelper::DoFetch},
+                            {"push", &RemoteHelper::DoPush}};
+
+    struct Options {
+        enum struct SetResult { InvalidValue, Ok, Unsupported };
+
+        static constexpr uint32_t kInfiniteDepth =
+            (uint32_t)std::numeric_limits<int32_t>::max();
+        bool progress = true;
+        int64_t verbosity = 0;
+        uint32_t depth = kInfiniteDepth;
+
+        SetResult Set(std::string_view option, std::string_view value) {
+            if (option == "progress") {
+                if (value == "true") {
+                    progress = true;
+                } else if (value == "false") {
+                    progress = false;
+                } else {
+                    return SetResult::InvalidValue;
+                }
+                return SetResult::Ok;
+            } /* else if (option == "verbosity") {
+                 char* endPos;
+                 auto v = std::strtol(value.data(), &endPos, 10);
+                 if (endPos == value.data()) {
+                     return SetResult::InvalidValue;
+                 }
+                 verbosity = v;
+                 return SetResult::Ok;
+             } else if (option == "depth") {
+                 char* endPos;
+                 auto v = std::strtoul(value.data(), &endPos, 10);
+                 if (endPos == value.data()) {
+                     return SetResult::InvalidValue;
+                 }
+                 depth = v;
+                 return SetResult::Ok;
+             }*/
+
+            return SetResult::Unsupported;
+        }
+    };
+
+    Options options_;
+};
+}  // namespace sourc3
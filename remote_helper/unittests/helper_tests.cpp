@@ -2,8 +2,20 @@
 #include <boost/test/included/unit_test.hpp>
 
 #include <git2.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <thread>
 #include "git_utils.h"
+#include "metrics.h"
+#include "mock_wallet_server.h"
 #include "object_collector.h"
+#include "object_hasher.h"
+#include "wallet_client.h"
 
 using namespace sourc3;
 
@@ -49,6 +61,118 @@ void GenerateTestRepo(std::string_view root) {
     f("*.h", "Second");
     f("*.*", "The third");
 }
+
+// Mock wallet with the repos used by the tests and a freshly generated git
+// repository, each test case gets its own
+struct MockWalletFixture {
+    MockWalletFixture()
+        : root("./temp/" +
+               boost::unit_test::framework::current_test_case().p_name.get()),
+          server(MakeServerOptions()) {
+        for (const char* name :
+             {"test", "fork", "fork2", "poisoner", "packed", "chunked"}) {
+            server.CreateRepo(server.GetUserKey(), name);
+        }
+        server.Start();
+        options.apiHost = "127.0.0.1";
+        options.apiPort = std::to_string(server.GetPort());
+        options.repoOwner = server.GetUserKey();
+        options.repoName = "test";
+        options.repoPath = root;
+
+        std::filesystem::remove_all(root);
+        GenerateTestRepo(root);
+        collector.emplace(root);
+        collector->Traverse({{"refs/heads/master", "refs/heads/master"}}, {});
+        BOOST_TEST_REQUIRE(git_reference_name_to_id(&head, *collector->m_repo,
+                                                    "refs/heads/master") >= 0);
+    }
+
+    static MockWalletServer::Options MakeServerOptions() {
+        using namespace std::chrono_literals;
+        MockWalletServer::Options server_options;
+        server_options.latency = 1ms;
+        server_options.txLatency = 10ms;
+        return server_options;
+    }
+
+    std::unique_ptr<SimpleWalletClient> MakeClient(
+        const std::string& repo_name) {
+        options.repoName = repo_name;
+        return std::make_unique<SimpleWalletClient>(options);
+    }
+
+    // Pushes all objects and the master ref in the repo format
+    bool Push(SimpleWalletClient& client, bool skip_existing) {
+        for (auto& obj : collector->m_objects) {
+            obj.selected = false;
+        }
+        collector->Serialize([&](const auto& buf, size_t done) {
+            std::string args = "role=user,action=push_objects,data=";
+            args.append(ToHex(buf.data(), buf.size()));
+            if (skip_existing) {
+                args.append(",skip_existing=1");
+            }
+            if (done == collector->m_objects.size()) {
+                args.append(",ref=refs/heads/master,ref_target=")
+                    .append(ToHex(head.id, sizeof(head.id)));
+            }
+            client.InvokeWallet(args);
+        });
+        return client.WaitForCompletion([](size_t, const std::string&) {});
+    }
+
+    // Pushes all objects to the repo with the storage option, returns the
+    // number of the objects found in the shared store
+    size_t PushTo(const std::string& repo_name, std::string_view storage) {
+        for (auto& obj : collector->m_objects) {
+            obj.selected = false;
+        }
+        auto client = MakeClient(repo_name);
+        size_t shared_count = 0;
+        collector->Serialize([&](const auto& buf, size_t) {
+            std::string args = "role=user,action=push_objects,data=";
+            args.append(ToHex(buf.data(), buf.size()))
+                .append(",")
+                .append(storage)
+                .append("=1");
+            auto res = boost::json::parse(client->InvokeWallet(args));
+            auto& objects = res.as_object()["objects"].as_object();
+            if (auto* count = objects.if_contains("shared_count")) {
+                shared_count += count->to_number<size_t>();
+            }
+        });
+        BOOST_TEST_CHECK(
+            client->WaitForCompletion([](size_t, const std::string&) {}));
+        return shared_count;
+    }
+
+    // Checks that the repo lists all objects and returns their data
+    void CheckObjects(const std::string& repo_name) {
+        namespace json = boost::json;
+        auto client = MakeClient(repo_name);
+        auto meta =
+            json::parse(client->InvokeWallet("role=user,action=repo_get_meta"));
+        auto& objects = meta.as_object()["objects"].as_array();
+        BOOST_TEST_CHECK(objects.size() == collector->m_objects.size());
+        for (auto& val : objects) {
+            auto& obj = val.as_object();
+            std::string args = "role=user,action=repo_get_data,obj_id=";
+            args.append(obj["object_hash"].as_string().c_str());
+            auto data = json::parse(client->InvokeWallet(args));
+            BOOST_TEST_CHECK(
+                data.as_object()["object_data"].as_string().size() ==
+                2 * obj["object_size"].to_number<size_t>());
+        }
+    }
+
+    git::Init init;
+    std::string root;
+    MockWalletServer server;
+    SimpleWalletClient::Options options;
+    std::optional<ObjectCollector> collector;
+    git_oid head;
+};
 }  // namespace
 
 BOOST_AUTO_TEST_CASE(TestObjectCollector) {
@@ -76,3 +200,679 @@ BOOST_AUTO_TEST_CASE(TestObjectCollector) {
         BOOST_TEST_CHECK(size == buf.size());
     });
 }
+
+BOOST_AUTO_TEST_CASE(TestObjectHasher) {
+    git::Init init;
+    std::vector<ByteBuffer> buffers;
+    for (size_t i = 0; i < 300; ++i) {
+        auto& buf = buffers.emplace_back(i * 37 % 5000);
+        for (size_t j = 0; j < buf.size(); ++j) {
+            buf[j] = static_cast<uint8_t>(i * 7 + j * 13);
+        }
+    }
+    const git_object_t types[] = {GIT_OBJECT_BLOB, GIT_OBJECT_TREE,
+                                  GIT_OBJECT_COMMIT, GIT_OBJECT_TAG};
+
+    for (auto engine : {HashEngine::Scalar, HashEngine::Avx2,
+                        HashEngine::ShaNi}) {
+        if (!IsHashEngineSupported(engine)) {
+            continue;
+        }
+        BOOST_TEST_MESSAGE("Hash engine: " << GetHashEngineName(engine));
+        std::vector<git_oid> hashes(buffers.size());
+        std::vector<ObjectHashRequest> requests(buffers.size());
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            requests[i].type = git_object_type2string(types[i % 4]);
+            requests[i].data = buffers[i].data();
+            requests[i].size = buffers[i].size();
+            requests[i].digest = hashes[i].id;
+        }
+        HashObjects(requests.data(), requests.size(), engine);
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            git_oid expected;
+            git_odb_hash(&expected, buffers[i].data(), buffers[i].size(),
+                         types[i % 4]);
+            BOOST_TEST_CHECK((hashes[i] == expected));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestMetrics) {
+    using namespace std::chrono_literals;
+    Histogram h;
+    h.Add(0us);
+    h.Add(3us);
+    h.Add(1000us);
+    h.Add(1000us);
+    BOOST_TEST_CHECK(h.GetCount() == 4u);
+    BOOST_TEST_CHECK(h.GetSum() == 2003u);
+    BOOST_TEST_CHECK(h.GetMax() == 1000u);
+    BOOST_TEST_CHECK(h.GetBucket(0) == 1u);   // < 1us
+    BOOST_TEST_CHECK(h.GetBucket(2) == 1u);   // < 4us
+    BOOST_TEST_CHECK(h.GetBucket(10) == 2u);  // < 1024us
+    BOOST_TEST_CHECK(h.GetPercentile(0.5) == 1000u);
+
+    Metrics disabled;
+    BOOST_TEST_CHECK(!disabled.IsEnabled());
+
+    Metrics metrics("stderr");
+    metrics.AddLatency("rpc.ipfs_get", 5ms);
+    metrics.AddCounter("bytes_sent", 10);
+    metrics.AddCounter("bytes_sent", 5);
+    std::stringstream ss;
+    metrics.WritePrometheus(ss);
+    auto text = ss.str();
+    BOOST_TEST_CHECK(
+        text.find("sourc3_latency_seconds_count{name=\"rpc.ipfs_get\"} 1") !=
+        std::string::npos);
+    BOOST_TEST_CHECK(text.find("sourc3_bytes_sent 15") != std::string::npos);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestMockWalletPush, MockWalletFixture) {
+    namespace json = boost::json;
+    auto client = MakeClient("test");
+    auto refs = json::parse(client->InvokeWallet("role=user,action=list_refs"));
+    BOOST_TEST_CHECK(refs.as_object()["refs"].as_array().empty());
+
+    BOOST_TEST_CHECK(Push(*client, false));
+    refs = json::parse(client->InvokeWallet("role=user,action=list_refs"));
+    auto& ref_list = refs.as_object()["refs"].as_array();
+    BOOST_TEST_REQUIRE(ref_list.size() == 1u);
+    BOOST_TEST_CHECK(ref_list[0].as_object()["name"].as_string() ==
+                     "refs/heads/master");
+    BOOST_TEST_CHECK(ref_list[0].as_object()["commit_hash"].as_string() ==
+                     ToHex(head.id, sizeof(head.id)));
+    CheckObjects("test");
+
+    // refs are updated only if they still point to the expected target
+    auto push_ref = [&](const git_oid* old_target) {
+        std::string args = "role=user,action=push_refs,ref=refs/heads/master";
+        args.append(",ref_target=").append(ToHex(head.id, sizeof(head.id)));
+        if (old_target != nullptr) {
+            args.append(",ref_old_target=")
+                .append(ToHex(old_target->id, sizeof(old_target->id)));
+        }
+        client->InvokeWallet(args);
+        auto txid = client->GetLastTransaction();
+        client->WaitForCompletion([](size_t, const std::string&) {}, false);
+        return client->GetFailedTransactions().count(txid) == 0;
+    };
+    BOOST_TEST_CHECK(!push_ref(nullptr));
+    BOOST_TEST_CHECK(push_ref(&head));
+
+    // objects exist, the contract rejects the transaction unless they are
+    // skipped
+    BOOST_TEST_CHECK(!Push(*client, false));
+    BOOST_TEST_CHECK(Push(*client, true));
+    CheckObjects("test");
+}
+
+BOOST_FIXTURE_TEST_CASE(TestMockWalletEvents, MockWalletFixture) {
+    // the client subscribes to the transaction events only while it waits
+    auto client = MakeClient("test");
+    client->InvokeWallet(
+        "role=user,action=push_refs,ref=refs/heads/master,ref_target=" +
+        ToHex(head.id, sizeof(head.id)));
+    BOOST_TEST_CHECK(server.GetSubscriberCount() == 0u);
+    size_t subscribers = 0;
+    BOOST_TEST_CHECK(
+        client->WaitForCompletion([&](size_t, const std::string& error) {
+            BOOST_TEST_CHECK(error.empty());
+            subscribers = server.GetSubscriberCount();
+        }));
+    BOOST_TEST_CHECK(subscribers == 1u);
+    BOOST_TEST_CHECK(server.GetSubscriberCount() == 0u);
+    BOOST_TEST_CHECK(client->GetTransactionCount() == 0u);
+    // nothing to wait for, no subscription
+    auto counts = server.GetRequestCounts();
+    BOOST_TEST_CHECK(
+        client->WaitForCompletion([](size_t, const std::string&) {}));
+    BOOST_TEST_CHECK(server.GetRequestCounts() == counts);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestMockWalletPages, MockWalletFixture) {
+    namespace json = boost::json;
+    auto client = MakeClient("test");
+    BOOST_TEST_CHECK(Push(*client, false));
+
+    // listings are requested page by page, a page ends at a pack boundary
+    std::set<std::string> listed;
+    size_t pages = 0;
+    std::string start_key;
+    do {
+        std::string args = "role=user,action=repo_get_meta,limit=2";
+        if (!start_key.empty()) {
+            args.append(",start_key=").append(start_key);
+        }
+        auto page = json::parse(client->InvokeWallet(args));
+        auto& page_objects = page.as_object()["objects"].as_array();
+        BOOST_TEST_REQUIRE(!page_objects.empty());
+        for (auto& val : page_objects) {
+            listed.insert(val.as_object()["object_hash"].as_string().c_str());
+        }
+        const json::value* next = page.as_object().if_contains("next");
+        start_key = next != nullptr ? next->as_string().c_str() : "";
+        ++pages;
+    } while (!start_key.empty());
+    BOOST_TEST_CHECK(listed.size() == collector->m_objects.size());
+    BOOST_TEST_CHECK(pages > 1u);
+    auto refs = json::parse(
+        client->InvokeWallet("role=user,action=list_refs,limit=1"));
+    BOOST_TEST_CHECK(refs.as_object()["refs"].as_array().size() == 1u);
+    BOOST_TEST_CHECK(refs.as_object().if_contains("next") == nullptr);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestMockWalletIpfs, MockWalletFixture) {
+    auto client = MakeClient("test");
+    const uint8_t blob[] = {1, 2, 3, 255};
+    auto added = client->SaveObjectToIPFS(blob, sizeof(blob));
+    std::string hash =
+        added.as_object()["result"].as_object()["hash"].as_string().c_str();
+    auto loaded = client->LoadObjectFromIPFS(std::move(hash));
+    auto& data = loaded.as_object()["result"].as_object()["data"].as_array();
+    BOOST_TEST_REQUIRE(data.size() == sizeof(blob));
+    BOOST_TEST_CHECK(data[3].to_number<int>() == 255);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestMockWalletSharedStore, MockWalletFixture) {
+    namespace json = boost::json;
+    // other bytes under an oid of the repo must not replace its data
+    const auto& victim = collector->m_objects.front();
+    ByteBuffer bogus;
+    uint32_t bogus_count = 1;
+    auto bogus_size = static_cast<uint32_t>(victim.GetSize());
+    bogus.insert(bogus.end(), reinterpret_cast<uint8_t*>(&bogus_count),
+                 reinterpret_cast<uint8_t*>(&bogus_count + 1));
+    bogus.push_back(static_cast<uint8_t>(victim.GetSerializeType()));
+    bogus.insert(bogus.end(), victim.oid.id, victim.oid.id + GIT_OID_RAWSZ);
+    bogus.insert(bogus.end(), reinterpret_cast<uint8_t*>(&bogus_size),
+                 reinterpret_cast<uint8_t*>(&bogus_size + 1));
+    bogus.resize(bogus.size() + bogus_size, 0xee);
+    auto poisoner = MakeClient("poisoner");
+    poisoner->InvokeWallet("role=user,action=push_objects,shared=1,data=" +
+                           ToHex(bogus.data(), bogus.size()));
+    BOOST_TEST_CHECK(
+        poisoner->WaitForCompletion([](size_t, const std::string&) {}));
+
+    // forks reference the data of the shared store instead of uploading it
+    BOOST_TEST_CHECK(PushTo("fork", "shared") == 0u);
+    BOOST_TEST_CHECK(PushTo("fork2", "shared") ==
+                     collector->m_objects.size() - 1);
+    auto fork2 = MakeClient("fork2");
+    auto victim_data = json::parse(
+        fork2->InvokeWallet("role=user,action=repo_get_data,obj_id=" +
+                            ToHex(victim.oid.id, GIT_OID_RAWSZ)));
+    BOOST_TEST_CHECK(victim_data.as_object()["object_data"].as_string() ==
+                     ToHex(victim.GetData(), victim.GetSize()));
+    CheckObjects("fork2");
+}
+
+BOOST_FIXTURE_TEST_CASE(TestMockWalletPacks, MockWalletFixture) {
+    // a pack is stored once, pushing its objects again adds nothing
+    PushTo("packed", "pack");
+    PushTo("packed", "pack");
+    PushTo("packed", "skip_existing");
+    CheckObjects("packed");
+}
+
+BOOST_FIXTURE_TEST_CASE(TestMockWalletChunks, MockWalletFixture) {
+    namespace json = boost::json;
+    // an object larger than a transaction is stored in chunks, it appears
+    // only when the last chunk completes it
+    auto client = MakeClient("chunked");
+    ByteBuffer large(2 * ObjectCollector::kSizeThreshold + 10);
+    for (size_t i = 0; i < large.size(); ++i) {
+        large[i] = static_cast<uint8_t>(i);
+    }
+    const std::string large_id(2 * GIT_OID_RAWSZ, 'a');
+    auto push_chunk = [&](size_t index) {
+        auto offset = index * ObjectCollector::kSizeThreshold;
+        auto size = std::min(large.size() - offset,
+                             ObjectCollector::kSizeThreshold);
+        std::string args = "role=user,action=push_object_chunk,obj_id=";
+        args.append(large_id)
+            .append(",obj_type=3,obj_size=")
+            .append(std::to_string(large.size()))
+            .append(",chunks=3,chunk=")
+            .append(std::to_string(index))
+            .append(",data=")
+            .append(ToHex(large.data() + offset, size));
+        client->InvokeWallet(args);
+        auto txid = client->GetLastTransaction();
+        client->WaitForCompletion([](size_t, const std::string&) {}, false);
+        return client->GetFailedTransactions().count(txid) == 0;
+    };
+    BOOST_TEST_CHECK(!push_chunk(2));
+    BOOST_TEST_CHECK(push_chunk(0));
+    BOOST_TEST_CHECK(push_chunk(1));
+    auto meta =
+        json::parse(client->InvokeWallet("role=user,action=repo_get_meta"));
+    BOOST_TEST_CHECK(meta.as_object()["objects"].as_array().empty());
+    BOOST_TEST_CHECK(push_chunk(2));
+    meta = json::parse(client->InvokeWallet("role=user,action=repo_get_meta"));
+    auto& chunked_objects = meta.as_object()["objects"].as_array();
+    BOOST_TEST_REQUIRE(chunked_objects.size() == 1u);
+    BOOST_TEST_CHECK(
+        chunked_objects[0].as_object()["object_size"].to_number<size_t>() ==
+        large.size());
+    std::string received;
+    for (size_t i = 0; i < 3; ++i) {
+        std::string args = "role=user,action=repo_get_data,obj_id=";
+        args.append(large_id).append(",chunk=").append(std::to_string(i));
+        auto res = json::parse(client->InvokeWallet(args));
+        BOOST_TEST_CHECK(
+            res.as_object()["chunks_number"].to_number<uint32_t>() == 3u);
+        received.append(res.as_object()["object_data"].as_string().c_str());
+    }
+    BOOST_TEST_CHECK(received == ToHex(large.data(), large.size()));
+}
+
+BOOST_AUTO_TEST_CASE(TestSessionCache) {
+    namespace json = boost::json;
+    MockWalletServer::Options server_options;
+    MockWalletServer server(server_options);
+    auto test_repo_id = server.CreateRepo(server.GetUserKey(), "test");
+    server.Start();
+
+    SimpleWalletClient::Options options;
+    options.apiHost = "127.0.0.1";
+    options.apiPort = std::to_string(server.GetPort());
+    options.repoOwner = server.GetUserKey();
+    options.repoName = "test";
+    options.sessionCachePath = "./temp/session_cache.json";
+    std::filesystem::remove(options.sessionCachePath);
+    const std::string target(40, 'a');
+    {
+        SimpleWalletClient client(options);
+        client.InvokeWallet(
+            "role=user,action=push_refs,ref=refs/heads/master,ref_target=" +
+            target);
+        BOOST_TEST_CHECK(
+            client.WaitForCompletion([](size_t, const std::string&) {}));
+        // a rejected ref update keeps the session
+        client.InvokeWallet(
+            "role=user,action=push_refs,ref=refs/heads/master,ref_target=" +
+            std::string(40, 'b'));
+        BOOST_TEST_CHECK(!client.WaitForCompletion(
+            [](size_t, const std::string&) {}, false));
+    }
+
+    // the cached id is trusted until a call with it fails, an id of a repo
+    // which doesn't exist is replaced
+    auto read_cache = [&] {
+        std::ifstream file(options.sessionCachePath);
+        std::stringstream ss;
+        ss << file.rdbuf();
+        return json::parse(ss.str());
+    };
+    auto repo_key = options.repoOwner + "/" + options.repoName;
+    auto cache = read_cache();
+    BOOST_TEST_REQUIRE(cache.as_object().size() == 1u);
+    auto& session = cache.as_object().begin()->value().as_object();
+    auto test_id = session["repos"].as_object()[repo_key];
+    BOOST_TEST_REQUIRE(test_id.as_string() == std::to_string(test_repo_id));
+    session["repos"].as_object()[repo_key] = std::to_string(test_repo_id + 1);
+    {
+        std::ofstream file(options.sessionCachePath, std::ios::trunc);
+        file << json::serialize(cache);
+    }
+
+    SimpleWalletClient client(options);
+    auto refs = json::parse(client.InvokeWallet("role=user,action=list_refs"));
+    auto& ref_list = refs.as_object()["refs"].as_array();
+    BOOST_TEST_REQUIRE(ref_list.size() == 1u);
+    BOOST_TEST_CHECK(ref_list[0].as_object()["commit_hash"].as_string() ==
+                     target);
+    cache = read_cache();
+    BOOST_TEST_CHECK(cache.as_object()
+                         .begin()
+                         ->value()
+                         .as_object()["repos"]
+                         .as_object()[repo_key] == test_id);
+}
+
+BOOST_AUTO_TEST_CASE(TestAsyncCalls) {
+    using namespace std::chrono_literals;
+    namespace json = boost::json;
+    MockWalletServer::Options server_options;
+    server_options.ipfsLatency = 200ms;
+    MockWalletServer server(server_options);
+    server.Start();
+
+    SimpleWalletClient::Options options;
+    options.apiHost = "127.0.0.1";
+    options.apiPort = std::to_string(server.GetPort());
+    SimpleWalletClient client(options);
+
+    // completion
+    std::string output;
+    client.AsyncInvokeShader(
+        "role=manager,action=view_contracts",
+        [&](const beast::error_code& ec, std::string&& result) {
+            BOOST_TEST_CHECK(!ec);
+            output = std::move(result);
+        });
+    const uint8_t blob[] = {1, 2, 3, 255};
+    std::string hash;
+    client.AsyncSaveObjectToIPFS(
+        blob, sizeof(blob),
+        [&](const beast::error_code& ec, json::value&& response) {
+            BOOST_TEST_REQUIRE(!ec);
+            hash = response.as_object()["result"]
+                       .as_object()["hash"]
+                       .as_string()
+                       .c_str();
+        });
+    client.Wait();
+    BOOST_TEST_CHECK(
+        json::parse(output).as_object()["contracts"].as_array().size() == 1u);
+    BOOST_TEST_REQUIRE(!hash.empty());
+    size_t loaded_size = 0;
+    client.AsyncLoadObjectFromIPFS(
+        hash, [&](const beast::error_code& ec, json::value&& response) {
+            BOOST_TEST_REQUIRE(!ec);
+            loaded_size = response.as_object()["result"]
+                              .as_object()["data"]
+                              .as_array()
+                              .size();
+        });
+    client.Wait();
+    BOOST_TEST_CHECK(loaded_size == sizeof(blob));
+
+    // timeout, the late response is ignored
+    beast::error_code timeout_ec;
+    client.AsyncLoadObjectFromIPFS(
+        hash,
+        [&](const beast::error_code& ec, json::value&&) {
+            timeout_ec = ec;
+        },
+        20ms);
+    client.Wait();
+    BOOST_TEST_CHECK(timeout_ec == net::error::timed_out);
+
+    // cancellation calls the handler at once
+    std::vector<beast::error_code> cancelled;
+    auto on_cancel = [&](const beast::error_code& ec, json::value&&) {
+        cancelled.push_back(ec);
+    };
+    auto id = client.AsyncLoadObjectFromIPFS(hash, on_cancel);
+    client.Cancel(id);
+    BOOST_TEST_REQUIRE(cancelled.size() == 1u);
+    BOOST_TEST_CHECK(cancelled[0] == net::error::operation_aborted);
+    client.AsyncLoadObjectFromIPFS(hash, on_cancel);
+    client.AsyncLoadObjectFromIPFS(hash, on_cancel);
+    client.CancelAll();
+    BOOST_TEST_REQUIRE(cancelled.size() == 3u);
+    BOOST_TEST_CHECK(cancelled[1] == net::error::operation_aborted);
+    BOOST_TEST_CHECK(cancelled[2] == net::error::operation_aborted);
+    // the responses of the cancelled requests don't reach the handlers
+    client.Wait();
+    client.AsyncLoadObjectFromIPFS(hash, on_cancel, 1s);
+    client.Wait();
+    BOOST_TEST_REQUIRE(cancelled.size() == 4u);
+    BOOST_TEST_CHECK(!cancelled[3]);
+}
+
+BOOST_AUTO_TEST_CASE(TestOutOfOrderReplies) {
+    using namespace std::chrono_literals;
+    namespace json = boost::json;
+    MockWalletServer::Options server_options;
+    server_options.latency = 20ms;
+    server_options.reorderReplies = 4;
+    MockWalletServer server(server_options);
+    server.Start();
+
+    SimpleWalletClient::Options options;
+    options.apiHost = "127.0.0.1";
+    options.apiPort = std::to_string(server.GetPort());
+    options.apiConnections = 1;
+    SimpleWalletClient client(options);
+
+    constexpr size_t kCount = 8;
+    std::vector<std::string> hashes(kCount);
+    std::vector<size_t> completed;
+    for (size_t i = 0; i < kCount; ++i) {
+        const auto byte = static_cast<uint8_t>(i);
+        client.PostSaveObjectToIPFS(&byte, 1, [&, i](json::value&& response) {
+            hashes[i] = response.as_object()["result"]
+                            .as_object()["hash"]
+                            .as_string()
+                            .c_str();
+            completed.push_back(i);
+        });
+    }
+    client.Wait();
+    BOOST_TEST_REQUIRE(completed.size() == kCount);
+    BOOST_TEST_CHECK(!std::is_sorted(completed.begin(), completed.end()));
+
+    // each response reaches the handler of its request
+    completed.clear();
+    for (size_t i = 0; i < kCount; ++i) {
+        client.PostLoadObjectFromIPFS(
+            std::string(hashes[i]), [&, i](json::value&& response) {
+                auto& data =
+                    response.as_object()["result"].as_object()["data"];
+                BOOST_TEST_REQUIRE(data.as_array().size() == 1u);
+                BOOST_TEST_CHECK(data.as_array()[0].to_number<size_t>() == i);
+                completed.push_back(i);
+            });
+    }
+    client.Wait();
+    BOOST_TEST_CHECK(completed.size() == kCount);
+    BOOST_TEST_CHECK(!std::is_sorted(completed.begin(), completed.end()));
+}
+
+BOOST_AUTO_TEST_CASE(TestEventsBetweenReplies) {
+    using namespace std::chrono_literals;
+    namespace json = boost::json;
+    MockWalletServer::Options server_options;
+    server_options.txLatency = 10ms;
+    server_options.eventsBetweenReplies = true;
+    MockWalletServer server(server_options);
+    server.CreateRepo(server.GetUserKey(), "test");
+    server.Start();
+
+    SimpleWalletClient::Options options;
+    options.apiHost = "127.0.0.1";
+    options.apiPort = std::to_string(server.GetPort());
+    options.repoOwner = server.GetUserKey();
+    options.repoName = "test";
+    SimpleWalletClient client(options);
+
+    const std::string target(40, 'b');
+    for (const char* name : {"refs/heads/a", "refs/heads/b", "refs/heads/c"}) {
+        std::string args = "role=user,action=push_refs,ref=";
+        args.append(name).append(",ref_target=").append(target);
+        client.InvokeWallet(args);
+    }
+    size_t done = 0;
+    BOOST_TEST_CHECK(client.WaitForCompletion(
+        [&](size_t, const std::string& error) {
+            BOOST_TEST_CHECK(error.empty());
+            ++done;
+        }));
+    BOOST_TEST_CHECK(done == 3u);
+
+    size_t listed = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        client.PostInvokeWallet("role=user,action=list_refs",
+                                [&](std::string&& output) {
+                                    auto refs = json::parse(output);
+                                    listed += refs.as_object()["refs"]
+                                                  .as_array()
+                                                  .size();
+                                });
+    }
+    client.Wait();
+    BOOST_TEST_CHECK(listed == 12u);
+}
+
+BOOST_AUTO_TEST_CASE(TestConnectionLoss) {
+    MockWalletServer::Options server_options;
+    server_options.dropAfter = 2;
+    MockWalletServer server(server_options);
+    server.Start();
+
+    SimpleWalletClient::Options options;
+    options.apiHost = "127.0.0.1";
+    options.apiPort = std::to_string(server.GetPort());
+    options.apiConnections = 1;
+    SimpleWalletClient client(options);
+    auto invoke = [&](bool idempotent) {
+        beast::error_code error;
+        std::string output;
+        client.AsyncInvokeShader(
+            "role=manager,action=view_contracts",
+            [&](const beast::error_code& ec, std::string&& result) {
+                error = ec;
+                output = std::move(result);
+            },
+            {}, idempotent);
+        client.Wait();
+        return !error && !output.empty();
+    };
+    auto invoked = [&] {
+        return server.GetRequestCounts()["invoke_contract"];
+    };
+
+    BOOST_TEST_CHECK(invoke(true));
+    // the connection is lost with the request, it is resent over a new one
+    BOOST_TEST_CHECK(invoke(true));
+    BOOST_TEST_CHECK(invoked() == 3u);
+    // a sent request which isn't idempotent may have been executed, it fails
+    BOOST_TEST_CHECK(!invoke(false));
+    BOOST_TEST_CHECK(invoked() == 4u);
+    // the next one waits for the backoff and reconnects
+    BOOST_TEST_CHECK(invoke(false));
+    BOOST_TEST_CHECK(invoked() == 5u);
+}
+
+BOOST_AUTO_TEST_CASE(TestReconnectBackoff) {
+    using namespace std::chrono_literals;
+    MockWalletServer::Options server_options;
+    {
+        MockWalletServer probe(server_options);
+        server_options.port = probe.GetPort();
+    }
+    // the wallet comes up after the first attempts to connect have failed
+    std::unique_ptr<MockWalletServer> server;
+    std::thread starter([&] {
+        std::this_thread::sleep_for(150ms);
+        server = std::make_unique<MockWalletServer>(server_options);
+        server->Start();
+    });
+
+    SimpleWalletClient::Options options;
+    options.apiHost = "127.0.0.1";
+    options.apiPort = std::to_string(server_options.port);
+    options.apiConnections = 1;
+    SimpleWalletClient client(options);
+    beast::error_code error;
+    auto started = std::chrono::steady_clock::now();
+    // not idempotent, but never sent, so it is retried
+    client.AsyncInvokeShader(
+        "role=manager,action=view_contracts",
+        [&](const beast::error_code& ec, std::string&&) {
+            error = ec;
+        });
+    client.Wait();
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    starter.join();
+    BOOST_TEST_CHECK(!error);
+    // retried after 100ms and then after 200ms
+    BOOST_TEST_CHECK((elapsed >= 300ms));
+    BOOST_TEST_CHECK(server->GetRequestCounts()["invoke_contract"] == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(TestCancelWhileConnecting) {
+    MockWalletServer::Options server_options;
+    MockWalletServer server(server_options);
+    server.Start();
+
+    SimpleWalletClient::Options options;
+    options.apiHost = "127.0.0.1";
+    options.apiPort = std::to_string(server.GetPort());
+    options.apiConnections = 1;
+    SimpleWalletClient client(options);
+    // the connection is established by the io context, the cancelled
+    // request is dropped from the queue before it is written
+    auto id = client.AsyncInvokeShader(
+        "role=manager,action=view_contracts",
+        [](const beast::error_code&, std::string&&) {
+        });
+    client.Cancel(id);
+    std::string output;
+    client.AsyncInvokeShader(
+        "role=manager,action=view_contracts",
+        [&](const beast::error_code& ec, std::string&& result) {
+            BOOST_TEST_CHECK(!ec);
+            output = std::move(result);
+        });
+    client.Wait();
+    BOOST_TEST_CHECK(!output.empty());
+    BOOST_TEST_CHECK(server.GetRequestCounts()["invoke_contract"] == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(TestHttpTransport) {
+    using namespace std::chrono_literals;
+    namespace json = boost::json;
+    MockWalletServer::Options server_options;
+    server_options.http = true;
+    server_options.txLatency = 100ms;
+    MockWalletServer server(server_options);
+    server.CreateRepo(server.GetUserKey(), "test");
+    server.Start();
+
+    SimpleWalletClient::Options options;
+    options.apiHost = "127.0.0.1";
+    options.apiPort = std::to_string(server.GetPort());
+    options.apiTarget = "/api/wallet";
+    options.apiTransport = "http";
+    options.repoOwner = server.GetUserKey();
+    options.repoName = "test";
+    SimpleWalletClient client(options);
+
+    auto refs = json::parse(client.InvokeWallet("role=user,action=list_refs"));
+    BOOST_TEST_CHECK(refs.as_object()["refs"].as_array().empty());
+
+    // there are no events over HTTP, the status is polled
+    const std::string target(40, 'c');
+    client.InvokeWallet(
+        "role=user,action=push_refs,ref=refs/heads/master,ref_target=" +
+        target);
+    auto started = std::chrono::steady_clock::now();
+    BOOST_TEST_CHECK(
+        client.WaitForCompletion([](size_t, const std::string&) {}));
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    // in progress at the first poll, completed at the next one
+    BOOST_TEST_CHECK(server.GetRequestCounts()["tx_status"] == 2u);
+    BOOST_TEST_CHECK(server.GetRequestCounts()["ev_subunsub"] == 0u);
+    BOOST_TEST_CHECK((elapsed >= 1s));
+
+    // requests are pipelined over the kept alive connections
+    size_t listed = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        client.PostInvokeWallet("role=user,action=list_refs",
+                                [&](std::string&& output) {
+                                    auto refs = json::parse(output);
+                                    auto& list =
+                                        refs.as_object()["refs"].as_array();
+                                    BOOST_TEST_REQUIRE(list.size() == 1u);
+                                    BOOST_TEST_CHECK(
+                                        list[0].as_object()["commit_hash"]
+                                            .as_string() == target);
+                                    ++listed;
+                                });
+    }
+    client.Wait();
+    BOOST_TEST_CHECK(listed == 8u);
+
+    const uint8_t blob[] = {1, 2, 3, 255};
+    auto added = client.SaveObjectToIPFS(blob, sizeof(blob));
+    std::string hash =
+        added.as_object()["result"].as_object()["hash"].as_string().c_str();
+    auto loaded = client.LoadObjectFromIPFS(std::move(hash));
+    auto& data = loaded.as_object()["result"].as_object()["data"].as_array();
+    BOOST_TEST_REQUIRE(data.size() == sizeof(blob));
+    BOOST_TEST_CHECK(data[3].to_number<int>() == 255);
+}
@@ -1,97 +1,413 @@
 #include "wallet_client.h"
 #include <boost/json.hpp>
 #include <boost/asio.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/scope_exit.hpp>
 #include <boost/beast/core/buffers_adaptor.hpp>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <sstream>
+#include "object_hasher.h"
 
 namespace sourc3 {
 namespace json = boost::json;
 
-std::string SimpleWalletClient::LoadObjectFromIPFS(std::string&& hash) {
-    auto msg =
-        json::value{{JsonRpcHeader, JsonRpcVersion},
-                    {"id", 1},
-                    {"method", "ipfs_get"},
-                    {"params", {{"hash", std::move(hash)}, {"timeout", 5000}}}};
-    return CallAPI(json::serialize(msg));
+namespace {
+// Identifies app shader by its content, like 'git hash-object' does
+std::string GetFileId(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return path;
+    }
+    ByteBuffer data((std::istreambuf_iterator<char>(file)),
+                    std::istreambuf_iterator<char>());
+    uint8_t digest[kSha1Size];
+    ObjectHashRequest request;
+    request.type = "blob";
+    request.data = data.data();
+    request.size = data.size();
+    request.digest = digest;
+    HashObjects(&request, 1);
+    return ToHex(digest, sizeof(digest));
 }
 
-std::string SimpleWalletClient::SaveObjectToIPFS(const uint8_t* data,
-                                                 size_t size) {
-    auto msg = json::value{{JsonRpcHeader, JsonRpcVersion},
-                           {"id", 1},
-                           {"method", "ipfs_add"},
-                           {"params",
-                            {
-                                {"data", json::array(data, data + size)},
-                            }}};
-    return CallAPI(json::serialize(msg));
+json::object ReadSessionCache(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        return {};
+    }
+    std::string content((std::istreambuf_iterator<char>(file)),
+                        std::istreambuf_iterator<char>());
+    json::error_code ec;
+    auto root = json::parse(content, ec);
+    if (ec || !root.is_object()) {
+        return {};
+    }
+    return std::move(root.as_object());
 }
 
-bool SimpleWalletClient::WaitForCompletion(WaitFunc&& func) {
-    if (transactions_.empty())
-        return true;  // ok
+void WriteSessionCache(const std::string& path, const json::object& cache) {
+    namespace fs = boost::filesystem;
+    boost::system::error_code ec;
+    fs::path cache_path(path);
+    if (cache_path.has_parent_path()) {
+        fs::create_directories(cache_path.parent_path(), ec);
+    }
+    // several helpers may run at once, replace the file atomically
+    auto temp_path = cache_path;
+    temp_path += fs::unique_path(".%%%%-%%%%");
+    {
+        std::ofstream file(temp_path.string(), std::ios::trunc);
+        if (!file) {
+            return;
+        }
+        file << json::serialize(cache);
+        if (!file) {
+            fs::remove(temp_path, ec);
+            return;
+        }
+    }
+    fs::rename(temp_path, cache_path, ec);
+    if (ec) {
+        fs::remove(temp_path, ec);
+    }
+}
 
-    SubUnsubEvents(true);
-    BOOST_SCOPE_EXIT_ALL(&, this) {
-        SubUnsubEvents(false);
+// Adapts async handler for the pipelined calls which report errors by
+// exceptions
+template <typename Handler>
+auto ThrowOnError(Handler&& handler) {
+    return [handler = std::move(handler)](const beast::error_code& ec,
+                                          auto&& result) {
+        if (ec) {
+            throw beast::system_error(ec);
+        }
+        handler(std::move(result));
     };
-    size_t done = 0;
-    while (!transactions_.empty()) {
-        auto response = ReadAPI();
-        auto r = json::parse(response);
+}
 
-        auto& res = r.as_object()["result"].as_object();
+// "rpc.<method>", shader calls are split by the action
+std::string GetMetricName(std::string_view method,
+                          const json::object& params) {
+    std::string name = "rpc.";
+    name.append(method);
+    if (const auto* args = params.if_contains("args");
+        args != nullptr && args->is_string()) {
+        std::string_view sv = args->as_string();
+        if (auto p = sv.find("action="); p != std::string_view::npos) {
+            sv.remove_prefix(p + 7);
+            name.append(":").append(sv.substr(0, sv.find(',')));
+        }
+    }
+    return name;
+}
+
+// Shader outputs are objects, a failed action returns {"error": ...}
+bool IsErrorOutput(std::string_view output) {
+    if (output.find("\"error\"") == std::string_view::npos) {
+        return false;
+    }
+    beast::error_code ec;
+    auto root = json::parse(output, ec);
+    return !ec && root.is_object() && root.as_object().contains("error");
+}
+}  // namespace
+
+std::string SimpleWalletClient::InvokeWallet(std::string args) {
+    CheckSession();
+    auto invoke = [&] {
+        return InvokeShader(args + ",repo_id=" + GetRepoID() +
+                            ",cid=" + GetCID());
+    };
+    std::string output;
+    try {
+        output = invoke();
+    } catch (const std::exception&) {
+        // the cached cid may be stale
+        check_session_ = true;
+        if (!CheckSession()) {
+            throw;
+        }
+        return invoke();
+    }
+    if (IsErrorOutput(output)) {
+        // e.g. the cached repo id is not found, nothing has been done
+        check_session_ = true;
+        if (CheckSession()) {
+            return invoke();
+        }
+    }
+    return output;
+}
 
-        for (auto& val : res["txs"].as_array()) {
-            auto& tx = val.as_object();
-            std::string txID = tx["txId"].as_string().c_str();
-            auto it = transactions_.find(txID);
-            if (it == transactions_.end()) {
-                continue;
+SimpleWalletClient::RequestId SimpleWalletClient::AsyncInvokeShader(
+    std::string args, AsyncInvokeHandler&& handler, Timeout timeout,
+    bool idempotent) {
+    return PostRequest(
+        "invoke_contract",
+        {{"contract_file", options_.appPath}, {"args", std::move(args)}},
+        [this, handler = std::move(handler)](const beast::error_code& ec,
+                                             json::value&& response) {
+            if (ec) {
+                handler(ec, {});
+                return;
             }
+            handler(ec, ExtractResult(response));
+        },
+        timeout, idempotent);
+}
+
+SimpleWalletClient::RequestId SimpleWalletClient::AsyncLoadObjectFromIPFS(
+    std::string hash, AsyncHandler&& handler, Timeout timeout) {
+    return PostRequest("ipfs_get",
+                       {{"hash", std::move(hash)}, {"timeout", 5000}},
+                       std::move(handler), timeout, true);
+}
+
+SimpleWalletClient::RequestId SimpleWalletClient::AsyncSaveObjectToIPFS(
+    const uint8_t* data, size_t size, AsyncHandler&& handler,
+    Timeout timeout) {
+    json::object params;
+    params["data"] = json::array(data, data + size);
+    // IPFS addresses are content based, adding twice is harmless
+    return PostRequest("ipfs_add", std::move(params), std::move(handler),
+                       timeout, true);
+}
+
+void SimpleWalletClient::Cancel(RequestId id) {
+    CompleteRequest(id, net::error::operation_aborted, {});
+}
+
+void SimpleWalletClient::CancelAll() {
+    if (auto error = FailPending(net::error::operation_aborted); error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void SimpleWalletClient::PostInvokeWallet(std::string args,
+                                          InvokeHandler&& handler,
+                                          bool idempotent) {
+    CheckSession();
+    args.append(",repo_id=")
+        .append(GetRepoID())
+        .append(",cid=")
+        .append(GetCID());
+    // the session is checked by Wait(), the failed calls are not repeated
+    AsyncInvokeShader(std::move(args),
+                      ThrowOnError([this, handler = std::move(handler)](
+                                       std::string&& output) {
+                          if (IsErrorOutput(output)) {
+                              check_session_ = true;
+                          }
+                          handler(std::move(output));
+                      }),
+                      {}, idempotent);
+}
+
+json::value SimpleWalletClient::LoadObjectFromIPFS(std::string&& hash) {
+    return CallAPI("ipfs_get", {{"hash", std::move(hash)}, {"timeout", 5000}},
+                   true);
+}
 
-            auto status = tx["status"].as_int64();
+void SimpleWalletClient::PostLoadObjectFromIPFS(std::string&& hash,
+                                                ResponseHandler&& handler) {
+    AsyncLoadObjectFromIPFS(std::move(hash), ThrowOnError(std::move(handler)));
+}
+
+json::value SimpleWalletClient::SaveObjectToIPFS(const uint8_t* data,
+                                                 size_t size) {
+    json::object params;
+    params["data"] = json::array(data, data + size);
+    return CallAPI("ipfs_add", std::move(params), true);
+}
+
+void SimpleWalletClient::PostSaveObjectToIPFS(const uint8_t* data, size_t size,
+                                              ResponseHandler&& handler) {
+    AsyncSaveObjectToIPFS(data, size, ThrowOnError(std::move(handler)));
+}
+
+void SimpleWalletClient::Wait() {
+    RunUntil([this] {
+        return pending_.empty();
+    });
+    CheckSession();
+}
+
+bool SimpleWalletClient::WaitForCompletion(WaitFunc&& func,
+                                           bool stopOnFailure) {
+    if (transactions_.empty())
+        return true;  // ok
+
+    size_t done = 0;
+    bool failed = false;
+    auto on_status = [&](const std::string& txID, const json::object& tx) {
+        auto it = transactions_.find(txID);
+        if (it == transactions_.end() || failed) {
+            return;
+        }
+
+        auto status = tx.at("status").as_int64();
+        if (status == 4 || status == 2) {
+            const auto* reason = tx.if_contains("failure_reason");
+            std::string error = status == 2 ? "canceled"
+                                : reason && reason->is_string()
+                                    ? reason->as_string().c_str()
+                                    : "failed";
+            func(++done, error);
+            failed_transactions_[txID] = error;
             if (status == 4) {
-                func(++done, tx["failure_reason"].as_string().c_str());
-                return false;
-            } else if (status == 2) {
-                func(++done, "canceled");
-                return false;
-            } else if (status == 3) {
-                func(++done, "");
+                // the stale cached ids fail a transaction as well as an
+                // expected rejection like a ref update based on an outdated
+                // value, the ids are checked after the wait
+                check_session_ = true;
+            }
+            if (stopOnFailure) {
+                failed = true;
+            } else {
                 transactions_.erase(txID);
             }
+        } else if (status == 3) {
+            func(++done, "");
+            transactions_.erase(txID);
         }
+    };
+
+    if (IsHttpTransport()) {
+        PollTransactions(on_status, [&] {
+            return transactions_.empty() || failed;
+        });
+    } else {
+        event_handler_ = [&](const json::value& event) {
+            const auto* res = event.as_object().if_contains("result");
+            if (res == nullptr || !res->is_object()) {
+                return;
+            }
+            const auto* txs = res->as_object().if_contains("txs");
+            if (txs == nullptr || !txs->is_array()) {
+                return;
+            }
+            for (auto& val : txs->as_array()) {
+                auto& tx = val.as_object();
+                on_status(tx.at("txId").as_string().c_str(), tx);
+            }
+        };
+        SubUnsubEvents(true);
+        BOOST_SCOPE_EXIT_ALL(&, this) {
+            event_handler_ = nullptr;
+            SubUnsubEvents(false);
+        };
+        RunUntil([&] {
+            return transactions_.empty() || failed;
+        });
     }
-    return true;
+    CheckSession();
+    return !failed;
 }
 
-std::string SimpleWalletClient::SubUnsubEvents(bool sub) {
-    auto msg = json::value{{JsonRpcHeader, JsonRpcVersion},
-                           {"id", 1},
-                           {"method", "ev_subunsub"},
-                           {"params",
-                            {
-                                {"ev_txs_changed", sub},
-                            }}};
-    return CallAPI(json::serialize(msg));
+void SimpleWalletClient::PollTransactions(
+    const std::function<void(const std::string&, const json::object&)>&
+        on_status,
+    const std::function<bool()>& done) {
+    net::steady_timer timer(ioc_);
+    while (!done()) {
+        std::vector<std::string> txs(transactions_.begin(),
+                                     transactions_.end());
+        size_t waiting = txs.size();
+        for (const auto& tx_id : txs) {
+            PostRequest(
+                "tx_status", {{"txId", tx_id}},
+                [&, tx_id](const beast::error_code& ec, json::value&& r) {
+                    --waiting;
+                    if (ec) {
+                        throw beast::system_error(ec);
+                    }
+                    const auto* res = r.as_object().if_contains("result");
+                    if (res != nullptr && res->is_object()) {
+                        on_status(tx_id, res->as_object());
+                    }
+                },
+                {}, true);
+        }
+        RunUntil([&] {
+            return waiting == 0;
+        });
+        if (done()) {
+            break;
+        }
+        bool expired = false;
+        timer.expires_after(kPollInterval);
+        timer.async_wait([&](const beast::error_code&) {
+            expired = true;
+        });
+        RunUntil([&] {
+            return expired;
+        });
+    }
 }
 
-void SimpleWalletClient::EnsureConnected() {
-    if (connected_) {
-        return;
-    }
+void SimpleWalletClient::SubUnsubEvents(bool sub) {
+    CallAPI("ev_subunsub", {{"ev_txs_changed", sub}}, true, kEventsConnection);
+}
 
-    auto const results = resolver_.resolve(options_.apiHost, options_.apiPort);
+void SimpleWalletClient::Connect(size_t index) {
+    connections_[index]->connecting = true;
+    resolver_.async_resolve(
+        options_.apiHost, options_.apiPort,
+        [this, index](const beast::error_code& ec,
+                      const tcp::resolver::results_type& results) {
+            if (ec) {
+                OnConnectFailed(index, ec);
+                return;
+            }
+            // Make the connection on the IP address we get from a lookup
+            connections_[index]->stream.async_connect(
+                results, [this, index](const beast::error_code& ec,
+                                       const tcp::endpoint&) {
+                    if (ec) {
+                        OnConnectFailed(index, ec);
+                        return;
+                    }
+                    auto& connection = *connections_[index];
+                    connection.connecting = false;
+                    connection.connected = true;
+                    ++connection.generation;
+                    // the requests cancelled meanwhile are not sent
+                    auto& queue = connection.write_queue;
+                    auto cancelled = [this](const auto& item) {
+                        return pending_.count(item.first) == 0;
+                    };
+                    queue.erase(
+                        std::remove_if(queue.begin(), queue.end(), cancelled),
+                        queue.end());
+                    if (queue.empty()) {
+                        return;
+                    }
+                    DoWrite(index);
+                    if (!connection.reading) {
+                        DoRead(index);
+                    }
+                });
+        });
+}
 
-    // Make the connection on the IP address we get from a lookup
-    stream_.connect(results);
-    connected_ = true;
+void SimpleWalletClient::OnConnectFailed(size_t index,
+                                         const beast::error_code& ec) {
+    auto& connection = *connections_[index];
+    connection.connecting = false;
+    ++connection.failures;
+    connection.retry_after =
+        std::chrono::steady_clock::now() + GetBackoff(connection.failures);
+    connection.write_queue.clear();
+    auto requests = std::move(connection.requests);
+    connection.requests.clear();
+    for (auto id : requests) {
+        Retry(id, ec, true);
+    }
 }
 
-std::string SimpleWalletClient::ExtractResult(const std::string& response) {
-    auto r = json::parse(response);
+std::string SimpleWalletClient::ExtractResult(json::value& r) {
+    last_transaction_.clear();
     if (auto* txid = r.as_object()["result"].as_object().if_contains("txid");
         txid) {
         if (!std::all_of(txid->as_string().begin(), txid->as_string().end(),
@@ -99,32 +415,35 @@ std::string SimpleWalletClient::ExtractResult(const std::string& response) {
                              return c == '0';
                          })) {
             transactions_.insert(txid->as_string().c_str());
+            last_transaction_ = txid->as_string().c_str();
         }
     }
     return r.as_object()["result"].as_object()["output"].as_string().c_str();
 }
 
-std::string SimpleWalletClient::InvokeShader(const std::string& args) {
+std::string SimpleWalletClient::InvokeShader(const std::string& args,
+                                             bool idempotent) {
     // std::cerr << "Args: " << args << std::endl;
-    auto msg = json::value{
-        {JsonRpcHeader, JsonRpcVersion},
-        {"id", 1},
-        {"method", "invoke_contract"},
-        {"params", {{"contract_file", options_.appPath}, {"args", args}}}};
-
-    return ExtractResult(CallAPI(json::serialize(msg)));
+    auto response = CallAPI(
+        "invoke_contract",
+        {{"contract_file", options_.appPath}, {"args", args}}, idempotent);
+    return ExtractResult(response);
 }
 
 const std::string& SimpleWalletClient::GetCID() {
+    if (cid_.empty()) {
+        LoadSession();
+    }
     if (cid_.empty()) {
         auto root =
-            json::parse(InvokeShader("role=manager,action=view_contracts"));
+            json::parse(InvokeShader("role=manager,action=view_contracts", true));
 
         assert(root.is_object());
         auto& contracts = root.as_object()["contracts"];
         if (contracts.is_array() && !contracts.as_array().empty()) {
             cid_ =
                 contracts.as_array()[0].as_object()["cid"].as_string().c_str();
+            SaveSession();
         }
     }
     return cid_;
@@ -132,41 +451,524 @@ const std::string& SimpleWalletClient::GetCID() {
 
 const std::string& SimpleWalletClient::GetRepoID() {
     if (repo_id_.empty()) {
-        std::string request = "role=user,action=repo_id_by_name,repo_name=";
-        request.append(options_.repoName)
-            .append(",repo_owner=")
-            .append(options_.repoOwner)
-            .append(",cid=")
-            .append(GetCID());
-
-        auto root = json::parse(InvokeShader(request));
-        assert(root.is_object());
-        if (auto it = root.as_object().find("repo_id");
-            it != root.as_object().end()) {
-            auto& id = *it;
-            repo_id_ = std::to_string(id.value().to_number<uint32_t>());
+        LoadSession();
+    }
+    if (repo_id_.empty()) {
+        repo_id_ = ResolveRepoID();
+        if (!repo_id_.empty()) {
+            SaveSession();
         }
     }
     return repo_id_;
 }
 
-std::string SimpleWalletClient::CallAPI(std::string&& request) {
-    EnsureConnected();
-    request.push_back('\n');
-    size_t s = request.size();
-    size_t transferred =
-        boost::asio::write(stream_, boost::asio::buffer(request));
-    if (s != transferred) {
-        return "";
+std::string SimpleWalletClient::ResolveRepoID() {
+    std::string request = "role=user,action=repo_id_by_name,repo_name=";
+    request.append(options_.repoName)
+        .append(",repo_owner=")
+        .append(options_.repoOwner)
+        .append(",cid=")
+        .append(GetCID());
+
+    auto root = json::parse(InvokeShader(request, true));
+    assert(root.is_object());
+    if (auto it = root.as_object().find("repo_id");
+        it != root.as_object().end()) {
+        auto& id = *it;
+        return std::to_string(id.value().to_number<uint32_t>());
+    }
+    return {};
+}
+
+// The cached ids are kept while the cached cid resolves the repo name to
+// the cached repo id, a removed or recreated repo resets the session
+bool SimpleWalletClient::ValidateSession() {
+    LoadSession();
+    if (!session_loaded_ || session_validated_) {
+        return false;
+    }
+    std::string repo_id;
+    try {
+        repo_id = ResolveRepoID();
+    } catch (const std::exception&) {
+        // the cached cid may be stale
+    }
+    if (repo_id.empty() || (!repo_id_.empty() && repo_id != repo_id_)) {
+        ResetSession();
+        return true;
+    }
+    session_validated_ = true;
+    if (repo_id_.empty()) {
+        repo_id_ = std::move(repo_id);
+        SaveSession();
+    }
+    return false;
+}
+
+bool SimpleWalletClient::CheckSession() {
+    if (!check_session_) {
+        return false;
+    }
+    check_session_ = false;
+    return ValidateSession();
+}
+
+void SimpleWalletClient::LoadSession() {
+    if (options_.sessionCachePath.empty() || !session_key_.empty()) {
+        return;
+    }
+    session_key_ = options_.apiHost + ":" + options_.apiPort + "/" +
+                   GetFileId(options_.appPath);
+    auto cache = ReadSessionCache(options_.sessionCachePath);
+    auto* session = cache.if_contains(session_key_);
+    if (session == nullptr || !session->is_object()) {
+        return;
+    }
+    auto& s = session->as_object();
+    if (auto* cid = s.if_contains("cid"); cid && cid->is_string()) {
+        cid_ = cid->as_string().c_str();
+    }
+    if (auto* repos = s.if_contains("repos"); repos && repos->is_object()) {
+        auto* id = repos->as_object().if_contains(options_.repoOwner + "/" +
+                                                  options_.repoName);
+        if (id && id->is_string()) {
+            repo_id_ = id->as_string().c_str();
+        }
+    }
+    session_loaded_ = !cid_.empty();
+}
+
+void SimpleWalletClient::SaveSession() {
+    if (session_key_.empty() || cid_.empty()) {
+        return;
+    }
+    auto cache = ReadSessionCache(options_.sessionCachePath);
+    auto& session = cache[session_key_];
+    if (!session.is_object()) {
+        session = json::object{};
+    }
+    auto& s = session.as_object();
+    if (auto* cid = s.if_contains("cid");
+        cid == nullptr || !cid->is_string() || cid->as_string() != cid_) {
+        // contract has changed, repo ids are not valid anymore
+        s["repos"] = json::object{};
+    }
+    s["cid"] = cid_;
+    auto& repos = s["repos"];
+    if (!repos.is_object()) {
+        repos = json::object{};
+    }
+    if (!repo_id_.empty()) {
+        repos.as_object()[options_.repoOwner + "/" + options_.repoName] =
+            repo_id_;
+    }
+    WriteSessionCache(options_.sessionCachePath, cache);
+}
+
+void SimpleWalletClient::ResetSession() {
+    cid_.clear();
+    repo_id_.clear();
+    session_loaded_ = false;
+    session_validated_ = false;
+    if (session_key_.empty()) {
+        return;
+    }
+    auto cache = ReadSessionCache(options_.sessionCachePath);
+    if (cache.erase(session_key_) != 0) {
+        WriteSessionCache(options_.sessionCachePath, cache);
+    }
+}
+
+SimpleWalletClient::RequestId SimpleWalletClient::PostRequest(
+    std::string_view method, json::object&& params, AsyncHandler&& handler,
+    Timeout timeout, bool idempotent, size_t connection) {
+    auto id = next_id_++;
+    std::string metric;
+    if (metrics_.IsEnabled()) {
+        metric = GetMetricName(method, params);
+    }
+    json::object msg;
+    msg[JsonRpcHeader] = JsonRpcVersion;
+    msg["id"] = id;
+    msg["method"] = method;
+    msg["params"] = std::move(params);
+    auto message = json::serialize(msg);
+    if (IsHttpTransport()) {
+        http::request<http::string_body> req{http::verb::post,
+                                             options_.apiTarget, 11};
+        req.set(http::field::host, options_.apiHost);
+        req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+        req.set(http::field::content_type, "application/json");
+        req.keep_alive(true);
+        req.body() = std::move(message);
+        req.prepare_payload();
+        std::ostringstream os;
+        os << req;
+        message = os.str();
+    } else {
+        message.push_back('\n');
+    }
+
+    auto& request = pending_[id];
+    request.handler = std::move(handler);
+    request.message = std::make_shared<const std::string>(std::move(message));
+    request.idempotent = idempotent;
+    request.pinned_connection = connection;
+    if (metrics_.IsEnabled()) {
+        request.metric = std::move(metric);
+        request.started = Metrics::Clock::now();
+    }
+    if (timeout.count() > 0) {
+        request.timer = std::make_unique<net::steady_timer>(ioc_, timeout);
+        request.timer->async_wait([this, id](const beast::error_code& ec) {
+            if (!ec) {
+                CompleteRequest(id, net::error::timed_out, {});
+            }
+        });
+    }
+    Send(id);
+    return id;
+}
+
+void SimpleWalletClient::Send(RequestId id) {
+    auto it = pending_.find(id);
+    if (it == pending_.end()) {
+        return;
+    }
+    auto& request = it->second;
+    auto now = std::chrono::steady_clock::now();
+    size_t index = kNoConnection;
+    auto retry_after = std::chrono::steady_clock::time_point::max();
+    for (size_t i = 0; i < connections_.size(); ++i) {
+        if (request.pinned_connection != kNoConnection &&
+            request.pinned_connection != i) {
+            continue;
+        }
+        const auto& c = *connections_[i];
+        if (c.retry_after > now) {
+            retry_after = std::min(retry_after, c.retry_after);
+            continue;
+        }
+        if (index == kNoConnection ||
+            c.requests.size() < connections_[index]->requests.size()) {
+            index = i;
+        }
+    }
+    if (index == kNoConnection) {
+        // all connections are backing off, wait for the first of them
+        request.retry_timer =
+            std::make_unique<net::steady_timer>(ioc_, retry_after);
+        request.retry_timer->async_wait(
+            [this, id](const beast::error_code& ec) {
+                if (!ec) {
+                    Send(id);
+                }
+            });
+        return;
+    }
+
+    auto& connection = *connections_[index];
+    request.connection = index;
+    connection.requests.insert(id);
+    connection.write_queue.emplace_back(id, request.message);
+    if (!connection.connected) {
+        if (!connection.connecting) {
+            Connect(index);
+        }
+        return;
+    }
+    if (connection.write_queue.size() == 1) {
+        DoWrite(index);
+    }
+    if (!connection.reading) {
+        DoRead(index);
+    }
+}
+
+void SimpleWalletClient::Retry(RequestId id, const beast::error_code& ec,
+                               bool unsent) {
+    auto it = pending_.find(id);
+    if (it == pending_.end()) {
+        return;
+    }
+    auto& request = it->second;
+    request.connection = kNoConnection;
+    if ((!request.idempotent && !unsent) ||
+        ++request.attempts > kMaxRetries) {
+        CompleteRequest(id, ec, {});
+        return;
+    }
+    if (metrics_.IsEnabled()) {
+        metrics_.AddCounter("rpc.retries");
+    }
+    request.retry_timer = std::make_unique<net::steady_timer>(
+        ioc_, GetBackoff(request.attempts));
+    request.retry_timer->async_wait(
+        [this, id](const beast::error_code& error) {
+            if (!error) {
+                Send(id);
+            }
+        });
+}
+
+SimpleWalletClient::Timeout SimpleWalletClient::GetBackoff(size_t attempt) {
+    auto delay = kRetryDelay;
+    for (size_t i = 1; i < attempt && delay < kMaxRetryDelay; ++i) {
+        delay *= 2;
+    }
+    return std::min(delay, kMaxRetryDelay);
+}
+
+json::value SimpleWalletClient::CallAPI(std::string_view method,
+                                        json::object&& params,
+                                        bool idempotent, size_t connection) {
+    std::optional<json::value> response;
+    beast::error_code error;
+    PostRequest(
+        method, std::move(params),
+        [&](const beast::error_code& ec, json::value&& r) {
+            error = ec;
+            response = std::move(r);
+        },
+        {}, idempotent, connection);
+    RunUntil([&] {
+        return response.has_value();
+    });
+    if (error) {
+        throw beast::system_error(error);
     }
-    return ReadAPI();
+    return std::move(*response);
 }
 
-std::string SimpleWalletClient::ReadAPI() {
-    auto n = boost::asio::read_until(stream_,
-                                     boost::asio::dynamic_buffer(data_), '\n');
-    auto line = data_.substr(0, n);
-    data_.erase(0, n);
-    return line;
+void SimpleWalletClient::RunUntil(const std::function<bool()>& done) {
+    while (!done()) {
+        if (ioc_.stopped()) {
+            ioc_.restart();
+        }
+        if (ioc_.run_one() == 0) {
+            throw std::runtime_error("Wallet API: nothing to wait for");
+        }
+    }
+}
+
+void SimpleWalletClient::CompleteRequest(RequestId id,
+                                         const beast::error_code& ec,
+                                         json::value&& response) {
+    auto it = pending_.find(id);
+    if (it == pending_.end()) {
+        return;  // timed out or cancelled
+    }
+    if (it->second.connection != kNoConnection) {
+        connections_[it->second.connection]->requests.erase(id);
+    }
+    if (!it->second.metric.empty()) {
+        metrics_.AddLatency(it->second.metric,
+                            Metrics::Clock::now() - it->second.started);
+        if (ec) {
+            metrics_.AddCounter("rpc.errors");
+        }
+    }
+    auto handler = std::move(it->second.handler);
+    pending_.erase(it);
+    try {
+        handler(ec, std::move(response));
+    } catch (...) {
+        // the caller unwinds, its handlers must not be called later
+        FailPending(net::error::operation_aborted);
+        throw;
+    }
+}
+
+std::exception_ptr SimpleWalletClient::FailPending(
+    const beast::error_code& ec) {
+    auto pending = std::move(pending_);
+    pending_.clear();
+    for (auto& connection : connections_) {
+        connection->requests.clear();
+    }
+    std::exception_ptr error;
+    for (auto& [id, request] : pending) {
+        try {
+            request.handler(ec, {});
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    return error;
+}
+
+void SimpleWalletClient::OnConnectionError(size_t index,
+                                           const beast::error_code& ec) {
+    auto& connection = *connections_[index];
+    if (!connection.connected) {
+        return;  // already handled
+    }
+    beast::error_code ignored;
+    connection.stream.socket().close(ignored);
+    connection.connected = false;
+    connection.reading = false;
+    if (ec != http::error::end_of_stream) {
+        if (metrics_.IsEnabled()) {
+            metrics_.AddCounter("connection.failures");
+        }
+        ++connection.failures;
+        connection.retry_after =
+            std::chrono::steady_clock::now() + GetBackoff(connection.failures);
+    }
+
+    // the first queued request may be partially written, others are not
+    // sent at all and may be repeated
+    std::set<RequestId> unsent;
+    for (size_t i = 1; i < connection.write_queue.size(); ++i) {
+        unsent.insert(connection.write_queue[i].first);
+    }
+    connection.write_queue.clear();
+    connection.buffer.consume(connection.buffer.size());
+    auto requests = std::move(connection.requests);
+    connection.requests.clear();
+
+    std::exception_ptr error;
+    try {
+        for (auto id : requests) {
+            Retry(id, ec, unsent.count(id) != 0);
+        }
+        if (index == kEventsConnection && event_handler_) {
+            // the subscription is lost with the connection
+            PostRequest(
+                "ev_subunsub", {{"ev_txs_changed", true}},
+                [](const beast::error_code&, json::value&&) {
+                },
+                {}, true, kEventsConnection);
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void SimpleWalletClient::DoWrite(size_t index) {
+    auto& connection = *connections_[index];
+    net::async_write(
+        connection.stream,
+        net::buffer(*connection.write_queue.front().second),
+        [this, index, generation = connection.generation](
+            const beast::error_code& ec, size_t n) {
+            auto& connection = *connections_[index];
+            if (generation != connection.generation) {
+                return;
+            }
+            if (ec) {
+                OnConnectionError(index, ec);
+                return;
+            }
+            if (metrics_.IsEnabled()) {
+                metrics_.AddCounter("bytes_sent", n);
+            }
+            connection.write_queue.pop_front();
+            if (!connection.write_queue.empty()) {
+                DoWrite(index);
+            }
+        });
+}
+
+void SimpleWalletClient::DoRead(size_t index) {
+    auto& connection = *connections_[index];
+    connection.reading = true;
+    if (IsHttpTransport()) {
+        DoReadHttp(index);
+        return;
+    }
+    net::async_read_until(
+        connection.stream, connection.buffer, '\n',
+        [this, index, generation = connection.generation](
+            const beast::error_code& ec, size_t n) {
+            auto& connection = *connections_[index];
+            if (generation != connection.generation) {
+                return;
+            }
+            connection.reading = false;
+            if (ec) {
+                OnConnectionError(index, ec);
+                return;
+            }
+            if (metrics_.IsEnabled()) {
+                metrics_.AddCounter("bytes_received", n);
+            }
+            auto data = connection.buffer.data();
+            connection.parser.reset();
+            connection.parser.write(static_cast<const char*>(data.data()), n);
+            connection.buffer.consume(n);
+            connection.failures = 0;
+            // keep reading while somebody waits for messages
+            if (!connection.requests.empty() ||
+                (event_handler_ && index == kEventsConnection)) {
+                DoRead(index);
+            }
+            Dispatch(connection.parser.release());
+        });
+}
+
+void SimpleWalletClient::DoReadHttp(size_t index) {
+    auto& connection = *connections_[index];
+    connection.response.emplace();
+    // objects are sent in the response body, it may be large and chunked
+    connection.response->body_limit(boost::none);
+    http::async_read(
+        connection.stream, connection.buffer, *connection.response,
+        [this, index, generation = connection.generation](
+            const beast::error_code& ec, size_t n) {
+            auto& connection = *connections_[index];
+            if (generation != connection.generation) {
+                return;
+            }
+            connection.reading = false;
+            if (ec) {
+                OnConnectionError(index, ec);
+                return;
+            }
+            if (metrics_.IsEnabled()) {
+                metrics_.AddCounter("bytes_received", n);
+            }
+            auto& response = connection.response->get();
+            if (response.result() != http::status::ok) {
+                OnConnectionError(index, beast::errc::make_error_code(
+                                             beast::errc::protocol_error));
+                return;
+            }
+            const auto& body = response.body();
+            connection.parser.reset();
+            connection.parser.write(body.data(), body.size());
+            connection.failures = 0;
+            bool keep_alive = response.keep_alive();
+            connection.response.reset();
+            if (keep_alive && !connection.requests.empty()) {
+                DoRead(index);
+            }
+            Dispatch(connection.parser.release());
+            if (!keep_alive) {
+                // the server closes the connection, unanswered requests
+                // have to be resent
+                OnConnectionError(index, http::error::end_of_stream);
+            }
+        });
+}
+
+bool SimpleWalletClient::IsHttpTransport() const {
+    return options_.apiTransport == "http";
+}
+
+void SimpleWalletClient::Dispatch(json::value&& message) {
+    const auto* id = message.as_object().if_contains("id");
+    if (id == nullptr || !id->is_number()) {
+        if (event_handler_) {
+            event_handler_(message);
+        }
+        return;
+    }
+    CompleteRequest(id->to_number<RequestId>(), {}, std::move(message));
 }
 }  // namespace sourc3
@@ -2,11 +2,27 @@
 
 #include <boost/asio/connect.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
+#include <boost/json.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
 #include <set>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "metrics.h"
 #include "utils.h"
 
 namespace sourc3 {
@@ -28,18 +44,46 @@ public:
         std::string repoOwner;
         std::string repoName;
         std::string repoPath = ".";
+        std::string sessionCachePath;
         bool useIPFS = true;
+        bool verifyObjects = false;
+        size_t apiConnections = 4;
+        // "tcp" for newline delimited JSON-RPC, "http" to use apiTarget
+        std::string apiTransport = "tcp";
+        // "repo" for the per repo objects, "pack" to store every push
+        // batch as one pack or "shared" for the store shared by repos
+        std::string objectStorage = "repo";
+        // see Metrics, empty disables them
+        std::string metricsOutput;
     };
 
     SimpleWalletClient(const Options& options)
-        : resolver_(ioc_), stream_(ioc_), options_(options) {
+        : resolver_(ioc_), options_(options), metrics_(options.metricsOutput) {
+        if (options_.apiTransport != "tcp" && options_.apiTransport != "http") {
+            throw std::invalid_argument("Unknown wallet API transport: " +
+                                        options_.apiTransport);
+        }
+        if (options_.objectStorage != "shared" &&
+            options_.objectStorage != "pack" &&
+            options_.objectStorage != "repo") {
+            throw std::invalid_argument("Unknown object storage: " +
+                                        options_.objectStorage);
+        }
+        for (size_t i = 0; i < std::max<size_t>(options_.apiConnections, 1);
+             ++i) {
+            connections_.push_back(std::make_unique<Connection>(ioc_));
+        }
     }
 
     ~SimpleWalletClient() {
-        // Gracefully close the socket
-        if (connected_) {
+        // Gracefully close the sockets
+        for (auto& connection : connections_) {
+            if (!connection->connected) {
+                continue;
+            }
             beast::error_code ec;
-            stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+            connection->stream.socket().shutdown(tcp::socket::shutdown_both,
+                                                 ec);
 
             if (ec && ec != beast::errc::not_connected) {
                 // doesn't throw, simply report
@@ -49,46 +93,206 @@ public:
         }
     }
 
-    std::string InvokeWallet(std::string args) {
-        args.append(",repo_id=")
-            .append(GetRepoID())
-            .append(",cid=")
-            .append(GetCID());
-        return InvokeShader(std::move(args));
-    }
+    // Invokes a user action of the repo. The cached ids are trusted until
+    // a call with them fails, then they are checked and the call is
+    // repeated if they have changed
+    std::string InvokeWallet(std::string args);
 
     const std::string& GetRepoDir() const {
         return options_.repoPath;
     }
 
-    std::string LoadObjectFromIPFS(std::string&& hash);
-    std::string SaveObjectToIPFS(const uint8_t* data, size_t size);
+    const Options& GetOptions() const {
+        return options_;
+    }
+
+    Metrics& GetMetrics() {
+        return metrics_;
+    }
+
+    boost::json::value LoadObjectFromIPFS(std::string&& hash);
+    boost::json::value SaveObjectToIPFS(const uint8_t* data, size_t size);
+
+    using RequestId = uint64_t;
+    using Timeout = std::chrono::milliseconds;
+    using AsyncHandler =
+        std::function<void(const beast::error_code&, boost::json::value&&)>;
+    using AsyncInvokeHandler =
+        std::function<void(const beast::error_code&, std::string&&)>;
+
+    // Asynchronous calls, handlers are called from the io context. The error
+    // is net::error::timed_out if there is no response within the timeout
+    // (zero means no timeout) and net::error::operation_aborted if the
+    // request has been cancelled. Requests are spread over the connection
+    // pool, idempotent ones are resent if their connection is lost
+    RequestId AsyncInvokeShader(std::string args, AsyncInvokeHandler&& handler,
+                                Timeout timeout = {}, bool idempotent = false);
+    RequestId AsyncLoadObjectFromIPFS(std::string hash, AsyncHandler&& handler,
+                                      Timeout timeout = {});
+    RequestId AsyncSaveObjectToIPFS(const uint8_t* data, size_t size,
+                                    AsyncHandler&& handler,
+                                    Timeout timeout = {});
+    void Cancel(RequestId id);
+    void CancelAll();
+
+    net::io_context& GetContext() {
+        return ioc_;
+    }
+
+    using ResponseHandler = std::function<void(boost::json::value&&)>;
+    using InvokeHandler = std::function<void(std::string&&)>;
+
+    // Pipelined calls: the request is sent immediately and the handler is
+    // called from Wait() when the response arrives. Responses may come
+    // in any order, errors are thrown from Wait()
+    void PostInvokeWallet(std::string args, InvokeHandler&& handler,
+                          bool idempotent = false);
+    void PostLoadObjectFromIPFS(std::string&& hash, ResponseHandler&& handler);
+    void PostSaveObjectToIPFS(const uint8_t* data, size_t size,
+                              ResponseHandler&& handler);
+    // Runs the io context until all posted requests are completed
+    void Wait();
 
     using WaitFunc = std::function<void(size_t, const std::string&)>;
-    bool WaitForCompletion(WaitFunc&&);
+    // Waits for the transactions of the invoked actions. If stopOnFailure
+    // is false, the failed ones are recorded and the rest are waited for
+    bool WaitForCompletion(WaitFunc&&, bool stopOnFailure = true);
     size_t GetTransactionCount() const {
         return transactions_.size();
     }
 
+    // Id of the transaction of the last invoked action, empty if there was
+    // no transaction
+    const std::string& GetLastTransaction() const {
+        return last_transaction_;
+    }
+
+    // Failure reasons by transaction id
+    const std::map<std::string, std::string>& GetFailedTransactions() const {
+        return failed_transactions_;
+    }
+
 private:
-    std::string SubUnsubEvents(bool sub);
-    void EnsureConnected();
-    std::string ExtractResult(const std::string& response);
-    std::string InvokeShader(const std::string& args);
+    using EventHandler = std::function<void(const boost::json::value&)>;
+
+    static constexpr size_t kNoConnection = size_t(-1);
+    // events come over the connection which has subscribed to them
+    static constexpr size_t kEventsConnection = 0;
+    static constexpr size_t kMaxRetries = 5;
+    static constexpr Timeout kRetryDelay{100};
+    static constexpr Timeout kMaxRetryDelay{5000};
+    // HTTP has no events, transactions are polled
+    static constexpr Timeout kPollInterval{1000};
+
+    struct PendingRequest {
+        AsyncHandler handler;
+        std::unique_ptr<net::steady_timer> timer;
+        std::unique_ptr<net::steady_timer> retry_timer;
+        // kept to resend the request
+        std::shared_ptr<const std::string> message;
+        bool idempotent = false;
+        size_t attempts = 0;
+        size_t connection = kNoConnection;
+        size_t pinned_connection = kNoConnection;
+        // set if metrics are enabled
+        std::string metric;
+        Metrics::Clock::time_point started;
+    };
+
+    struct Connection {
+        explicit Connection(net::io_context& ioc) : stream(ioc) {
+        }
+
+        beast::tcp_stream stream;
+        // Lines are parsed in place, the buffer memory is reused
+        beast::flat_buffer buffer;
+        boost::json::parser parser;
+        std::optional<http::response_parser<http::string_body>> response;
+        std::deque<std::pair<RequestId, std::shared_ptr<const std::string>>>
+            write_queue;
+        // requests sent over this connection and not answered yet
+        std::set<RequestId> requests;
+        bool connected = false;
+        // the requests are queued while the connection is being established
+        bool connecting = false;
+        bool reading = false;
+        // completion handlers of the previous sockets are ignored
+        uint64_t generation = 0;
+        // health: consecutive failures, the connection is not used until
+        // the backoff delay expires
+        size_t failures = 0;
+        std::chrono::steady_clock::time_point retry_after;
+    };
+
+    void SubUnsubEvents(bool sub);
+    void PollTransactions(
+        const std::function<void(const std::string&,
+                                 const boost::json::object&)>& on_status,
+        const std::function<bool()>& done);
+    // Resolves the wallet address and connects asynchronously, the queued
+    // requests are written once the connection is established
+    void Connect(size_t index);
+    // The queued requests haven't been sent and are retried
+    void OnConnectFailed(size_t index, const beast::error_code& ec);
+    std::string ExtractResult(boost::json::value& response);
+    std::string InvokeShader(const std::string& args, bool idempotent = false);
     const std::string& GetCID();
     const std::string& GetRepoID();
-    std::string CallAPI(std::string&& request);
-    std::string ReadAPI();
+    std::string ResolveRepoID();
+    // Session cache keeps cid and repo id between helper runs
+    void LoadSession();
+    // Returns true if the session has been reset
+    bool ValidateSession();
+    // Validates the session if a call with the cached ids has failed
+    bool CheckSession();
+    void SaveSession();
+    void ResetSession();
+    RequestId PostRequest(std::string_view method,
+                          boost::json::object&& params, AsyncHandler&& handler,
+                          Timeout timeout, bool idempotent,
+                          size_t connection = kNoConnection);
+    boost::json::value CallAPI(std::string_view method,
+                               boost::json::object&& params,
+                               bool idempotent = false,
+                               size_t connection = kNoConnection);
+    // Sends the request over the least loaded healthy connection
+    void Send(RequestId id);
+    // Requests which haven't been sent can be resent even if they are not
+    // idempotent
+    void Retry(RequestId id, const beast::error_code& ec, bool unsent);
+    static Timeout GetBackoff(size_t attempt);
+    void RunUntil(const std::function<bool()>& done);
+    void CompleteRequest(RequestId id, const beast::error_code& ec,
+                         boost::json::value&& response);
+    // Calls all pending handlers with the error, returns the first exception
+    // thrown by them
+    std::exception_ptr FailPending(const beast::error_code& ec);
+    void OnConnectionError(size_t index, const beast::error_code& ec);
+    void DoWrite(size_t index);
+    void DoRead(size_t index);
+    void DoReadHttp(size_t index);
+    bool IsHttpTransport() const;
+    // Routes the message to the request handler by its id, messages
+    // without numeric id are events
+    void Dispatch(boost::json::value&& message);
 
 private:
     net::io_context ioc_;
     tcp::resolver resolver_;
-    beast::tcp_stream stream_;
-    bool connected_ = false;
+    std::vector<std::unique_ptr<Connection>> connections_;
     const Options& options_;
+    Metrics metrics_;
     std::string repo_id_;
     std::string cid_;
+    std::string session_key_;
+    bool session_loaded_ = false;
+    bool session_validated_ = false;
+    bool check_session_ = false;
     std::set<std::string> transactions_;
-    std::string data_;
+    std::string last_transaction_;
+    std::map<std::string, std::string> failed_transactions_;
+    RequestId next_id_ = 1;
+    std::map<RequestId, PendingRequest> pending_;
+    EventHandler event_handler_;
 };
 }  // namespace sourc3
@@ -8,6 +8,10 @@ namespace Env {  // NOLINT
 }  // namespace Env
 
 #include <algorithm>
+#include <array>
+#include <iterator>
+#include <map>
+#include <set>
 #include <vector>
 #include <utility>
 #include <string_view>
@@ -23,8 +27,6 @@ namespace sourc3 {
 
 namespace {
 using ActionFunc = void (*)(const ContractID&);
-using ActionsMap = std::vector<std::pair<std::string_view, ActionFunc>>;
-using RolesMap = std::vector<std::pair<std::string_view, const ActionsMap&>>;
 
 constexpr size_t kActionBufSize = 32;
 constexpr size_t kRoleBufSize = 16;
@@ -33,14 +35,6 @@ void OnError(const char* msg) {
     Env::DocAddText("error", msg);
 }
 
-template <typename T>
-auto FindIfContains(const std::string_view str,
-                    const std::vector<std::pair<std::string_view, T>>& v) {
-    return std::find_if(v.begin(), v.end(), [&str](const auto& p) {
-        return str == p.first;
-    });
-}
-
 const char kAdminSeed[] = "admin-sourc3";
 
 struct MyKeyID :public Env::KeyID {
@@ -49,12 +43,30 @@ struct MyKeyID :public Env::KeyID {
 
 // Add new SID here after changing contract.cpp
 const ShaderID kSid[] = {
-        sourc3::s_SID
+        sourc3::s_SID,
+        sourc3::s_SID_1
 };
 
 const Upgradable3::Manager::VerInfo kVerInfo = { kSid, _countof(kSid) };
 
+// s_SID repeats an older SID when contract_sid.i was not regenerated after
+// a change of contract.cpp, such a build must not deploy or upgrade
+bool SidsAreDistinct() {
+    for (size_t i = 0; i < _countof(kSid); ++i) {
+        for (size_t j = i + 1; j < _countof(kSid); ++j) {
+            if (Env::Memcmp(&kSid[i], &kSid[j], sizeof(ShaderID)) == 0) {
+                OnError("stale contract_sid.i, rebuild contract.wasm");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 void OnActionCreateContract(const ContractID& unused) {
+    if (!SidsAreDistinct()) {
+        return;
+    }
     MyKeyID kid;
     PubKey pk;
     kid.get_Pk(pk);
@@ -70,6 +82,9 @@ void OnActionCreateContract(const ContractID& unused) {
 void OnActionScheduleUpgrade(const ContractID& cid) {
     Height hTarget; // NOLINT
     Env::DocGetNum64("hTarget", &hTarget);
+    if (!SidsAreDistinct()) {
+        return;
+    }
 
     MyKeyID kid;
     Upgradable3::Manager::MultiSigRitual::Perform_ScheduleUpgrade(kVerInfo, cid, kid, hTarget);
@@ -141,6 +156,88 @@ private:
 };
 #pragma pack(pop)
 
+// Cursor pagination of the listings. A page has at most 'limit' records
+// starting from 'start_key', the contract key of the first one. If there are
+// more records, the key of the next one is returned as 'next' to request the
+// following page
+class Page {
+public:
+    static constexpr uint32_t kMaxLimit = 1000;
+    static constexpr uint32_t kMaxKeySize = 128;
+
+    Page() {
+        Env::DocGetNum32("limit", &limit_);
+        if (limit_ == 0 || limit_ > kMaxLimit) {
+            limit_ = kMaxLimit;
+        }
+    }
+
+    // Keys before the first key of the listing are ignored
+    template <typename Key>
+    Key GetStart(const Key& first) const {
+        static_assert(sizeof(Key) <= kMaxKeySize);
+        Key start = first;
+        if (Env::DocGetBlob("start_key", nullptr, 0) == sizeof(Key)) {
+            Env::DocGetBlob("start_key", &start, sizeof(start));
+            if (Env::Memcmp(&start, &first, sizeof(Key)) < 0) {
+                start = first;
+            }
+        }
+        return start;
+    }
+
+    // Counts the records stored under the key, returns false if they don't
+    // fit the page, the key becomes the cursor then
+    template <typename Key>
+    bool Add(const Key& key, uint32_t count = 1) {
+        static_assert(sizeof(Key) <= kMaxKeySize);
+        if (count_ != 0 && count_ + count > limit_) {
+            Env::Memcpy(next_, &key, sizeof(Key));
+            next_size_ = sizeof(Key);
+            return false;
+        }
+        count_ += count;
+        return true;
+    }
+
+    bool HasNext() const {
+        return next_size_ != 0;
+    }
+
+    // Returns true if the page starts from a key of this type, listings
+    // which scan several key ranges tell by it where to continue
+    template <typename Key>
+    static bool StartsFrom() {
+        return Env::DocGetBlob("start_key", nullptr, 0) == sizeof(Key);
+    }
+
+    // Called after the listing is closed
+    void AddNext() const {
+        if (HasNext()) {
+            Env::DocAddBlob("next", next_, next_size_);
+        }
+    }
+
+private:
+    uint32_t limit_ = 0;
+    uint32_t count_ = 0;
+    uint32_t next_size_ = 0;
+    uint8_t next_[kMaxKeySize];
+};
+
+// Returns the counters of the version without the index keys, zeros if the
+// contract was deployed with the indexes
+sourc3::LegacyState LoadLegacyState(const ContractID& cid) {
+    using sourc3::LegacyState;
+    Env::Key_T<LegacyState::Key> key;
+    key.m_Prefix.m_Cid = cid;
+    LegacyState legacy;
+    if (!Env::VarReader::Read_T(key, legacy)) {
+        _POD_(legacy).SetZero();
+    }
+    return legacy;
+}
+
 void OnActionCreateRepo(const ContractID& cid) {
     using sourc3::Project;
     using sourc3::Repo;
@@ -274,32 +371,74 @@ void OnActionListProjects(const ContractID& cid) {
     using sourc3::Project;
     using ProjectKey = Env::Key_T<Project::Key>;
 
+    Page page;
     ProjectKey start{.m_Prefix = {.m_Cid = cid},
-                     .m_KeyInContract = Project::Key{0}};
-    ProjectKey end = start;
-    end.m_KeyInContract.id = std::numeric_limits<uint64_t>::max();
+                     .m_KeyInContract = page.GetStart(Project::Key{0})};
+    ProjectKey end{.m_Prefix = {.m_Cid = cid},
+                   .m_KeyInContract =
+                       Project::Key{std::numeric_limits<uint64_t>::max()}};
 
     ProjectKey key = start;
-    Env::DocArray projects("projects");
-    uint32_t value_len = 0, key_len = sizeof(ProjectKey);
+    {
+        Env::DocArray projects("projects");
+        uint32_t value_len = 0, key_len = sizeof(ProjectKey);
+        for (Env::VarReader reader(start, end);
+             reader.MoveNext(&key, key_len, nullptr, value_len, 0) &&
+             page.Add(key.m_KeyInContract);) {
+            auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
+            reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
+            auto* value = reinterpret_cast<Project*>(buf.get());
+            Env::DocGroup project_object("");
+            Env::DocAddNum("project_tag", (uint32_t)key.m_KeyInContract.tag);
+            Env::DocAddNum("project_id", key.m_KeyInContract.id);
+            Env::DocAddNum("organization_id", value->organization_id);
+            Env::DocAddText("project_name", value->name);
+            Env::DocAddBlob_T("project_creator", value->creator);
+            value_len = 0;
+        }
+    }
+    page.AddNext();
+}
+
+// Looks up an organization or a project created before the name index by
+// scanning, it has no name key. Returns false if the owner has no such
+// object
+template <typename T>
+bool FindLegacyNamed(const ContractID& cid, typename T::Id legacy_end,
+                     const char* name, const PubKey& owner,
+                     typename T::Id& id) {
+    using Key = Env::Key_T<typename T::Key>;
+    if (legacy_end <= 1) {
+        return false;
+    }
+    Key start{.m_Prefix = {.m_Cid = cid},
+              .m_KeyInContract = typename T::Key{0}};
+    Key end = start;
+    end.m_KeyInContract.id = std::numeric_limits<typename T::Id>::max();
+
+    Key key = start;
+    uint32_t value_len = 0, key_len = sizeof(Key);
     for (Env::VarReader reader(start, end);
-         reader.MoveNext(&key, key_len, nullptr, value_len, 0);) {
+         reader.MoveNext(&key, key_len, nullptr, value_len, 0);
+         key_len = sizeof(Key), value_len = 0) {
+        if (key.m_KeyInContract.id >= legacy_end) {
+            continue;
+        }
         auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
         reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
-        auto* value = reinterpret_cast<Project*>(buf.get());
-        Env::DocGroup project_object("");
-        Env::DocAddNum("project_tag", (uint32_t)key.m_KeyInContract.tag);
-        Env::DocAddNum("project_id", key.m_KeyInContract.id);
-        Env::DocAddNum("organization_id", value->organization_id);
-        Env::DocAddText("project_name", value->name);
-        Env::DocAddBlob_T("project_creator", value->creator);
-        value_len = 0;
+        auto* value = reinterpret_cast<T*>(buf.get());
+        if (Env::Strcmp(value->name, name) == 0 &&
+            _POD_(value->creator) == owner) {  // NOLINT
+            id = key.m_KeyInContract.id;
+            return true;
+        }
     }
+    return false;
 }
 
 void OnActionProjectByName(const ContractID& cid) {
     using sourc3::Project;
-    using ProjectKey = Env::Key_T<Project::Key>;
+    using NameKey = Env::Key_T<Project::NameKey>;
 
     char name[Project::kMaxNameLen + 1];
     auto name_len = Env::DocGetText("name", name, sizeof(name));
@@ -311,31 +450,32 @@ void OnActionProjectByName(const ContractID& cid) {
         return OnError("'owner' required");
     }
 
-    ProjectKey start{.m_Prefix = {.m_Cid = cid},
-                     .m_KeyInContract = Project::Key{0}};
-    ProjectKey end = start;
-    end.m_KeyInContract.id = std::numeric_limits<uint64_t>::max();
-
-    ProjectKey key = start;
+    NameKey key{.m_KeyInContract = {owner,
+                                    sourc3::GetNameHash(name, name_len - 1)}};
+    key.m_Prefix.m_Cid = cid;
+    Project::Id project_id;
     Env::DocArray projects("projects");
-    uint32_t value_len = 0, key_len = sizeof(ProjectKey);
-    for (Env::VarReader reader(start, end);
-         reader.MoveNext(&key, key_len, nullptr, value_len, 0);) {
-        auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
-        reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
-        auto* value = reinterpret_cast<Project*>(buf.get());
+    if (!Env::VarReader::Read_T(key, project_id) &&
+        !FindLegacyNamed<Project>(cid, LoadLegacyState(cid).last_project_id,
+                                  name, owner, project_id)) {
+        return;
+    }
 
-        if (Env::Strcmp(value->name, name) == 0 &&
-            _POD_(value->creator) == owner) {  // NOLINT
-            Env::DocGroup project_object("");
-            Env::DocAddNum("project_tag", (uint32_t)key.m_KeyInContract.tag);
-            Env::DocAddNum("project_id", key.m_KeyInContract.id);
-            Env::DocAddNum("organization_id", value->organization_id);
-            Env::DocAddText("project_name", value->name);
-            Env::DocAddBlob_T("project_creator", value->creator);
-            return;
-        }
+    Env::Key_T<Project::Key> project_key{.m_KeyInContract =
+                                             Project::Key{project_id}};
+    project_key.m_Prefix.m_Cid = cid;
+    Project value;  // the name is known already
+    Env::VarReader reader(project_key, project_key);
+    uint32_t key_len = 0, value_len = sizeof(value);
+    if (!reader.MoveNext(nullptr, key_len, &value, value_len, 0)) {
+        return;
     }
+    Env::DocGroup project_object("");
+    Env::DocAddNum("project_tag", static_cast<uint32_t>(sourc3::kProject));
+    Env::DocAddNum("project_id", project_id);
+    Env::DocAddNum("organization_id", value.organization_id);
+    Env::DocAddText("project_name", name);
+    Env::DocAddBlob_T("project_creator", value.creator);
 }
 
 void OnActionListProjectMembers(const ContractID& cid) {
@@ -344,23 +484,30 @@ void OnActionListProjectMembers(const ContractID& cid) {
     using Member = Members<sourc3::kProjectMember, Project>;
     using MemberKey = Env::Key_T<Member::Key>;
 
-    MemberKey start{.m_Prefix = {.m_Cid = cid},
-                    .m_KeyInContract = Member::Key{PubKey{}, 0}};
-    if (!Env::DocGet("project_id", start.m_KeyInContract.id)) {
+    Project::Id project_id;
+    if (!Env::DocGet("project_id", project_id)) {
         return OnError("no 'project_id'");
     }
+    Page page;
+    MemberKey start{.m_Prefix = {.m_Cid = cid},
+                    .m_KeyInContract = Member::Key{PubKey{}, project_id}};
     _POD_(start.m_KeyInContract.user).SetZero();
     MemberKey end = start;
     _POD_(end.m_KeyInContract.user).SetObject(0xFF);
+    start.m_KeyInContract = page.GetStart(start.m_KeyInContract);
 
     MemberKey key = start;
-    Env::DocArray projects("members");
-    sourc3::UserInfo member;
-    for (Env::VarReader reader(start, end); reader.MoveNext_T(key, member);) {
-        Env::DocGroup member_object("");
-        Env::DocAddBlob_T("member", key.m_KeyInContract.user);
-        Env::DocAddNum32("permissions", member.permissions);
+    {
+        Env::DocArray projects("members");
+        sourc3::UserInfo member;
+        for (Env::VarReader reader(start, end);
+             reader.MoveNext_T(key, member) && page.Add(key.m_KeyInContract);) {
+            Env::DocGroup member_object("");
+            Env::DocAddBlob_T("member", key.m_KeyInContract.user);
+            Env::DocAddNum32("permissions", member.permissions);
+        }
     }
+    page.AddNext();
 }
 
 void OnActionModifyProject(const ContractID& cid) {
@@ -404,23 +551,110 @@ void OnActionModifyProject(const ContractID& cid) {
                         /*nCharge=*/0);
 }
 
+// Collects the members of an organization or a project. The user comes
+// first in the member keys, so all members of the tag are scanned
+template <sourc3::Tag Tg, typename T>
+std::vector<PubKey> CollectMembers(const ContractID& cid, typename T::Id id) {
+    using Member = sourc3::Members<Tg, T>;
+    using MemberKey = Env::Key_T<typename Member::Key>;
+    MemberKey start{.m_Prefix = {.m_Cid = cid},
+                    .m_KeyInContract = typename Member::Key{PubKey{}, id}};
+    _POD_(start.m_KeyInContract.user).SetZero();
+    MemberKey end = start;
+    _POD_(end.m_KeyInContract.user).SetObject(0xFF);
+
+    std::vector<PubKey> members;
+    MemberKey key = start;
+    sourc3::UserInfo member;
+    for (Env::VarReader reader(start, end); reader.MoveNext_T(key, member);) {
+        if (key.m_KeyInContract.id == id) {
+            members.push_back(key.m_KeyInContract.user);
+        }
+    }
+    return members;
+}
+
+// Builds the arguments of RemoveOrganizationWithMembers or
+// RemoveProjectWithMembers, the members follow the request
+template <typename Request>
+std::unique_ptr<uint8_t[]> MakeRemoveRequest(const Request& request,
+                                             const std::vector<PubKey>& members,
+                                             size_t& args_size) {
+    args_size = sizeof(Request) + members.size() * sizeof(PubKey);
+    auto buf = std::make_unique<uint8_t[]>(args_size);
+    auto* params = reinterpret_cast<Request*>(buf.get());
+    *params = request;
+    params->members_number = static_cast<uint32_t>(members.size());
+    if (!members.empty()) {
+        Env::Memcpy(params + 1, members.data(),
+                    members.size() * sizeof(PubKey));
+    }
+    return buf;
+}
+
+bool ProjectHasRepos(const ContractID& cid, sourc3::Project::Id project_id) {
+    using sourc3::Repo;
+    using IndexKey = Env::Key_T<Repo::ProjectKey>;
+    using RepoKey = Env::Key_T<Repo::Key>;
+    IndexKey start{.m_KeyInContract = {project_id, 0}};
+    IndexKey end{.m_KeyInContract = {project_id,
+                                     std::numeric_limits<Repo::Id>::max()}};
+    start.m_Prefix.m_Cid = cid;
+    end.m_Prefix.m_Cid = cid;
+    uint32_t key_len = 0, value_len = 0;
+    if (Env::VarReader(start, end).MoveNext(nullptr, key_len, nullptr,
+                                            value_len, 0)) {
+        return true;
+    }
+    // the repos created before the index
+    auto legacy = LoadLegacyState(cid);
+    if (legacy.last_repo_id <= 1) {
+        return false;
+    }
+    RepoKey repo_start{.m_KeyInContract = Repo::Key(1)};
+    RepoKey repo_end{.m_KeyInContract = Repo::Key(legacy.last_repo_id - 1)};
+    repo_start.m_Prefix.m_Cid = cid;
+    repo_end.m_Prefix.m_Cid = cid;
+    RepoKey key = repo_start;
+    Repo value;  // the name is not needed
+    key_len = sizeof(key);
+    value_len = sizeof(value);
+    for (Env::VarReader reader(repo_start, repo_end);
+         reader.MoveNext(&key, key_len, &value, value_len, 0);
+         key_len = sizeof(key), value_len = sizeof(value)) {
+        if (value.project_id == project_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void OnActionRemoveProject(const ContractID& cid) {
     using sourc3::Project;
-    using sourc3::method::RemoveProject;
+    using sourc3::method::RemoveProjectWithMembers;
 
-    RemoveProject request;
+    RemoveProjectWithMembers request;
     UserKey user_key(cid);
     user_key.Get(request.caller);
     if (!Env::DocGet("project_id", request.project_id)) {
         return OnError("'project_id' required");
     }
+    if (ProjectHasRepos(cid, request.project_id)) {
+        return OnError("the project has repos");
+    }
+    size_t args_size = 0;
+    auto args = MakeRemoveRequest(
+        request,
+        CollectMembers<sourc3::kProjectMember, Project>(cid,
+                                                        request.project_id),
+        args_size);
     SigRequest sig;
     user_key.FillSigRequest(sig);
 
     Env::GenerateKernel(/*pCid=*/&cid,
-                        /*iMethod=*/RemoveProject::kMethod,
-                        /*pArgs=*/&request,
-                        /*nArgs=*/sizeof(request),
+                        /*iMethod=*/RemoveProjectWithMembers::kMethod,
+                        /*pArgs=*/args.get(),
+                        /*nArgs=*/args_size,
                         /*pFunds=*/nullptr,
                         /*nFunds=*/0,
                         /*pSig=*/&sig,
@@ -429,42 +663,101 @@ void OnActionRemoveProject(const ContractID& cid) {
                         /*nCharge=*/0);
 }
 
+// Adds the repo to a new group of the current array
+void AddRepo(const sourc3::Repo& repo, bool details) {
+    Env::DocGroup repo_object("");
+    Env::DocAddNum("repo_id", repo.repo_id);
+    Env::DocAddText("repo_name", repo.name);
+    if (details) {
+        Env::DocAddNum("project_id", repo.project_id);
+        Env::DocAddNum64("cur_objects", repo.cur_objs_number);
+        Env::DocAddBlob_T("repo_owner", repo.owner);
+    }
+}
+
+void AddRepo(const ContractID& cid, sourc3::Repo::Id repo_id, bool details) {
+    using sourc3::Repo;
+    Env::Key_T<Repo::Key> key{.m_KeyInContract = Repo::Key(repo_id)};
+    key.m_Prefix.m_Cid = cid;
+    uint32_t value_len = 0, key_len = 0;
+    Env::VarReader reader(key, key);
+    if (!reader.MoveNext(nullptr, key_len, nullptr, value_len, 0)) {
+        return;
+    }
+    auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
+    reader.MoveNext(nullptr, key_len, buf.get(), value_len, 1);
+    AddRepo(*reinterpret_cast<Repo*>(buf.get()), details);
+}
+
+// Lists the repos created before the index which match the filter, they
+// have no index keys. The page counts the scanned repos, it may list fewer.
+// Returns false if the page is full, the index listing follows otherwise
+template <typename IndexKey, typename Filter>
+bool ListLegacyRepos(const ContractID& cid, Page& page, bool details,
+                     Filter&& filter) {
+    using sourc3::Repo;
+    using RepoKey = Env::Key_T<Repo::Key>;
+    auto legacy = LoadLegacyState(cid);
+    if (legacy.last_repo_id <= 1 || Page::StartsFrom<IndexKey>()) {
+        return true;
+    }
+    RepoKey start{.m_KeyInContract = page.GetStart(Repo::Key(1))};
+    RepoKey end{.m_KeyInContract = Repo::Key(legacy.last_repo_id - 1)};
+    start.m_Prefix.m_Cid = cid;
+    end.m_Prefix.m_Cid = cid;
+
+    RepoKey key = start;
+    uint32_t value_len = 0, key_len = sizeof(RepoKey);
+    for (Env::VarReader reader(start, end);
+         reader.MoveNext(&key, key_len, nullptr, value_len, 0);
+         key_len = sizeof(RepoKey), value_len = 0) {
+        if (!page.Add(key.m_KeyInContract)) {
+            return false;
+        }
+        auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
+        reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
+        const auto& repo = *reinterpret_cast<Repo*>(buf.get());
+        if (filter(repo)) {
+            AddRepo(repo, details);
+        }
+    }
+    return true;
+}
+
 void OnActionListProjectRepos(const ContractID& cid) {
     using sourc3::Project;
     using sourc3::Repo;
-    using RepoKey = Env::Key_T<Repo::Key>;
+    using IndexKey = Env::Key_T<Repo::ProjectKey>;
 
     Project::Id project_id;
     if (!Env::DocGet("project_id", project_id)) {
         return OnError("'project_id' required");
     }
 
-    RepoKey start, end;
-    _POD_(start.m_Prefix.m_Cid) = cid;
-    _POD_(end) = start;
-    end.m_KeyInContract.repo_id = std::numeric_limits<uint64_t>::max();
+    Page page;
+    IndexKey start{.m_KeyInContract = page.GetStart(
+                       Repo::ProjectKey{project_id, 0})};
+    IndexKey end{.m_KeyInContract = {project_id,
+                                     std::numeric_limits<Repo::Id>::max()}};
+    start.m_Prefix.m_Cid = cid;
+    end.m_Prefix.m_Cid = cid;
 
-    RepoKey key;
-    PubKey my_key;
-    UserKey user_key(cid);
-    user_key.Get(my_key);
-    Env::DocArray repos("repos");
-    uint32_t value_len = 0, key_len = sizeof(RepoKey);
-    for (Env::VarReader reader(start, end);
-         reader.MoveNext(&key, key_len, nullptr, value_len, 0);) {
-        auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
-        reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
-        auto* value = reinterpret_cast<Repo*>(buf.get());
-        if (value->project_id == project_id) {
-            Env::DocGroup repo_object("");
-            Env::DocAddNum("repo_id", value->repo_id);
-            Env::DocAddText("repo_name", value->name);
-            Env::DocAddNum("project_id", value->project_id);
-            Env::DocAddNum64("cur_objects", value->cur_objs_number);
-            Env::DocAddBlob_T("repo_owner", value->owner);
-            value_len = 0;
+    IndexKey key = start;
+    Repo::Id repo_id;
+    {
+        Env::DocArray repos("repos");
+        if (ListLegacyRepos<Repo::ProjectKey>(
+                cid, page, /*details=*/true, [&](const Repo& repo) {
+                    return repo.project_id == project_id;
+                })) {
+            for (Env::VarReader reader(start, end);
+                 reader.MoveNext_T(key, repo_id) &&
+                 page.Add(key.m_KeyInContract);) {
+                AddRepo(cid, repo_id, /*details=*/true);
+            }
         }
     }
+    page.AddNext();
 }
 
 void OnActionCreateOrganization(const ContractID& cid) {
@@ -504,31 +797,40 @@ void OnActionListOrganizations(const ContractID& cid) {
     using sourc3::Organization;
     using OrganizationKey = Env::Key_T<Organization::Key>;
 
+    Page page;
     OrganizationKey start{.m_Prefix = {.m_Cid = cid},
-                          .m_KeyInContract = Organization::Key{0}};
-    auto end = start;
-    end.m_KeyInContract.id = std::numeric_limits<uint64_t>::max();
+                          .m_KeyInContract =
+                              page.GetStart(Organization::Key{0})};
+    OrganizationKey end{
+        .m_Prefix = {.m_Cid = cid},
+        .m_KeyInContract =
+            Organization::Key{std::numeric_limits<uint64_t>::max()}};
 
     OrganizationKey key = start;
-    Env::DocArray organizations("organizations");
-    uint32_t value_len = 0, key_len = sizeof(OrganizationKey);
-    for (Env::VarReader reader(start, end);
-         reader.MoveNext(&key, key_len, nullptr, value_len, 0);) {
-        auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
-        reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
-        auto* value = reinterpret_cast<Organization*>(buf.get());
-        Env::DocGroup org_object("");
-        Env::DocAddNum("organization_tag", (uint32_t)key.m_KeyInContract.tag);
-        Env::DocAddNum("organization_id", key.m_KeyInContract.id);
-        Env::DocAddText("organization_name", value->name);
-        Env::DocAddBlob_T("organization_creator", value->creator);
-        value_len = 0;
+    {
+        Env::DocArray organizations("organizations");
+        uint32_t value_len = 0, key_len = sizeof(OrganizationKey);
+        for (Env::VarReader reader(start, end);
+             reader.MoveNext(&key, key_len, nullptr, value_len, 0) &&
+             page.Add(key.m_KeyInContract);) {
+            auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
+            reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
+            auto* value = reinterpret_cast<Organization*>(buf.get());
+            Env::DocGroup org_object("");
+            Env::DocAddNum("organization_tag",
+                           (uint32_t)key.m_KeyInContract.tag);
+            Env::DocAddNum("organization_id", key.m_KeyInContract.id);
+            Env::DocAddText("organization_name", value->name);
+            Env::DocAddBlob_T("organization_creator", value->creator);
+            value_len = 0;
+        }
     }
+    page.AddNext();
 }
 
 void OnActionOrganizationByName(const ContractID& cid) {
     using sourc3::Organization;
-    using OrganizationKey = Env::Key_T<Organization::Key>;
+    using NameKey = Env::Key_T<Organization::NameKey>;
 
     char name[Organization::kMaxNameLen + 1];
     auto name_len = Env::DocGetText("name", name, sizeof(name));
@@ -540,29 +842,21 @@ void OnActionOrganizationByName(const ContractID& cid) {
         return OnError("'owner' required");
     }
 
-    OrganizationKey start{.m_Prefix = {.m_Cid = cid},
-                          .m_KeyInContract = Organization::Key{0}};
-    auto end = start;
-    end.m_KeyInContract.id = std::numeric_limits<uint64_t>::max();
-
-    OrganizationKey key = start;
+    NameKey key{.m_KeyInContract = {owner,
+                                    sourc3::GetNameHash(name, name_len - 1)}};
+    key.m_Prefix.m_Cid = cid;
+    Organization::Id organization_id;
     Env::DocArray organizations("organizations");
-    uint32_t value_len = 0, key_len = sizeof(OrganizationKey);
-    for (Env::VarReader reader(start, end);
-         reader.MoveNext(&key, key_len, nullptr, value_len, 0);) {
-        auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
-        reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
-        auto* value = reinterpret_cast<Organization*>(buf.get());
-        if (Env::Strcmp(value->name, name) == 0 &&
-            _POD_(value->creator) == owner) {  // NOLINT
-            Env::DocGroup org_object("");
-            Env::DocAddNum("organization_tag",
-                           (uint32_t)key.m_KeyInContract.tag);
-            Env::DocAddNum("organization_id", key.m_KeyInContract.id);
-            Env::DocAddText("organization_name", value->name);
-            Env::DocAddBlob_T("organization_creator", value->creator);
-            return;
-        }
+    if (Env::VarReader::Read_T(key, organization_id) ||
+        FindLegacyNamed<Organization>(
+            cid, LoadLegacyState(cid).last_organization_id, name, owner,
+            organization_id)) {
+        Env::DocGroup org_object("");
+        Env::DocAddNum("organization_tag",
+                       static_cast<uint32_t>(sourc3::kOrganization));
+        Env::DocAddNum("organization_id", organization_id);
+        Env::DocAddText("organization_name", name);
+        Env::DocAddBlob_T("organization_creator", owner);
     }
 }
 
@@ -571,34 +865,42 @@ void OnActionListOrganizationProjects(const ContractID& cid) {
     using sourc3::Project;
     using ProjectKey = Env::Key_T<Project::Key>;
 
-    ProjectKey start{.m_Prefix = {.m_Cid = cid},
-                     .m_KeyInContract = Project::Key{0}};
-    ProjectKey end = start;
-    end.m_KeyInContract.id = std::numeric_limits<uint64_t>::max();
-
     Organization::Id org_id;
     if (!Env::DocGet("organization_id", org_id)) {
         return OnError("no 'organization_id'");
     }
 
+    // the page counts the scanned projects, it may list fewer
+    Page page;
+    ProjectKey start{.m_Prefix = {.m_Cid = cid},
+                     .m_KeyInContract = page.GetStart(Project::Key{0})};
+    ProjectKey end{.m_Prefix = {.m_Cid = cid},
+                   .m_KeyInContract =
+                       Project::Key{std::numeric_limits<uint64_t>::max()}};
+
     ProjectKey key = start;
-    Env::DocArray projects("projects");
-    uint32_t value_len = 0, key_len = sizeof(ProjectKey);
-    for (Env::VarReader reader(start, end);
-         reader.MoveNext(&key, key_len, nullptr, value_len, 0);) {
-        auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
-        reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
-        auto* value = reinterpret_cast<Project*>(buf.get());
-        if (value->organization_id == org_id) {
-            Env::DocGroup project_object("");
-            Env::DocAddNum("project_tag", (uint32_t)key.m_KeyInContract.tag);
-            Env::DocAddNum("project_id", key.m_KeyInContract.id);
-            Env::DocAddNum("organization_id", value->organization_id);
-            Env::DocAddText("project_name", value->name);
-            Env::DocAddBlob_T("project_creator", value->creator);
+    {
+        Env::DocArray projects("projects");
+        uint32_t value_len = 0, key_len = sizeof(ProjectKey);
+        for (Env::VarReader reader(start, end);
+             reader.MoveNext(&key, key_len, nullptr, value_len, 0) &&
+             page.Add(key.m_KeyInContract);) {
+            auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
+            reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
+            auto* value = reinterpret_cast<Project*>(buf.get());
+            if (value->organization_id == org_id) {
+                Env::DocGroup project_object("");
+                Env::DocAddNum("project_tag",
+                               (uint32_t)key.m_KeyInContract.tag);
+                Env::DocAddNum("project_id", key.m_KeyInContract.id);
+                Env::DocAddNum("organization_id", value->organization_id);
+                Env::DocAddText("project_name", value->name);
+                Env::DocAddBlob_T("project_creator", value->creator);
+            }
+            value_len = 0;
         }
-        value_len = 0;
     }
+    page.AddNext();
 }
 
 void OnActionListOrganizationMembers(const ContractID& cid) {
@@ -607,23 +909,30 @@ void OnActionListOrganizationMembers(const ContractID& cid) {
     using Member = Members<sourc3::kOrganizationMember, Organization>;
     using MemberKey = Env::Key_T<Member::Key>;
 
-    MemberKey start{.m_Prefix = {.m_Cid = cid},
-                    .m_KeyInContract = Member::Key{PubKey{}, 0}};
-    if (!Env::DocGet("organization_id", start.m_KeyInContract.id)) {
+    Organization::Id org_id;
+    if (!Env::DocGet("organization_id", org_id)) {
         return OnError("no 'organization_id'");
     }
+    Page page;
+    MemberKey start{.m_Prefix = {.m_Cid = cid},
+                    .m_KeyInContract = Member::Key{PubKey{}, org_id}};
     _POD_(start.m_KeyInContract.user).SetZero();
     MemberKey end = start;
     _POD_(end.m_KeyInContract.user).SetObject(0xFF);
+    start.m_KeyInContract = page.GetStart(start.m_KeyInContract);
 
     MemberKey key = start;
-    Env::DocArray members("members");
-    sourc3::UserInfo member;
-    for (Env::VarReader reader(start, end); reader.MoveNext_T(key, member);) {
-        Env::DocGroup member_object("");
-        Env::DocAddBlob_T("member", key.m_KeyInContract.user);
-        Env::DocAddNum32("permissions", member.permissions);
+    {
+        Env::DocArray members("members");
+        sourc3::UserInfo member;
+        for (Env::VarReader reader(start, end);
+             reader.MoveNext_T(key, member) && page.Add(key.m_KeyInContract);) {
+            Env::DocGroup member_object("");
+            Env::DocAddBlob_T("member", key.m_KeyInContract.user);
+            Env::DocAddNum32("permissions", member.permissions);
+        }
     }
+    page.AddNext();
 }
 
 void OnActionModifyOrganization(const ContractID& cid) {
@@ -663,24 +972,55 @@ void OnActionModifyOrganization(const ContractID& cid) {
                         /*nCharge=*/0);
 }
 
+bool OrganizationHasProjects(const ContractID& cid,
+                             sourc3::Organization::Id org_id) {
+    using sourc3::Project;
+    using ProjectKey = Env::Key_T<Project::Key>;
+    ProjectKey start{.m_Prefix = {.m_Cid = cid},
+                     .m_KeyInContract = Project::Key{0}};
+    ProjectKey end{.m_Prefix = {.m_Cid = cid},
+                   .m_KeyInContract =
+                       Project::Key{std::numeric_limits<uint64_t>::max()}};
+    ProjectKey key = start;
+    Project value;  // the name is not needed
+    uint32_t key_len = sizeof(key), value_len = sizeof(value);
+    for (Env::VarReader reader(start, end);
+         reader.MoveNext(&key, key_len, &value, value_len, 0);
+         key_len = sizeof(key), value_len = sizeof(value)) {
+        if (value.organization_id == org_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void OnActionRemoveOrganization(const ContractID& cid) {
     using sourc3::Organization;
-    using sourc3::method::RemoveOrganization;
+    using sourc3::method::RemoveOrganizationWithMembers;
 
-    RemoveOrganization request;
+    RemoveOrganizationWithMembers request;
     UserKey user_key(cid);
     user_key.Get(request.caller);
     if (!Env::DocGet("organization_id", request.id)) {
         return OnError("'organization_id' required");
     }
+    if (OrganizationHasProjects(cid, request.id)) {
+        return OnError("the organization has projects");
+    }
+    size_t args_size = 0;
+    auto args = MakeRemoveRequest(
+        request,
+        CollectMembers<sourc3::kOrganizationMember, Organization>(cid,
+                                                                  request.id),
+        args_size);
 
     SigRequest sig;
     user_key.FillSigRequest(sig);
 
     Env::GenerateKernel(/*pCid=*/&cid,
-                        /*iMethod=*/RemoveOrganization::kMethod,
-                        /*pArgs=*/&request,
-                        /*nArgs=*/sizeof(request),
+                        /*iMethod=*/RemoveOrganizationWithMembers::kMethod,
+                        /*pArgs=*/args.get(),
+                        /*nArgs=*/args_size,
                         /*pFunds=*/nullptr,
                         /*nFunds=*/0,
                         /*pSig=*/&sig,
@@ -907,59 +1247,67 @@ void OnActionRemoveOrganizationMember(const ContractID& cid) {
 
 void OnActionMyRepos(const ContractID& cid) {
     using sourc3::Repo;
-    using RepoKey = Env::Key_T<Repo::Key>;
-    RepoKey start, end;
-    _POD_(start.m_Prefix.m_Cid) = cid;
-    _POD_(end) = start;
-    end.m_KeyInContract.repo_id = std::numeric_limits<uint64_t>::max();
+    using IndexKey = Env::Key_T<Repo::OwnerKey>;
 
-    RepoKey key;
     PubKey my_key;
     UserKey user_key(cid);
     user_key.Get(my_key);
-    Env::DocArray repos("repos");
-    uint32_t value_len = 0, key_len = sizeof(RepoKey);
-    for (Env::VarReader reader(start, end);
-         reader.MoveNext(&key, key_len, nullptr, value_len, 0);) {
-        auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
-        reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
-        auto* value = reinterpret_cast<Repo*>(buf.get());
-        if ((_POD_(value->owner) == my_key) != 0u) {
-            Env::DocGroup repo_object("");
-            Env::DocAddNum("repo_id", value->repo_id);
-            Env::DocAddText("repo_name", value->name);
-        }
-        value_len = 0;
-    }
-}
 
-void OnActionAllRepos(const ContractID& cid) {
-    using sourc3::Repo;
-    using RepoKey = Env::Key_T<Repo::Key>;
-    RepoKey start, end;
+    Page page;
+    IndexKey start{.m_KeyInContract = page.GetStart(Repo::OwnerKey{my_key, 0})};
+    IndexKey end{.m_KeyInContract = {my_key,
+                                     std::numeric_limits<Repo::Id>::max()}};
+    start.m_Prefix.m_Cid = cid;
+    end.m_Prefix.m_Cid = cid;
+
+    IndexKey key = start;
+    Repo::Id repo_id;
+    {
+        Env::DocArray repos("repos");
+        if (ListLegacyRepos<Repo::OwnerKey>(
+                cid, page, /*details=*/false, [&](const Repo& repo) {
+                    return _POD_(repo.owner) == my_key;  // NOLINT
+                })) {
+            for (Env::VarReader reader(start, end);
+                 reader.MoveNext_T(key, repo_id) &&
+                 page.Add(key.m_KeyInContract);) {
+                AddRepo(cid, repo_id, /*details=*/false);
+            }
+        }
+    }
+    page.AddNext();
+}
+
+void OnActionAllRepos(const ContractID& cid) {
+    using sourc3::Repo;
+    using RepoKey = Env::Key_T<Repo::Key>;
+    Page page;
+    RepoKey start{.m_KeyInContract = page.GetStart(Repo::Key())};
+    RepoKey end{.m_KeyInContract = Repo::Key()};
     _POD_(start.m_Prefix.m_Cid) = cid;
-    _POD_(end) = start;
+    _POD_(end.m_Prefix.m_Cid) = cid;
     end.m_KeyInContract.repo_id = std::numeric_limits<uint64_t>::max();
 
     RepoKey key;
-    PubKey my_key;
-    UserKey user_key(cid);
-    user_key.Get(my_key);
-    Env::DocArray repos("repos");
-    uint32_t value_len = 0, key_len = sizeof(RepoKey);
-    for (Env::VarReader reader(start, end);
-         reader.MoveNext(&key, key_len, nullptr, value_len, 0);) {
-        auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
-        reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
-        auto* value = reinterpret_cast<Repo*>(buf.get());
-        Env::DocGroup repo_object("");
-        Env::DocAddNum("repo_id", value->repo_id);
-        Env::DocAddText("repo_name", value->name);
-        Env::DocAddNum("project_id", value->project_id);
-        Env::DocAddNum64("cur_objects", value->cur_objs_number);
-        Env::DocAddBlob_T("repo_owner", value->owner);
-        value_len = 0;
+    {
+        Env::DocArray repos("repos");
+        uint32_t value_len = 0, key_len = sizeof(RepoKey);
+        for (Env::VarReader reader(start, end);
+             reader.MoveNext(&key, key_len, nullptr, value_len, 0) &&
+             page.Add(key.m_KeyInContract);) {
+            auto buf = std::make_unique<uint8_t[]>(value_len + 1);  // 0-term
+            reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
+            auto* value = reinterpret_cast<Repo*>(buf.get());
+            Env::DocGroup repo_object("");
+            Env::DocAddNum("repo_id", value->repo_id);
+            Env::DocAddText("repo_name", value->name);
+            Env::DocAddNum("project_id", value->project_id);
+            Env::DocAddNum64("cur_objects", value->cur_objs_number);
+            Env::DocAddBlob_T("repo_owner", value->owner);
+            value_len = 0;
+        }
     }
+    page.AddNext();
 }
 
 void OnActionDeleteRepo(const ContractID& cid) {
@@ -1078,6 +1426,224 @@ void OnActionRemoveUserParams(const ContractID& cid) {
                         /*nCharge=*/0);
 }
 
+template <typename Key>
+bool GetVarSize(const ContractID& cid, const Key& key_in_contract,
+                uint32_t& value_len) {
+    Env::Key_T<Key> key{.m_KeyInContract = key_in_contract};
+    key.m_Prefix.m_Cid = cid;
+    uint32_t key_len = 0;
+    value_len = 0;
+    Env::VarReader reader(key, key);
+    return reader.MoveNext(nullptr, key_len, nullptr, value_len, 0);
+}
+
+template <typename Key>
+std::unique_ptr<uint8_t[]> ReadVar(const ContractID& cid,
+                                   const Key& key_in_contract,
+                                   uint32_t& value_len) {
+    Env::Key_T<Key> key{.m_KeyInContract = key_in_contract};
+    key.m_Prefix.m_Cid = cid;
+    uint32_t key_len = 0;
+    value_len = 0;
+    Env::VarReader reader(key, key);
+    if (!reader.MoveNext(nullptr, key_len, nullptr, value_len, 0)) {
+        return nullptr;
+    }
+    auto buf = std::make_unique<uint8_t[]>(value_len);
+    reader.MoveNext(nullptr, key_len, buf.get(), value_len, 1);
+    return buf;
+}
+
+template <typename Key>
+bool VarExists(const ContractID& cid, const Key& key_in_contract) {
+    uint32_t value_len = 0;
+    return GetVarSize(cid, key_in_contract, value_len);
+}
+
+// Returns false if the object isn't packed. The slots of the bucket tell
+// the packs which may have it, their indexes are read up to the entry
+bool FindPackedObject(const ContractID& cid, sourc3::Repo::Id repo_id,
+                      const sourc3::GitOid& hash,
+                      sourc3::Pack::Location& location) {
+    using sourc3::Pack;
+    uint32_t bucket_size = 0;
+    auto bucket = ReadVar(cid, Pack::BucketKey(repo_id, hash), bucket_size);
+    if (bucket == nullptr) {
+        return false;
+    }
+    const auto* slots = reinterpret_cast<const Pack::Slot*>(bucket.get());
+    uint32_t count = bucket_size / sizeof(Pack::Slot);
+    for (auto i = Pack::FindSlot(slots, count, hash);
+         i < count && Pack::CompareSlot(slots[i], hash) == 0; ++i) {
+        const auto& slot = slots[i];
+        Env::Key_T<Pack::IndexKey> key{
+            .m_KeyInContract = Pack::IndexKey(repo_id, slot.first_id)};
+        key.m_Prefix.m_Cid = cid;
+        uint32_t end = sizeof(Pack::Entry) * (slot.entry + 1);
+        auto index = std::make_unique<Pack::Entry[]>(slot.entry + 1);
+        uint32_t key_len = 0, index_size = end;
+        Env::VarReader reader(key, key);
+        if (!reader.MoveNext(nullptr, key_len, index.get(), index_size, 0) ||
+            index_size < end ||
+            Env::Memcmp(&index[slot.entry].hash, &hash, sizeof(hash)) != 0) {
+            continue;
+        }
+        location.first_id = slot.first_id;
+        location.offset = 0;
+        for (uint32_t j = 0; j < slot.entry; ++j) {
+            location.offset += index[j].data_size;
+        }
+        location.data_size = index[slot.entry].data_size;
+        return true;
+    }
+    return false;
+}
+
+bool ObjectDataExists(const ContractID& cid, sourc3::Repo::Id repo_id,
+                      const sourc3::GitOid& hash) {
+    using sourc3::GitObject;
+    sourc3::Pack::Location location;
+    return VarExists(cid, GitObject::Data::Key(repo_id, hash)) ||
+           VarExists(cid, GitObject::Shared::MemberKey(repo_id, hash)) ||
+           VarExists(cid, GitObject::Chunked::MarkerKey(repo_id, hash)) ||
+           FindPackedObject(cid, repo_id, hash, location);
+}
+
+// Returns the number of chunks of a complete chunked object, 0 if the
+// object isn't chunked
+uint32_t GetChunksNumber(const ContractID& cid, sourc3::Repo::Id repo_id,
+                         const sourc3::GitOid& hash) {
+    using MarkerKey = sourc3::GitObject::Chunked::MarkerKey;
+    Env::Key_T<MarkerKey> key{.m_KeyInContract = MarkerKey(repo_id, hash)};
+    key.m_Prefix.m_Cid = cid;
+    uint32_t chunks_number = 0;
+    Env::VarReader::Read_T(key, chunks_number);
+    return chunks_number;
+}
+
+// Returns true if the shared store keeps the same bytes under the oid
+bool SharedDataMatches(const ContractID& cid, const sourc3::GitOid& hash,
+                       const void* data, uint32_t data_size) {
+    using sourc3::GitObject;
+    uint32_t value_len = 0;
+    auto buf = ReadVar(cid, GitObject::Shared::DataKey(hash), value_len);
+    return buf != nullptr && value_len == data_size &&
+           Env::Memcmp(buf.get(), data, data_size) == 0;
+}
+
+// Converts the pushed objects for the shared store. The data is always
+// sent, the contract checks it against the stored copy. Counts the objects
+// which will reference the data of the shared store
+std::unique_ptr<uint8_t[]> MakeSharedPush(
+    const ContractID& cid, const sourc3::method::PushObjects& params,
+    size_t& args_size, uint32_t& shared) {
+    using sourc3::method::PushObjects;
+    using sourc3::method::PushSharedObjects;
+    args_size = sizeof(PushSharedObjects);
+    shared = 0;
+    auto* obj = reinterpret_cast<const PushObjects::PackedObject*>(&params + 1);
+    for (uint32_t i = 0; i < params.objects_number; ++i) {
+        args_size += sizeof(PushSharedObjects::PackedObject) + obj->data_size;
+        obj = reinterpret_cast<const PushObjects::PackedObject*>(
+            reinterpret_cast<const uint8_t*>(obj + 1) + obj->data_size);
+    }
+
+    auto buf = std::make_unique<uint8_t[]>(args_size);
+    auto* shared_params = reinterpret_cast<PushSharedObjects*>(buf.get());
+    shared_params->repo_id = params.repo_id;
+    shared_params->user = params.user;
+    shared_params->objects_number = params.objects_number;
+    auto* dst =
+        reinterpret_cast<PushSharedObjects::PackedObject*>(shared_params + 1);
+    obj = reinterpret_cast<const PushObjects::PackedObject*>(&params + 1);
+    for (uint32_t i = 0; i < params.objects_number; ++i) {
+        dst->type = obj->type;
+        dst->hash = obj->hash;
+        dst->data_size = obj->data_size;
+        dst->has_data = 1;
+        if (SharedDataMatches(cid, obj->hash, obj + 1, obj->data_size)) {
+            ++shared;
+        }
+        auto* data = reinterpret_cast<uint8_t*>(dst + 1);
+        Env::Memcpy(data, obj + 1, obj->data_size);
+        dst = reinterpret_cast<PushSharedObjects::PackedObject*>(
+            data + obj->data_size);
+        obj = reinterpret_cast<const PushObjects::PackedObject*>(
+            reinterpret_cast<const uint8_t*>(obj + 1) + obj->data_size);
+    }
+    return buf;
+}
+
+// Calls handler(index_key, index, count) for the packs of the repo starting
+// from the start key until it returns true
+template <typename Handler>
+bool ForEachPack(const ContractID& cid, const sourc3::Pack::IndexKey& start,
+                 Handler&& handler) {
+    using sourc3::GitObject;
+    using sourc3::Pack;
+    using IndexKey = Env::Key_T<Pack::IndexKey>;
+    auto repo_id = Utils::FromBE(start.repo_id);
+    IndexKey begin{.m_KeyInContract = start};
+    IndexKey end{.m_KeyInContract = {
+                     repo_id, std::numeric_limits<GitObject::Id>::max()}};
+    begin.m_Prefix.m_Cid = cid;
+    end.m_Prefix.m_Cid = cid;
+    IndexKey key = begin;
+    uint32_t key_len = sizeof(key), value_len = 0;
+    for (Env::VarReader reader(begin, end);
+         reader.MoveNext(&key, key_len, nullptr, value_len, 0);
+         key_len = sizeof(key), value_len = 0) {
+        auto buf = std::make_unique<uint8_t[]>(value_len);
+        reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
+        if (handler(key.m_KeyInContract,
+                    reinterpret_cast<const Pack::Entry*>(buf.get()),
+                    value_len / sizeof(Pack::Entry))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Builds the pack from the pushed objects, objects which the repo has
+// already are left out
+std::unique_ptr<uint8_t[]> MakePackPush(
+    const ContractID& cid, const sourc3::method::PushObjects& params,
+    size_t& args_size) {
+    using sourc3::Pack;
+    using sourc3::method::PushObjectPack;
+    using sourc3::method::PushObjects;
+    std::vector<const PushObjects::PackedObject*> objects;
+    size_t data_size = 0;
+    auto* obj = reinterpret_cast<const PushObjects::PackedObject*>(&params + 1);
+    for (uint32_t i = 0; i < params.objects_number; ++i) {
+        if (!ObjectDataExists(cid, params.repo_id, obj->hash)) {
+            objects.push_back(obj);
+            data_size += obj->data_size;
+        }
+        obj = reinterpret_cast<const PushObjects::PackedObject*>(
+            reinterpret_cast<const uint8_t*>(obj + 1) + obj->data_size);
+    }
+
+    args_size = sizeof(PushObjectPack) + sizeof(Pack::Entry) * objects.size() +
+                data_size;
+    auto buf = std::make_unique<uint8_t[]>(args_size);
+    auto* pack = reinterpret_cast<PushObjectPack*>(buf.get());
+    pack->repo_id = params.repo_id;
+    pack->user = params.user;
+    pack->objects_number = objects.size();
+    auto* index = reinterpret_cast<Pack::Entry*>(pack + 1);
+    auto* data = reinterpret_cast<uint8_t*>(index + objects.size());
+    for (const auto* packed_obj : objects) {
+        index->type = packed_obj->type;
+        index->hash = packed_obj->hash;
+        index->data_size = packed_obj->data_size;
+        ++index;
+        Env::Memcpy(data, packed_obj + 1, packed_obj->data_size);
+        data += packed_obj->data_size;
+    }
+    return buf;
+}
+
 void OnActionPushObjects(const ContractID& cid) {
     using sourc3::GitRef;
     using sourc3::method::PushObjects;
@@ -1145,11 +1711,27 @@ void OnActionPushObjects(const ContractID& cid) {
                             /*nCharge=*/10000000);
     }
 
+    // existing objects are skipped by the contract instead of failing the
+    // transaction, safe for retries and concurrent pushes
+    uint32_t skip_existing = 0;
+    Env::DocGetNum32("skip_existing", &skip_existing);
+    // objects go to the store shared by all repos, it skips existing
+    // objects as well
+    uint32_t shared = 0;
+    Env::DocGetNum32("shared", &shared);
+    // objects are stored as one pack, existing objects are left out
+    uint32_t pack = 0;
+    Env::DocGetNum32("pack", &pack);
+    if (shared != 0 || pack != 0) {
+        skip_existing = 1;
+    }
+
     // dump objects for debug
     Env::DocGroup gr("objects");
     {
         Env::DocAddNum32("count", params->objects_number);
 
+        uint32_t new_objects = 0;
         auto* obj =
             reinterpret_cast<const PushObjects::PackedObject*>(params + 1);
         for (uint32_t i = 0; i < params->objects_number; ++i) {
@@ -1158,17 +1740,67 @@ void OnActionPushObjects(const ContractID& cid) {
             Env::DocAddBlob("oid", &obj->hash, sizeof(sourc3::GitOid));
             Env::DocAddNum32("size", size);
             Env::DocAddNum32("type", obj->type);
+            if (skip_existing != 0 &&
+                !ObjectDataExists(cid, params->repo_id, obj->hash)) {
+                ++new_objects;
+            }
             ++obj;  // skip header
             const auto* data = reinterpret_cast<const uint8_t*>(obj);
 
             obj = reinterpret_cast<const PushObjects::PackedObject*>(
                 data + size);  // move to next object
         }
+        if (skip_existing != 0) {
+            // objects pushed by others before the transaction is executed
+            // are skipped too
+            Env::DocAddNum32("new_count", new_objects);
+        }
     }
 
     user_key.Get(params->user);
+    if (pack != 0) {
+        auto pack_args = MakePackPush(cid, *params, args_size);
+        auto* pack_params =
+            reinterpret_cast<sourc3::method::PushObjectPack*>(pack_args.get());
+        if (pack_params->objects_number == 0) {
+            return;
+        }
+        Env::GenerateKernel(
+            /*pCid=*/&cid,
+            /*iMethod=*/sourc3::method::PushObjectPack::kMethod,
+            /*pArgs=*/pack_args.get(),
+            /*nArgs=*/args_size,
+            /*pFunds=*/nullptr,
+            /*nFunds=*/0,
+            /*pSig=*/&sig,
+            /*nSig=*/1,
+            /*szComment=*/"Pushing objects",
+            /*nCharge=*/20000000 + 10000 * pack_params->objects_number);
+        return;
+    }
+    if (shared != 0) {
+        uint32_t shared_count = 0;
+        auto shared_args =
+            MakeSharedPush(cid, *params, args_size, shared_count);
+        // these objects don't add data to the contract state
+        Env::DocAddNum32("shared_count", shared_count);
+        Env::GenerateKernel(
+            /*pCid=*/&cid,
+            /*iMethod=*/sourc3::method::PushSharedObjects::kMethod,
+            /*pArgs=*/shared_args.get(),
+            /*nArgs=*/args_size,
+            /*pFunds=*/nullptr,
+            /*nFunds=*/0,
+            /*pSig=*/&sig,
+            /*nSig=*/1,
+            /*szComment=*/"Pushing objects",
+            /*nCharge=*/20000000 + 100000 * params->objects_number);
+        return;
+    }
     Env::GenerateKernel(/*pCid=*/&cid,
-                        /*iMethod=*/PushObjects::kMethod,
+                        /*iMethod=*/skip_existing != 0
+                            ? sourc3::method::PushObjectsIfMissing::kMethod
+                            : PushObjects::kMethod,
                         /*pArgs=*/params,
                         /*nArgs=*/args_size,
                         /*pFunds=*/nullptr,
@@ -1179,6 +1811,112 @@ void OnActionPushObjects(const ContractID& cid) {
                         /*nCharge=*/20000000 + 100000 * params->objects_number);
 }
 
+void OnActionPushObjectChunk(const ContractID& cid) {
+    using sourc3::GitObject;
+    using sourc3::method::PushObjectChunk;
+    auto chunk_size = Env::DocGetBlob("data", nullptr, 0);
+    if (chunk_size == 0u) {
+        return OnError("there is no data to push");
+    }
+    if (chunk_size > GitObject::Chunked::kMaxChunkSize) {
+        return OnError("the chunk is too large");
+    }
+    auto args_size = sizeof(PushObjectChunk) + chunk_size;
+    auto buf = std::make_unique<uint8_t[]>(args_size);
+    auto* params = reinterpret_cast<PushObjectChunk*>(buf.get());
+    if (Env::DocGetBlob("data", params + 1, chunk_size) != chunk_size) {
+        return OnError("failed to read push data");
+    }
+    params->chunk_size = chunk_size;
+    if (!Env::DocGet("repo_id", params->repo_id)) {
+        return OnError("failed to read 'repo_id'");
+    }
+    if (Env::DocGetBlob("obj_id", &params->hash, sizeof(params->hash)) !=
+        sizeof(params->hash)) {
+        return OnError("failed to read 'obj_id'");
+    }
+    uint32_t type = 0;
+    if (!Env::DocGetNum32("obj_type", &type)) {
+        return OnError("failed to read 'obj_type'");
+    }
+    params->type = static_cast<int8_t>(type);
+    if (!Env::DocGetNum32("obj_size", &params->data_size)) {
+        return OnError("failed to read 'obj_size'");
+    }
+    if (!Env::DocGetNum32("chunks", &params->chunks_number)) {
+        return OnError("failed to read 'chunks'");
+    }
+    if (!Env::DocGetNum32("chunk", &params->chunk_index) ||
+        params->chunk_index >= params->chunks_number) {
+        return OnError("failed to read 'chunk'");
+    }
+
+    UserKey user_key(cid);
+    user_key.Get(params->user);
+    SigRequest sig;
+    user_key.FillSigRequest(sig);
+
+    Env::GenerateKernel(/*pCid=*/&cid,
+                        /*iMethod=*/PushObjectChunk::kMethod,
+                        /*pArgs=*/params,
+                        /*nArgs=*/args_size,
+                        /*pFunds=*/nullptr,
+                        /*nFunds=*/0,
+                        /*pSig=*/&sig,
+                        /*nSig=*/1,
+                        /*szComment=*/"Pushing object chunk",
+                        /*nCharge=*/20000000);
+}
+
+void OnActionPushRefs(const ContractID& cid) {
+    using sourc3::GitRef;
+    using sourc3::method::PushRefsIfUnchanged;
+    char ref_name[GitRef::kMaxNameSize + 1];
+    auto name_len = Env::DocGetText("ref", ref_name, _countof(ref_name));
+    if (name_len <= 1) {
+        return OnError("failed to read 'ref'");
+    }
+    --name_len;  // remove 0-term
+    auto args_size = sizeof(PushRefsIfUnchanged) +
+                     sizeof(PushRefsIfUnchanged::RefUpdate) + sizeof(GitRef) +
+                     name_len;
+    auto buf = std::make_unique<uint8_t[]>(args_size);
+    auto* params = reinterpret_cast<PushRefsIfUnchanged*>(buf.get());
+    if (!Env::DocGet("repo_id", params->repo_id)) {
+        return OnError("failed to read 'repo_id'");
+    }
+    params->refs_number = 1;  // single ref for now
+    auto* update =
+        reinterpret_cast<PushRefsIfUnchanged::RefUpdate*>(params + 1);
+    auto* ref = reinterpret_cast<GitRef*>(update + 1);
+    if (Env::DocGetBlob("ref_target", &ref->commit_hash,
+                        sizeof(sourc3::GitOid)) != sizeof(sourc3::GitOid)) {
+        return OnError("failed to read 'ref_target'");
+    }
+    // without the old target the ref must not exist
+    _POD_(update->old_commit_hash).SetZero();
+    Env::DocGetBlob("ref_old_target", &update->old_commit_hash,
+                    sizeof(sourc3::GitOid));
+    ref->name_length = name_len;
+    Env::Memcpy(/*pDst=*/ref->name, /*pSrc=*/ref_name, /*n=*/name_len);
+
+    UserKey user_key(cid);
+    user_key.Get(params->user);
+    SigRequest sig;
+    user_key.FillSigRequest(sig);
+
+    Env::GenerateKernel(/*pCid=*/&cid,
+                        /*iMethod=*/PushRefsIfUnchanged::kMethod,
+                        /*pArgs=*/params,
+                        /*nArgs=*/args_size,
+                        /*pFunds=*/nullptr,
+                        /*nFunds=*/0,
+                        /*pSig=*/&sig,
+                        /*nSig=*/1,
+                        /*szComment=*/"Pushing refs",
+                        /*nCharge=*/10000000);
+}
+
 void OnActionListRefs(const ContractID& cid) {
     using sourc3::GitRef;
     using sourc3::Repo;
@@ -1188,27 +1926,37 @@ void OnActionListRefs(const ContractID& cid) {
     if (!Env::DocGet("repo_id", repo_id)) {
         return OnError("failed to read 'repo_id'");
     }
+    // the helper trusts its cached repo id until a call with it fails
+    if (!VarExists(cid, Repo::Key(repo_id))) {
+        return OnError("repo not found");
+    }
 
     start.m_KeyInContract.repo_id = Utils::FromBE(repo_id);
     _POD_(start.m_Prefix.m_Cid) = cid;
     _POD_(start.m_KeyInContract.name_hash).SetZero();
     _POD_(end) = start;
     _POD_(end.m_KeyInContract.name_hash).SetObject(0xff);
+    Page page;
+    start.m_KeyInContract = page.GetStart(start.m_KeyInContract);
 
     Key key;
-    Env::DocArray repos("refs");
-    uint32_t value_len = 0, key_len = sizeof(Key);
-    for (Env::VarReader reader(start, end);
-         reader.MoveNext(&key, key_len, nullptr, value_len, 0);) {
-        auto buf = std::make_unique<uint8_t[]>(value_len);
-        reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
-        auto* value = reinterpret_cast<GitRef*>(buf.get());
-        Env::DocGroup repo_object("");
-        Env::DocAddText("name", value->name);
-        Env::DocAddBlob("commit_hash", &value->commit_hash,
-                        sizeof(value->commit_hash));
-        value_len = 0;
+    {
+        Env::DocArray repos("refs");
+        uint32_t value_len = 0, key_len = sizeof(Key);
+        for (Env::VarReader reader(start, end);
+             reader.MoveNext(&key, key_len, nullptr, value_len, 0) &&
+             page.Add(key.m_KeyInContract);) {
+            auto buf = std::make_unique<uint8_t[]>(value_len);
+            reader.MoveNext(&key, key_len, buf.get(), value_len, 1);
+            auto* value = reinterpret_cast<GitRef*>(buf.get());
+            Env::DocGroup repo_object("");
+            Env::DocAddText("name", value->name);
+            Env::DocAddBlob("commit_hash", &value->commit_hash,
+                            sizeof(value->commit_hash));
+            value_len = 0;
+        }
     }
+    page.AddNext();
 }
 
 void OnActionUserGetKey(const ContractID& cid) {
@@ -1241,7 +1989,95 @@ void OnActionUserGetRepo(const ContractID& cid) {
 }
 
 using MetaKey = Env::Key_T<sourc3::GitObject::Meta::Key>;
-using DataKey = Env::Key_T<sourc3::GitObject::Data::Key>;
+
+// Joins the chunks of a complete chunked object
+std::unique_ptr<uint8_t[]> LoadChunkedObject(const ContractID& cid,
+                                             sourc3::Repo::Id repo_id,
+                                             const sourc3::GitOid& hash,
+                                             uint32_t& value_len) {
+    using ChunkKey = sourc3::GitObject::Chunked::ChunkKey;
+    auto chunks_number = GetChunksNumber(cid, repo_id, hash);
+    if (chunks_number == 0) {
+        return nullptr;
+    }
+    std::vector<std::unique_ptr<uint8_t[]>> chunks;
+    std::vector<uint32_t> sizes(chunks_number);
+    value_len = 0;
+    for (uint32_t i = 0; i < chunks_number; ++i) {
+        chunks.push_back(ReadVar(cid, ChunkKey(repo_id, hash, i), sizes[i]));
+        if (chunks.back() == nullptr) {
+            return nullptr;
+        }
+        value_len += sizes[i];
+    }
+    auto buf = std::make_unique<uint8_t[]>(value_len);
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < chunks_number; ++i) {
+        Env::Memcpy(buf.get() + offset, chunks[i].get(), sizes[i]);
+        offset += sizes[i];
+    }
+    return buf;
+}
+
+// Loads the data of an object which is kept by the repo, by the shared store
+// or in chunks
+std::unique_ptr<uint8_t[]> LoadUnpackedObject(const ContractID& cid,
+                                              sourc3::Repo::Id repo_id,
+                                              const sourc3::GitOid& hash,
+                                              uint32_t& value_len) {
+    using sourc3::GitObject;
+    auto buf = ReadVar(cid, GitObject::Data::Key(repo_id, hash), value_len);
+    if (buf == nullptr &&
+        VarExists(cid, GitObject::Shared::MemberKey(repo_id, hash))) {
+        buf = ReadVar(cid, GitObject::Shared::DataKey(hash), value_len);
+    }
+    if (buf == nullptr) {
+        buf = LoadChunkedObject(cid, repo_id, hash, value_len);
+    }
+    return buf;
+}
+
+// Reads the pack data up to the end of the object, the rest of the pack
+// isn't read
+std::unique_ptr<uint8_t[]> LoadPackedObject(const ContractID& cid,
+                                            sourc3::Repo::Id repo_id,
+                                            const sourc3::GitOid& hash,
+                                            uint32_t& value_len) {
+    using sourc3::Pack;
+    Pack::Location location;
+    if (!FindPackedObject(cid, repo_id, hash, location)) {
+        return nullptr;
+    }
+    Env::Key_T<Pack::DataKey> key{
+        .m_KeyInContract = Pack::DataKey(repo_id, location.first_id)};
+    key.m_Prefix.m_Cid = cid;
+    uint32_t end = location.offset + location.data_size;
+    auto pack = std::make_unique<uint8_t[]>(end);
+    uint32_t key_len = 0, pack_size = end;
+    Env::VarReader reader(key, key);
+    if (!reader.MoveNext(nullptr, key_len, pack.get(), pack_size, 0) ||
+        pack_size < end) {
+        return nullptr;
+    }
+    value_len = location.data_size;
+    auto buf = std::make_unique<uint8_t[]>(value_len);
+    Env::Memcpy(buf.get(), pack.get() + location.offset, value_len);
+    return buf;
+}
+
+// Loads the data of a repo object, it is kept by the repo, by the shared
+// store, in chunks or in a pack. Returns nullptr if the repo has no such
+// object
+std::unique_ptr<uint8_t[]> LoadObjectData(const ContractID& cid,
+                                          sourc3::Repo::Id repo_id,
+                                          const sourc3::GitOid& hash,
+                                          uint32_t& value_len) {
+    auto buf = LoadUnpackedObject(cid, repo_id, hash, value_len);
+    if (buf == nullptr) {
+        buf = LoadPackedObject(cid, repo_id, hash, value_len);
+    }
+    return buf;
+}
 
 std::tuple<MetaKey, MetaKey, MetaKey> PrepareGetObject(const ContractID& cid) {
     using sourc3::GitObject;
@@ -1259,20 +2095,70 @@ std::tuple<MetaKey, MetaKey, MetaKey> PrepareGetObject(const ContractID& cid) {
     return {start, end, key};
 }
 
+// Lists the repo objects. The meta records are listed first and the packs
+// after them, a page ends at a pack boundary
 void OnActionGetRepoMeta(const ContractID& cid) {
     using sourc3::GitObject;
-    auto [start, end, key] = PrepareGetObject(cid);
-
-    GitObject::Meta value;
-    Env::DocArray objects_array("objects");
-    for (Env::VarReader reader(start, end); reader.MoveNext_T(key, value);) {
+    using sourc3::Pack;
+    sourc3::Repo::Id repo_id = 0;
+    Env::DocGet("repo_id", repo_id);
+    if (!VarExists(cid, sourc3::Repo::Key(repo_id))) {
+        return OnError("repo not found");
+    }
+    Page page;
+    // the keys of the meta records and of the packs have the same layout,
+    // the tag tells which of them the page starts from
+    auto start = page.GetStart(GitObject::Meta::Key(repo_id, 0));
+    auto add_object = [](int8_t type, const sourc3::GitOid& hash,
+                         uint32_t size) {
         Env::DocGroup obj("");
-        Env::DocAddBlob_T("object_hash", value.hash);
-        Env::DocAddNum("object_type", static_cast<uint32_t>(value.type));
-        Env::DocAddNum("object_size", value.data_size);
+        Env::DocAddBlob_T("object_hash", hash);
+        Env::DocAddNum("object_type", static_cast<uint32_t>(type));
+        Env::DocAddNum("object_size", size);
+    };
+
+    {
+        Env::DocArray objects_array("objects");
+        if (start.tag == sourc3::kObjects) {
+            MetaKey begin{.m_KeyInContract = start};
+            MetaKey end{.m_KeyInContract = {
+                            repo_id,
+                            std::numeric_limits<GitObject::Id>::max()}};
+            begin.m_Prefix.m_Cid = cid;
+            end.m_Prefix.m_Cid = cid;
+            MetaKey key = begin;
+            GitObject::Meta value;
+            for (Env::VarReader reader(begin, end);
+                 reader.MoveNext_T(key, value) &&
+                 page.Add(key.m_KeyInContract);) {
+                add_object(value.type, value.hash, value.data_size);
+            }
+        }
+        if (!page.HasNext() && (start.tag == sourc3::kObjects ||
+                                start.tag == sourc3::kPackIndex)) {
+            // the pack ids are big-endian
+            Pack::IndexKey pack_start(
+                repo_id, start.tag == sourc3::kPackIndex
+                             ? Utils::FromBE(start.obj_id)
+                             : 0);
+            ForEachPack(cid, pack_start,
+                        [&](const Pack::IndexKey& key,
+                            const Pack::Entry* index, size_t count) {
+                            if (!page.Add(key, count)) {
+                                return true;
+                            }
+                            for (size_t i = 0; i < count; ++i) {
+                                add_object(index[i].type, index[i].hash,
+                                           index[i].data_size);
+                            }
+                            return false;
+                        });
+        }
     }
+    page.AddNext();
 }
 
+
 void OnActionGetRepoData(const ContractID& cid) {
     using sourc3::GitObject;
     using sourc3::GitOid;
@@ -1281,13 +2167,20 @@ void OnActionGetRepoData(const ContractID& cid) {
     GitOid hash;
     Env::DocGet("repo_id", repo_id);
     Env::DocGetBlob("obj_id", &hash, sizeof(hash));
-    DataKey key{.m_KeyInContract = {repo_id, hash}};
-    key.m_Prefix.m_Cid = cid;
-    uint32_t value_len = 0, key_len = 0;
-    Env::VarReader reader(key, key);
-    if (reader.MoveNext(nullptr, key_len, nullptr, value_len, 0)) {
-        auto buf = std::make_unique<uint8_t[]>(value_len);
-        reader.MoveNext(nullptr, key_len, buf.get(), value_len, 1);
+    uint32_t value_len = 0;
+    // chunked objects are streamed, each call returns one chunk and the
+    // caller requests the rest
+    if (auto chunks_number = GetChunksNumber(cid, repo_id, hash)) {
+        uint32_t chunk = 0;
+        Env::DocGetNum32("chunk", &chunk);
+        Env::DocAddNum32("chunks_number", chunks_number);
+        auto buf =
+            ReadVar(cid, GitObject::Chunked::ChunkKey(repo_id, hash, chunk),
+                    value_len);
+        Env::DocAddBlob("object_data", buf.get(), value_len);
+        return;
+    }
+    if (auto buf = LoadObjectData(cid, repo_id, hash, value_len)) {
         auto* value = reinterpret_cast<GitObject::Data*>(buf.get());
         Env::DocAddBlob("object_data", value->data, value_len);
     } else {
@@ -1295,9 +2188,33 @@ void OnActionGetRepoData(const ContractID& cid) {
     }
 }
 
-void AddCommit(const mygit2::git_commit& commit,
-               const sourc3::GitOid& hash) {
-    Env::DocGroup commit_obj("commit");
+// Frees the fields of a parsed commit, the quick parsing and a failed one
+// leave some of them empty
+void FreeCommit(const mygit2::git_commit& commit) {
+    for (auto* sig : {commit.author, commit.committer}) {
+        if (sig != nullptr) {
+            for (auto* field : {sig->name, sig->email}) {
+                if (field != nullptr) {
+                    Env::Heap_Free(field);
+                }
+            }
+            Env::Heap_Free(sig);
+        }
+    }
+    for (auto* field : {commit.message_encoding, commit.raw_message,
+                        commit.raw_header}) {
+        if (field != nullptr) {
+            Env::Heap_Free(field);
+        }
+    }
+    if (commit.parent_ids.ptr != nullptr) {
+        Env::Heap_Free(commit.parent_ids.ptr);
+    }
+}
+
+void AddCommit(const mygit2::git_commit& commit, const sourc3::GitOid& hash,
+               const char* name = "commit") {
+    Env::DocGroup commit_obj(name);
     char oid_buffer[GIT_OID_HEXSZ + 1];
     oid_buffer[GIT_OID_HEXSZ] = '\0';
     Env::DocAddBlob("commit_oid", &hash, sizeof(hash));
@@ -1309,7 +2226,7 @@ void AddCommit(const mygit2::git_commit& commit,
     Env::DocAddText("author_email", commit.author->email);
     Env::DocAddText("committer_name", commit.committer->name);
     Env::DocAddText("committer_email", commit.committer->email);
-    Env::DocAddNum32("commit_time_sec", commit.committer->when.offset);
+    Env::DocAddNum32("commit_time_sec", commit.committer->when.time);
     Env::DocAddNum32("commit_time_tz_offset_min",
                      commit.committer->when.offset);
     Env::DocAddNum32(
@@ -1328,11 +2245,7 @@ void AddCommit(const mygit2::git_commit& commit,
         git_oid_fmt(oid_buffer, &commit.parent_ids.ptr[i]);
         Env::DocAddText("oid", oid_buffer);
     }
-    Env::Heap_Free(commit.parent_ids.ptr);
-    Env::Heap_Free(commit.author);
-    Env::Heap_Free(commit.raw_message);
-    Env::Heap_Free(commit.raw_header);
-    Env::Heap_Free(commit.committer);
+    FreeCommit(commit);
 }
 
 void AddTree(const mygit2::git_tree& tree) {
@@ -1379,13 +2292,8 @@ void OnActionGetCommit(const ContractID& cid) {
     GitOid hash;
     Env::DocGet("repo_id", repo_id);
     Env::DocGetBlob("obj_id", &hash, sizeof(hash));
-    DataKey key{.m_KeyInContract = {repo_id, hash}};
-    key.m_Prefix.m_Cid = cid;
-    uint32_t value_len = 0, key_len = 0;
-    Env::VarReader reader(key, key);
-    if (reader.MoveNext(nullptr, key_len, nullptr, value_len, 0)) {
-        auto buf = std::make_unique<uint8_t[]>(value_len);
-        reader.MoveNext(nullptr, key_len, buf.get(), value_len, 1);
+    uint32_t value_len = 0;
+    if (auto buf = LoadObjectData(cid, repo_id, hash, value_len)) {
         auto* value = reinterpret_cast<GitObject::Data*>(buf.get());
         mygit2::git_commit commit{};
         if (commit_parse(&commit, value->data, value_len, 0) == 0) {
@@ -1416,13 +2324,8 @@ void OnActionGetTree(const ContractID& cid) {
     GitOid hash;
     Env::DocGet("repo_id", repo_id);
     Env::DocGetBlob("obj_id", &hash, sizeof(hash));
-    DataKey key{.m_KeyInContract = {repo_id, hash}};
-    key.m_Prefix.m_Cid = cid;
-    uint32_t value_len = 0, key_len = 0;
-    Env::VarReader reader(key, key);
-    if (reader.MoveNext(nullptr, key_len, nullptr, value_len, 0)) {
-        auto buf = std::make_unique<uint8_t[]>(value_len);
-        reader.MoveNext(nullptr, key_len, buf.get(), value_len, 1);
+    uint32_t value_len = 0;
+    if (auto buf = LoadObjectData(cid, repo_id, hash, value_len)) {
         auto* value = reinterpret_cast<GitObject::Data*>(buf.get());
         mygit2::git_tree tree{};
         if (tree_parse(&tree, value->data, value_len) == 0) {
@@ -1460,318 +2363,1476 @@ void OnActionGetTreeFromData(const ContractID&) {
     });
 }
 
-void GetObjects(const ContractID& cid,
-                sourc3::GitObject::Meta::Type type) {
-    using sourc3::GitObject;
-    using sourc3::Repo;
-    auto [start, end, key] = PrepareGetObject(cid);
-    GitObject::Meta value;
-    Env::DocArray objects_array("objects");
-    for (Env::VarReader reader(start, end); reader.MoveNext_T(key, value);) {
-        auto current_type = value.type & 0x7f;  // clear first bit
-        if (current_type == type) {
-            Env::DocGroup obj("");
-            Env::DocAddBlob_T("object_hash", value.hash);
-            Env::DocAddNum("object_type", static_cast<uint32_t>(value.type));
-            Env::DocAddNum("object_size", value.data_size);
-        }
+// Modes of the tree entries
+constexpr uint16_t kGitTreeMode = 0040000;
+constexpr uint16_t kGitSubmoduleMode = 0160000;
+
+struct OidLess {
+    bool operator()(const sourc3::GitOid& a, const sourc3::GitOid& b) const {
+        return Env::Memcmp(&a, &b, sizeof(a)) < 0;
     }
-}
+};
 
-void OnActionGetCommits(const ContractID& cid) {
-    GetObjects(cid, sourc3::GitObject::Meta::kGitObjectCommit);
+// Reads a list of oids, returns false if the size of the param is wrong
+bool GetOids(const char* name, std::vector<sourc3::GitOid>& oids) {
+    auto size = Env::DocGetBlob(name, nullptr, 0);
+    if (size % sizeof(sourc3::GitOid) != 0) {
+        return false;
+    }
+    oids.resize(size / sizeof(sourc3::GitOid));
+    if (size != 0) {
+        Env::DocGetBlob(name, oids.data(), size);
+    }
+    return true;
 }
 
-void OnActionGetTrees(const ContractID& cid) {
-    GetObjects(cid, sourc3::GitObject::Meta::kGitObjectTree);
-}
-}  // namespace
+// Finds the objects of a repo by hash. The data of the last read pack is
+// kept, the objects of a push are usually walked together
+class RepoObjects {
+public:
+    RepoObjects(const ContractID& cid, sourc3::Repo::Id repo_id)
+        : cid_(cid), repo_id_(repo_id) {
+    }
 
-BEAM_EXPORT void Method_0() {  // NOLINT
-    Env::DocGroup root("");
-    {
-        Env::DocGroup gr("roles");
-        {
-            Env::DocGroup gr_role("manager");
-            {
-                Env::DocGroup gr_method("create_contract");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("hUpgradeDelay", "Height");
-                Env::DocAddText("nMinApprovers", "uint32_t");
-                Env::DocAddText("uint32_t", "bSkipVerifyVer");
-            }
-            {
-                Env::DocGroup gr_method("schedule_upgrade");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("hTarget", "Height");
-                Env::DocAddText("uint32_t", "bSkipVerifyVer");
-                Env::DocAddText("uint32_t", "iSender");
-                Env::DocAddText("uint32_t", "approve_mask");
-            }
-            {
-                Env::DocGroup gr_method("explicit_upgrade");
-                Env::DocAddText("cid", "ContractID");
-            }
-            {
-                Env::DocGroup gr_method("destroy_contract");
-                Env::DocAddText("cid", "ContractID");
-            }
-            { Env::DocGroup gr_method("view_contracts"); }
-            {
-                Env::DocGroup gr_method("view_contract_params");
-                Env::DocAddText("cid", "ContractID");
-            }
+    // Returns nullptr if the repo has no such object
+    std::unique_ptr<uint8_t[]> Load(const sourc3::GitOid& hash,
+                                    uint32_t& size) {
+        auto buf = LoadUnpackedObject(cid_, repo_id_, hash, size);
+        if (buf != nullptr) {
+            return buf;
         }
-        {
-            Env::DocGroup gr_role("user");
-            {
-                Env::DocGroup gr_method("create_repo");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_name", "Name of repo");
-                Env::DocAddText("project_id", "Project ID");
-                Env::DocAddText("pid", "uint32_t");
-            }
-            {
-                Env::DocGroup gr_method("create_project");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("name", "Name of project");
-                Env::DocAddText("organization_id", "Organization ID");
-                Env::DocAddText("pid", "uint32_t");
-            }
-            {
-                Env::DocGroup gr_method("modify_project");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("name", "Name of project");
-                Env::DocAddText("project_id", "Project ID");
-                Env::DocAddText("organization_id", "Organization ID");
-                Env::DocAddText("pid", "uint32_t");
-            }
-            {
-                Env::DocGroup gr_method("remove_project");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("project_id", "Project ID");
-                Env::DocAddText("pid", "uint32_t");
-            }
-            {
-                Env::DocGroup gr_method("create_organization");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("name", "Name of organization");
-                Env::DocAddText("pid", "uint32_t");
-            }
-            {
-                Env::DocGroup gr_method("modify_organization");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("name", "Name of organization");
-                Env::DocAddText("organization_id", "Organization ID");
-                Env::DocAddText("pid", "uint32_t");
-            }
-            {
-                Env::DocGroup gr_method("remove_organization");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("organization_id", "Organization ID");
-                Env::DocAddText("pid", "uint32_t");
-            }
-            {
-                Env::DocGroup gr_method("my_repos");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("pid", "uint32_t");
-            }
-            {
-                Env::DocGroup gr_method("all_repos");
-                Env::DocAddText("cid", "ContractID");
-            }
-            {
-                Env::DocGroup gr_method("modify_repo");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_name", "Name of repo");
-                Env::DocAddText("repo_id", "Repo ID");
-                Env::DocAddText("pid", "uint32_t");
-            }
-            {
-                Env::DocGroup gr_method("delete_repo");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_id", "Repo ID");
-                Env::DocAddText("pid", "uint32_t");
-            }
-            {
-                Env::DocGroup gr_method("add_user_params");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_id", "Repo ID");
-                Env::DocAddText("user", "User PubKey");
-                Env::DocAddText("permissions", "permissions");
-                Env::DocAddText("pid", "uint32_t");
+        sourc3::Pack::Location location;
+        if (!FindPackedObject(cid_, repo_id_, hash, location)) {
+            return nullptr;
+        }
+        if (pack_ == nullptr || pack_id_ != location.first_id) {
+            pack_id_ = location.first_id;
+            pack_ = ReadVar(cid_, sourc3::Pack::DataKey(repo_id_, pack_id_),
+                            pack_size_);
+        }
+        if (pack_ == nullptr ||
+            pack_size_ < location.offset + location.data_size) {
+            return nullptr;
+        }
+        size = location.data_size;
+        buf = std::make_unique<uint8_t[]>(size);
+        Env::Memcpy(buf.get(), pack_.get() + location.offset, size);
+        return buf;
+    }
+
+    // Returns false if the repo has no such object
+    bool GetSize(const sourc3::GitOid& hash, uint32_t& size) {
+        using sourc3::GitObject;
+        if (GetVarSize(cid_, GitObject::Data::Key(repo_id_, hash), size)) {
+            return true;
+        }
+        if (VarExists(cid_, GitObject::Shared::MemberKey(repo_id_, hash))) {
+            return GetVarSize(cid_, GitObject::Shared::DataKey(hash), size);
+        }
+        if (auto chunks_number = GetChunksNumber(cid_, repo_id_, hash)) {
+            size = 0;
+            for (uint32_t i = 0; i < chunks_number; ++i) {
+                uint32_t chunk_size = 0;
+                GetVarSize(cid_,
+                           GitObject::Chunked::ChunkKey(repo_id_, hash, i),
+                           chunk_size);
+                size += chunk_size;
             }
-            {
-                Env::DocGroup gr_method("modify_user_params");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_id", "Repo ID");
-                Env::DocAddText("user", "User PubKey");
-                Env::DocAddText("permissions", "permissions");
-                Env::DocAddText("pid", "uint32_t");
+            return true;
+        }
+        sourc3::Pack::Location location;
+        if (!FindPackedObject(cid_, repo_id_, hash, location)) {
+            return false;
+        }
+        size = location.data_size;
+        return true;
+    }
+
+private:
+    const ContractID& cid_;
+    sourc3::Repo::Id repo_id_;
+    std::unique_ptr<uint8_t[]> pack_;
+    sourc3::GitObject::Id pack_id_ = 0;
+    uint32_t pack_size_ = 0;
+};
+
+// Walks the commits and the trees from the wanted ones and lists the objects
+// which the client needs. The walk doesn't enter the objects of the have
+// set, they are the commits and the trees which the client has with all
+// their history. A call walks at most 'limit' (100 by default) commits and
+// trees, the rest of the walk is returned as 'pending'. The next call
+// passes it back and adds the commits and the trees listed so far to the
+// have set, their parents and entries are pending already. 'wants' is
+// ignored when 'pending' is given, so a continuation never restarts the
+// walk from the tips
+void OnActionNegotiate(const ContractID& cid) {
+    using sourc3::GitObject;
+    using sourc3::GitOid;
+    using Type = GitObject::Meta::Type;
+    struct Pending {
+        GitOid hash;
+        int8_t type;
+    };
+
+    sourc3::Repo::Id repo_id = 0;
+    if (!Env::DocGet("repo_id", repo_id)) {
+        return OnError("failed to read 'repo_id'");
+    }
+    std::vector<GitOid> wants;
+    std::vector<GitOid> haves;
+    if (!GetOids("wants", wants) || !GetOids("haves", haves)) {
+        return OnError("'wants' and 'haves' must be lists of oids");
+    }
+    std::vector<Pending> stack;
+    auto pending_size = Env::DocGetBlob("pending", nullptr, 0);
+    if (pending_size % sizeof(Pending) != 0) {
+        return OnError("wrong size of 'pending'");
+    }
+    stack.resize(pending_size / sizeof(Pending));
+    if (pending_size != 0) {
+        Env::DocGetBlob("pending", stack.data(), pending_size);
+    }
+    constexpr uint32_t kDefaultLimit = 100;
+    uint32_t limit = kDefaultLimit;
+    Env::DocGetNum32("limit", &limit);
+    if (limit == 0 || limit > Page::kMaxLimit) {
+        limit = kDefaultLimit;
+    }
+
+    std::set<GitOid, OidLess> seen(haves.begin(), haves.end());
+    for (const auto& pending : stack) {
+        seen.insert(pending.hash);
+    }
+    if (pending_size == 0) {
+        for (const auto& hash : wants) {
+            if (seen.insert(hash).second) {
+                stack.push_back({hash, Type::kGitObjectCommit});
             }
-            {
-                Env::DocGroup gr_method("remove_user_params");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_id", "Repo ID");
-                Env::DocAddText("user", "User PubKey");
-                Env::DocAddText("pid", "uint32_t");
+        }
+    }
+
+    RepoObjects objects(cid, repo_id);
+    auto add_object = [](const GitOid& hash, int8_t type, uint32_t size) {
+        Env::DocGroup obj("");
+        Env::DocAddBlob_T("object_hash", hash);
+        Env::DocAddNum("object_type", static_cast<uint32_t>(type));
+        Env::DocAddNum("object_size", size);
+    };
+    {
+        Env::DocArray needed("objects");
+        for (uint32_t walked = 0; !stack.empty() && walked < limit;
+             ++walked) {
+            auto current = stack.back();
+            stack.pop_back();
+            uint32_t size = 0;
+            auto buf = objects.Load(current.hash, size);
+            if (buf == nullptr) {
+                continue;  // the repo doesn't have it
             }
-            {
-                Env::DocGroup gr_method("push_objects");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_id", "Repo ID");
-                Env::DocAddText("data", "Push objects");
-                Env::DocAddText("ref", "Objects ref");
-                Env::DocAddText("ref_target", "Objects ref target");
-                Env::DocAddText("pid", "uint32_t");
+            add_object(current.hash, current.type, size);
+            const auto* data = reinterpret_cast<const char*>(buf.get());
+            if (current.type == Type::kGitObjectCommit) {
+                mygit2::git_commit commit{};
+                if (commit_parse(&commit, data, size, 0) != 0) {
+                    FreeCommit(commit);
+                    continue;  // kept in IPFS
+                }
+                GitOid tree_id;
+                Env::Memcpy(&tree_id, &commit.tree_id, sizeof(tree_id));
+                if (seen.insert(tree_id).second) {
+                    stack.push_back({tree_id, Type::kGitObjectTree});
+                }
+                for (size_t i = 0; i < commit.parent_ids.size; ++i) {
+                    GitOid parent;
+                    Env::Memcpy(&parent, &commit.parent_ids.ptr[i],
+                                sizeof(parent));
+                    if (seen.insert(parent).second) {
+                        stack.push_back({parent, Type::kGitObjectCommit});
+                    }
+                }
+                FreeCommit(commit);
+            } else {
+                mygit2::git_tree tree{};
+                if (tree_parse(&tree, data, size) != 0) {
+                    Env::Heap_Free(tree.entries.ptr);
+                    continue;  // kept in IPFS
+                }
+                for (size_t i = 0; i < tree.entries.size; ++i) {
+                    const auto& entry = tree.entries.ptr[i];
+                    GitOid hash;
+                    Env::Memcpy(&hash, entry.oid, sizeof(hash));
+                    if (entry.attr == kGitSubmoduleMode ||
+                        !seen.insert(hash).second) {
+                        continue;
+                    }
+                    if (entry.attr == kGitTreeMode) {
+                        stack.push_back({hash, Type::kGitObjectTree});
+                    } else if (objects.GetSize(hash, size)) {
+                        add_object(hash, Type::kGitObjectBlob, size);
+                    }
+                }
+                Env::Heap_Free(tree.entries.ptr);
             }
-            {
-                Env::DocGroup gr_method("list_refs");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_id", "Repo ID");
-                Env::DocAddText("pid", "uint32_t");
+        }
+    }
+    if (!stack.empty()) {
+        Env::DocAddBlob("pending", stack.data(),
+                        static_cast<uint32_t>(stack.size() * sizeof(Pending)));
+    }
+}
+
+// Reads the commit given by 'obj_id' or by the target of 'ref'
+bool GetCommitParam(const ContractID& cid, sourc3::Repo::Id repo_id,
+                    sourc3::GitOid& hash) {
+    using sourc3::GitRef;
+    if (Env::DocGetBlob("obj_id", &hash, sizeof(hash)) == sizeof(hash)) {
+        return true;
+    }
+    char ref_name[GitRef::kMaxNameSize + 1];
+    auto name_len = Env::DocGetText("ref", ref_name, _countof(ref_name));
+    if (name_len <= 1) {
+        return false;
+    }
+    uint32_t value_len = 0;
+    auto buf = ReadVar(cid, GitRef::Key(repo_id, ref_name, name_len - 1),
+                       value_len);
+    if (buf == nullptr) {
+        return false;
+    }
+    hash = reinterpret_cast<const GitRef*>(buf.get())->commit_hash;
+    return true;
+}
+
+#pragma pack(push, 1)
+// Commit to be listed by repo_log, the rest of the walk is passed between
+// the calls as an array of them
+struct LogEntry {
+    sourc3::GitOid hash;
+    int64_t time;  // of the commit
+};
+#pragma pack(pop)
+
+// Lists the history of a commit in the date order, newest first. A call
+// lists at most 'limit' commits and returns the queued commits as 'pending'
+// for the next call. A commit is listed after all of its children, so the
+// walk only skips the commits already queued; a commit dated before one of
+// its children may be listed twice
+void OnActionLog(const ContractID& cid) {
+    using sourc3::GitOid;
+    constexpr uint32_t kDefaultLimit = 50;
+    sourc3::Repo::Id repo_id = 0;
+    if (!Env::DocGet("repo_id", repo_id)) {
+        return OnError("failed to read 'repo_id'");
+    }
+    uint32_t limit = kDefaultLimit;
+    Env::DocGetNum32("limit", &limit);
+    if (limit == 0 || limit > Page::kMaxLimit) {
+        limit = Page::kMaxLimit;
+    }
+
+    std::vector<LogEntry> queue;
+    auto pending_size = Env::DocGetBlob("pending", nullptr, 0);
+    if (pending_size != 0) {
+        if (pending_size % sizeof(LogEntry) != 0) {
+            return OnError("wrong size of 'pending'");
+        }
+        queue.resize(pending_size / sizeof(LogEntry));
+        Env::DocGetBlob("pending", queue.data(), pending_size);
+    } else {
+        queue.emplace_back();
+        if (!GetCommitParam(cid, repo_id, queue.back().hash)) {
+            return OnError("failed to read 'obj_id' or 'ref'");
+        }
+    }
+    std::set<GitOid, OidLess> queued;
+    for (const auto& entry : queue) {
+        queued.insert(entry.hash);
+    }
+    auto later = [](const LogEntry& a, const LogEntry& b) {
+        return a.time < b.time;
+    };
+    std::make_heap(queue.begin(), queue.end(), later);
+
+    struct Loaded {
+        std::unique_ptr<uint8_t[]> buf;
+        uint32_t size;
+    };
+    // parents loaded for their time, listed later by this call
+    std::map<GitOid, Loaded, OidLess> loaded;
+    RepoObjects objects(cid, repo_id);
+    {
+        Env::DocArray commits("commits");
+        uint32_t listed = 0;
+        while (!queue.empty() && listed < limit) {
+            std::pop_heap(queue.begin(), queue.end(), later);
+            auto hash = queue.back().hash;
+            queue.pop_back();
+            queued.erase(hash);
+            Loaded data{};
+            auto it = loaded.find(hash);
+            if (it != loaded.end()) {
+                data = std::move(it->second);
+                loaded.erase(it);
+            } else {
+                data.buf = objects.Load(hash, data.size);
             }
-            {
-                Env::DocGroup gr_method("get_key");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("pid", "uint32_t");
+            mygit2::git_commit commit{};
+            if (data.buf == nullptr ||
+                commit_parse(&commit,
+                             reinterpret_cast<const char*>(data.buf.get()),
+                             data.size, 0) != 0) {
+                FreeCommit(commit);
+                continue;  // missing or kept in IPFS
             }
-            {
-                Env::DocGroup gr_method("repo_id_by_name");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_name", "Name of repo");
-                Env::DocAddText("repo_owner", "Owner key of repo");
+            for (size_t i = 0; i < commit.parent_ids.size; ++i) {
+                LogEntry parent{};
+                Env::Memcpy(&parent.hash, &commit.parent_ids.ptr[i],
+                            sizeof(parent.hash));
+                if (!queued.insert(parent.hash).second) {
+                    continue;
+                }
+                Loaded parent_data{};
+                parent_data.buf = objects.Load(parent.hash, parent_data.size);
+                mygit2::git_commit quick{};
+                if (parent_data.buf != nullptr &&
+                    commit_parse(
+                        &quick,
+                        reinterpret_cast<const char*>(parent_data.buf.get()),
+                        parent_data.size, GIT_COMMIT_PARSE_QUICK) == 0) {
+                    parent.time = quick.committer->when.time;
+                    loaded.emplace(parent.hash, std::move(parent_data));
+                }
+                FreeCommit(quick);
+                queue.push_back(parent);
+                std::push_heap(queue.begin(), queue.end(), later);
             }
-            {
-                Env::DocGroup gr_method("project_id_by_name");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("name", "Name of project");
-                Env::DocAddText("owner", "Owner key of project");
+            AddCommit(commit, hash, "");
+            ++listed;
+        }
+    }
+    if (!queue.empty()) {
+        Env::DocAddBlob("pending", queue.data(),
+                        static_cast<uint32_t>(queue.size() * sizeof(LogEntry)));
+    }
+}
+
+// Resolves a path at a commit given by 'obj_id' or 'ref'. Returns the oid,
+// the mode and the size of the entry, with 'with_data' also the entries of
+// a tree or the data of a blob. The empty path is the root tree
+void OnActionGetPath(const ContractID& cid) {
+    using sourc3::GitOid;
+    constexpr size_t kMaxPathSize = 4096;
+    sourc3::Repo::Id repo_id = 0;
+    if (!Env::DocGet("repo_id", repo_id)) {
+        return OnError("failed to read 'repo_id'");
+    }
+    GitOid oid;
+    if (!GetCommitParam(cid, repo_id, oid)) {
+        return OnError("failed to read 'obj_id' or 'ref'");
+    }
+    auto path = std::make_unique<char[]>(kMaxPathSize);
+    auto path_len = Env::DocGetText("path", path.get(), kMaxPathSize);
+    std::string_view rest(path.get(), path_len > 1 ? path_len - 1 : 0);
+    uint32_t with_data = 0;
+    Env::DocGetNum32("with_data", &with_data);
+
+    RepoObjects objects(cid, repo_id);
+    uint32_t size = 0;
+    auto buf = objects.Load(oid, size);
+    mygit2::git_commit commit{};
+    if (buf == nullptr ||
+        commit_parse(&commit, reinterpret_cast<const char*>(buf.get()), size,
+                     0) != 0) {
+        return OnError("no commit in data");
+    }
+    Env::Memcpy(&oid, &commit.tree_id, sizeof(oid));
+    FreeCommit(commit);
+    uint16_t attr = kGitTreeMode;
+    for (;;) {
+        while (!rest.empty() && rest.front() == '/') {
+            rest.remove_prefix(1);
+        }
+        if (rest.empty()) {
+            break;
+        }
+        if (attr != kGitTreeMode) {
+            return OnError("path not found");
+        }
+        auto name = rest.substr(0, rest.find('/'));
+        rest.remove_prefix(name.size());
+        buf = objects.Load(oid, size);
+        mygit2::git_tree tree{};
+        if (buf == nullptr ||
+            tree_parse(&tree, reinterpret_cast<const char*>(buf.get()),
+                       size) != 0) {
+            return OnError("no tree in data");
+        }
+        bool found = false;
+        for (size_t i = 0; i < tree.entries.size && !found; ++i) {
+            const auto& entry = tree.entries.ptr[i];
+            if (entry.filename_len == name.size() &&
+                Env::Memcmp(entry.filename, name.data(), name.size()) == 0) {
+                Env::Memcpy(&oid, entry.oid, sizeof(oid));
+                attr = entry.attr;
+                found = true;
             }
-            {
-                Env::DocGroup gr_method("organization_id_by_name");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("name", "Name of organization");
-                Env::DocAddText("owner", "Owner key of organization");
+        }
+        Env::Heap_Free(tree.entries.ptr);
+        if (!found) {
+            return OnError("path not found");
+        }
+    }
+
+    char oid_buffer[GIT_OID_HEXSZ + 1];
+    oid_buffer[GIT_OID_HEXSZ] = '\0';
+    git_oid_fmt(oid_buffer, reinterpret_cast<const mygit2::git_oid*>(&oid));
+    Env::DocAddText("oid", oid_buffer);
+    Env::DocAddNum("attributes", static_cast<uint32_t>(attr));
+    if (attr == kGitSubmoduleMode) {
+        return;  // the commit is in another repo
+    }
+    if (with_data == 0) {
+        if (objects.GetSize(oid, size)) {
+            Env::DocAddNum("object_size", size);
+        }
+        return;
+    }
+    buf = objects.Load(oid, size);
+    if (buf == nullptr) {
+        return OnError("no object data");
+    }
+    Env::DocAddNum("object_size", size);
+    if (attr == kGitTreeMode) {
+        mygit2::git_tree tree{};
+        if (tree_parse(&tree, reinterpret_cast<const char*>(buf.get()),
+                       size) != 0) {
+            return OnError("no tree in data");
+        }
+        AddTree(tree);
+    } else {
+        Env::DocAddBlob("object_data", buf.get(), size);
+    }
+}
+
+// Compares the entries in the order of git trees, the name of a tree is
+// compared as if it ends with '/'
+int CompareTreeEntries(const mygit2::git_tree_entry& a,
+                       const mygit2::git_tree_entry& b) {
+    auto len = std::min(a.filename_len, b.filename_len);
+    if (auto res = Env::Memcmp(a.filename, b.filename, len)) {
+        return res;
+    }
+    auto next = [len](const mygit2::git_tree_entry& entry) -> int {
+        if (entry.filename_len > len) {
+            return static_cast<uint8_t>(entry.filename[len]);
+        }
+        return entry.attr == kGitTreeMode ? '/' : 0;
+    };
+    return next(a) - next(b);
+}
+
+#pragma pack(push, 1)
+// Pair of trees to be compared by repo_diff_trees, followed by the path.
+// The rest of the walk is passed between the calls as a list of them
+struct DiffEntry {
+    static constexpr uint8_t kOld = 1;
+    static constexpr uint8_t kNew = 2;
+    sourc3::GitOid old_oid;
+    sourc3::GitOid new_oid;
+    uint8_t sides;  // which of the trees exist
+    uint16_t path_len;
+};
+#pragma pack(pop)
+
+// Lists the paths added, removed or modified between the trees of two
+// commits, the base is the first parent by default. Subtrees with the same
+// oid are skipped, so the walk follows only the changes. A call compares at
+// most 'limit' pairs of trees and returns the rest of the walk as 'pending'
+void OnActionDiffTrees(const ContractID& cid) {
+    using sourc3::GitOid;
+    struct Dir {
+        DiffEntry entry;
+        std::vector<char> path;  // ends with '/' unless empty
+    };
+
+    sourc3::Repo::Id repo_id = 0;
+    if (!Env::DocGet("repo_id", repo_id)) {
+        return OnError("failed to read 'repo_id'");
+    }
+    uint32_t limit = Page::kMaxLimit;
+    Env::DocGetNum32("limit", &limit);
+    if (limit == 0 || limit > Page::kMaxLimit) {
+        limit = Page::kMaxLimit;
+    }
+    RepoObjects objects(cid, repo_id);
+
+    std::vector<Dir> stack;
+    auto pending_size = Env::DocGetBlob("pending", nullptr, 0);
+    if (pending_size != 0) {
+        auto pending = std::make_unique<uint8_t[]>(pending_size);
+        Env::DocGetBlob("pending", pending.get(), pending_size);
+        for (uint32_t offset = 0; offset < pending_size;) {
+            if (pending_size - offset < sizeof(DiffEntry)) {
+                return OnError("wrong size of 'pending'");
             }
-            {
-                Env::DocGroup gr_method("repo_get_data");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_id", "Repo ID");
-                Env::DocAddText("obj_id", "Object hash");
+            auto& dir = stack.emplace_back();
+            Env::Memcpy(&dir.entry, pending.get() + offset, sizeof(DiffEntry));
+            offset += sizeof(DiffEntry);
+            if (pending_size - offset < dir.entry.path_len) {
+                return OnError("wrong size of 'pending'");
             }
-            {
-                Env::DocGroup gr_method("repo_get_meta");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_id", "Repo ID");
+            dir.path.assign(pending.get() + offset,
+                            pending.get() + offset + dir.entry.path_len);
+            offset += dir.entry.path_len;
+        }
+    } else {
+        GitOid new_commit;
+        if (!GetCommitParam(cid, repo_id, new_commit)) {
+            return OnError("failed to read 'obj_id' or 'ref'");
+        }
+        GitOid base_commit;
+        bool has_base = Env::DocGetBlob("base_id", &base_commit,
+                                        sizeof(base_commit)) ==
+                        sizeof(base_commit);
+        auto& root = stack.emplace_back();
+        root.entry.sides = 0;
+        root.entry.path_len = 0;
+        // reads the root tree, the base is the first parent by default
+        auto read_commit = [&](const GitOid& hash, GitOid& tree_oid,
+                               bool first_parent) {
+            uint32_t size = 0;
+            auto buf = objects.Load(hash, size);
+            mygit2::git_commit commit{};
+            if (buf == nullptr ||
+                commit_parse(&commit, reinterpret_cast<const char*>(buf.get()),
+                             size, 0) != 0) {
+                return false;
             }
-            {
-                Env::DocGroup gr_method("repo_get_commit");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_id", "Repo ID");
-                Env::DocAddText("obj_id", "Object hash");
+            if (first_parent && !has_base && commit.parent_ids.size != 0) {
+                has_base = true;
+                Env::Memcpy(&base_commit, &commit.parent_ids.ptr[0],
+                            sizeof(base_commit));
             }
-            {
-                Env::DocGroup gr_method("repo_get_commit_from_data");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("data", "Commit data");
-                Env::DocAddText("obj_id", "Object hash");
+            Env::Memcpy(&tree_oid, &commit.tree_id, sizeof(tree_oid));
+            FreeCommit(commit);
+            return true;
+        };
+        if (!read_commit(new_commit, root.entry.new_oid, true)) {
+            return OnError("no commit in data");
+        }
+        root.entry.sides = DiffEntry::kNew;
+        if (has_base) {
+            if (!read_commit(base_commit, root.entry.old_oid, false)) {
+                return OnError("no base commit in data");
             }
-            {
-                Env::DocGroup gr_method("repo_get_tree");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_id", "Repo ID");
-                Env::DocAddText("obj_id", "Object hash");
+            root.entry.sides |= DiffEntry::kOld;
+        }
+    }
+
+    // entries of a missing tree are empty
+    struct Tree {
+        std::unique_ptr<uint8_t[]> buf;
+        mygit2::git_tree tree{};
+        ~Tree() {
+            if (tree.entries.ptr != nullptr) {
+                Env::Heap_Free(tree.entries.ptr);
             }
-            {
-                Env::DocGroup gr_method("repo_get_tree_from_data");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("data", "Commit data");
-                Env::DocAddText("obj_id", "Object hash");
+        }
+    };
+    auto load_tree = [&objects](const GitOid& oid, Tree& tree) {
+        uint32_t size = 0;
+        tree.buf = objects.Load(oid, size);
+        return tree.buf != nullptr &&
+               tree_parse(&tree.tree,
+                          reinterpret_cast<const char*>(tree.buf.get()),
+                          size) == 0;
+    };
+    char oid_buffer[GIT_OID_HEXSZ + 1];
+    oid_buffer[GIT_OID_HEXSZ] = '\0';
+    auto add_oid = [&oid_buffer](const char* name,
+                                 const mygit2::git_tree_entry* entry) {
+        if (entry != nullptr) {
+            git_oid_fmt(oid_buffer, entry->oid);
+            Env::DocAddText(name, oid_buffer);
+        }
+    };
+    std::vector<char> path;
+
+    {
+        Env::DocArray changes("changes");
+        for (uint32_t walked = 0; !stack.empty() && walked < limit;
+             ++walked) {
+            auto dir = std::move(stack.back());
+            stack.pop_back();
+            Tree old_tree;
+            Tree new_tree;
+            if (((dir.entry.sides & DiffEntry::kOld) != 0 &&
+                 !load_tree(dir.entry.old_oid, old_tree)) ||
+                ((dir.entry.sides & DiffEntry::kNew) != 0 &&
+                 !load_tree(dir.entry.new_oid, new_tree))) {
+                return OnError("no tree in data");
             }
-            {
-                Env::DocGroup gr_method("list_commits");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_id", "Repo ID");
+            const auto& old_entries = old_tree.tree.entries;
+            const auto& new_entries = new_tree.tree.entries;
+            // lists the change of a blob or queues the trees to compare
+            auto add_change = [&](const mygit2::git_tree_entry* old_entry,
+                                  const mygit2::git_tree_entry* new_entry) {
+                const auto* entry = new_entry ? new_entry : old_entry;
+                path = dir.path;
+                path.insert(path.end(), entry->filename,
+                            entry->filename + entry->filename_len);
+                if (entry->attr == kGitTreeMode) {
+                    auto& sub = stack.emplace_back();
+                    sub.entry.sides = 0;
+                    if (old_entry != nullptr) {
+                        sub.entry.sides |= DiffEntry::kOld;
+                        Env::Memcpy(&sub.entry.old_oid, old_entry->oid,
+                                    sizeof(GitOid));
+                    }
+                    if (new_entry != nullptr) {
+                        sub.entry.sides |= DiffEntry::kNew;
+                        Env::Memcpy(&sub.entry.new_oid, new_entry->oid,
+                                    sizeof(GitOid));
+                    }
+                    path.push_back('/');
+                    sub.entry.path_len = static_cast<uint16_t>(path.size());
+                    sub.path = std::move(path);
+                    return;
+                }
+                path.push_back('\0');
+                const char* status = "modified";
+                if (old_entry == nullptr) {
+                    status = "added";
+                } else if (new_entry == nullptr) {
+                    status = "removed";
+                }
+                Env::DocGroup change("");
+                Env::DocAddText("path", path.data());
+                Env::DocAddText("status", status);
+                add_oid("old_oid", old_entry);
+                add_oid("new_oid", new_entry);
+                Env::DocAddNum("attributes",
+                               static_cast<uint32_t>(entry->attr));
+            };
+            size_t i = 0;
+            size_t j = 0;
+            while (i < old_entries.size || j < new_entries.size) {
+                const auto* old_entry =
+                    i < old_entries.size ? &old_entries.ptr[i] : nullptr;
+                const auto* new_entry =
+                    j < new_entries.size ? &new_entries.ptr[j] : nullptr;
+                int res = 0;
+                if (old_entry == nullptr) {
+                    res = 1;
+                } else if (new_entry == nullptr) {
+                    res = -1;
+                } else {
+                    res = CompareTreeEntries(*old_entry, *new_entry);
+                }
+                if (res < 0) {
+                    add_change(old_entry, nullptr);
+                    ++i;
+                } else if (res > 0) {
+                    add_change(nullptr, new_entry);
+                    ++j;
+                } else {
+                    if (old_entry->attr != new_entry->attr ||
+                        Env::Memcmp(old_entry->oid, new_entry->oid,
+                                    sizeof(GitOid)) != 0) {
+                        add_change(old_entry, new_entry);
+                    }
+                    ++i;
+                    ++j;
+                }
             }
-            {
-                Env::DocGroup gr_method("list_trees");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("repo_id", "Repo ID");
+        }
+    }
+    if (!stack.empty()) {
+        std::vector<uint8_t> pending;
+        for (const auto& dir : stack) {
+            const auto* entry = reinterpret_cast<const uint8_t*>(&dir.entry);
+            pending.insert(pending.end(), entry, entry + sizeof(DiffEntry));
+            pending.insert(pending.end(), dir.path.begin(), dir.path.end());
+        }
+        Env::DocAddBlob("pending", pending.data(),
+                        static_cast<uint32_t>(pending.size()));
+    }
+}
+
+// Returns the number of the repo objects which have no type keys, they were
+// stored before the type index
+sourc3::GitObject::Id GetLegacyObjectsNumber(const ContractID& cid,
+                                             sourc3::Repo::Id repo_id) {
+    using sourc3::GitObject;
+    using sourc3::Repo;
+    if (repo_id >= LoadLegacyState(cid).last_repo_id) {
+        return 0;
+    }
+    Env::Key_T<GitObject::Meta::LegacyKey> legacy_key{
+        .m_KeyInContract = GitObject::Meta::LegacyKey(repo_id)};
+    legacy_key.m_Prefix.m_Cid = cid;
+    GitObject::Id number = 0;
+    if (Env::VarReader::Read_T(legacy_key, number)) {
+        return number;
+    }
+    Env::Key_T<Repo::Key> repo_key{.m_KeyInContract = Repo::Key(repo_id)};
+    repo_key.m_Prefix.m_Cid = cid;
+    Repo repo;  // the name is not needed
+    uint32_t key_len = 0, value_len = sizeof(repo);
+    if (!Env::VarReader(repo_key, repo_key)
+             .MoveNext(nullptr, key_len, &repo, value_len, 0)) {
+        return 0;
+    }
+    return repo.cur_objs_number;
+}
+
+// Lists the objects of the type stored before the type index by scanning
+// the meta records of the repo. The page counts the scanned records, it may
+// list fewer. Returns false if the page is full, the index listing follows
+// otherwise
+bool ListLegacyObjects(const ContractID& cid, sourc3::Repo::Id repo_id,
+                       sourc3::GitObject::Meta::Type type, Page& page) {
+    using sourc3::GitObject;
+    auto legacy_number = GetLegacyObjectsNumber(cid, repo_id);
+    if (legacy_number == 0 || Page::StartsFrom<GitObject::Meta::TypeKey>()) {
+        return true;
+    }
+    MetaKey start{.m_KeyInContract =
+                      page.GetStart(GitObject::Meta::Key(repo_id, 0))};
+    MetaKey end{.m_KeyInContract = {
+                    repo_id, std::numeric_limits<GitObject::Id>::max()}};
+    start.m_Prefix.m_Cid = cid;
+    end.m_Prefix.m_Cid = cid;
+
+    MetaKey key = start;
+    GitObject::Meta value;
+    for (Env::VarReader reader(start, end); reader.MoveNext_T(key, value);) {
+        if (!page.Add(key.m_KeyInContract)) {
+            return false;
+        }
+        if (value.id < legacy_number && (value.type & 0x7f) == type) {
+            Env::DocGroup obj("");
+            Env::DocAddBlob_T("object_hash", value.hash);
+            Env::DocAddNum("object_type", static_cast<uint32_t>(value.type));
+            Env::DocAddNum("object_size", value.data_size);
+        }
+    }
+    return true;
+}
+
+// Lists the commits or the trees: the ones stored before the type index,
+// the indexed ones and the packed ones. A page ends at a pack boundary
+void GetObjects(const ContractID& cid,
+                sourc3::GitObject::Meta::Type type) {
+    using sourc3::GitObject;
+    using sourc3::Pack;
+    using TypeKey = Env::Key_T<GitObject::Meta::TypeKey>;
+    sourc3::Repo::Id repo_id = 0;
+    Env::DocGet("repo_id", repo_id);
+    Page page;
+    TypeKey start{.m_KeyInContract = page.GetStart(
+                      GitObject::Meta::TypeKey(repo_id, type, 0))};
+    TypeKey end{.m_KeyInContract = {
+                    repo_id, type, std::numeric_limits<GitObject::Id>::max()}};
+    start.m_Prefix.m_Cid = cid;
+    end.m_Prefix.m_Cid = cid;
+    // the keys of the packs have the layout of the meta keys of the legacy
+    // listing, the tag tells which of them the page starts from
+    auto pack_start = page.GetStart(GitObject::Meta::Key(repo_id, 0));
+    bool from_packs = Page::StartsFrom<Pack::IndexKey>() &&
+                      pack_start.tag == sourc3::kPackIndex;
+    auto add_object = [](int8_t type, const sourc3::GitOid& hash,
+                         uint32_t size) {
+        Env::DocGroup obj("");
+        Env::DocAddBlob_T("object_hash", hash);
+        Env::DocAddNum("object_type", static_cast<uint32_t>(type));
+        Env::DocAddNum("object_size", size);
+    };
+
+    TypeKey key = start;
+    GitObject::Meta value;
+    {
+        Env::DocArray objects("objects");
+        if (!from_packs && ListLegacyObjects(cid, repo_id, type, page)) {
+            for (Env::VarReader reader(start, end);
+                 reader.MoveNext_T(key, value) &&
+                 page.Add(key.m_KeyInContract);) {
+                add_object(value.type, value.hash, value.data_size);
             }
-            {
-                Env::DocGroup gr_method("list_projects");
-                Env::DocAddText("cid", "ContractID");
+        }
+        if (!page.HasNext()) {
+            // the pack ids are big-endian
+            Pack::IndexKey first(
+                repo_id, from_packs ? Utils::FromBE(pack_start.obj_id) : 0);
+            auto is_listed = [type](const Pack::Entry& entry) {
+                return (entry.type & 0x7f) == type;
+            };
+            ForEachPack(cid, first,
+                        [&](const Pack::IndexKey& key,
+                            const Pack::Entry* index, size_t count) {
+                            auto listed = static_cast<uint32_t>(
+                                std::count_if(index, index + count,
+                                              is_listed));
+                            if (!page.Add(key, listed)) {
+                                return true;
+                            }
+                            for (size_t i = 0; i < count; ++i) {
+                                if (is_listed(index[i])) {
+                                    add_object(index[i].type, index[i].hash,
+                                               index[i].data_size);
+                                }
+                            }
+                            return false;
+                        });
+        }
+    }
+    page.AddNext();
+}
+
+void OnActionGetCommits(const ContractID& cid) {
+    GetObjects(cid, sourc3::GitObject::Meta::kGitObjectCommit);
+}
+
+void OnActionGetTrees(const ContractID& cid) {
+    GetObjects(cid, sourc3::GitObject::Meta::kGitObjectTree);
+}
+
+// Deletes up to 'limit' vars of a removed repo: its objects, the chunks of
+// the uploads which were never completed, packs, buckets, refs and members.
+// The action is repeated after the transaction of the last call completes,
+// until it reports done. The members of a repo created before the member
+// index are found by scanning the members of all repos, 'limit' bounds the
+// scanned keys as well and 'next' is passed back as 'start_key'
+void OnActionCleanupRepo(const ContractID& cid) {
+    using sourc3::GitObject;
+    using sourc3::GitRef;
+    using sourc3::Hash256;
+    using sourc3::Pack;
+    using sourc3::Repo;
+    using sourc3::method::CleanupRepo;
+    using Member = sourc3::Members<sourc3::kRepoMember, Repo>;
+
+    Repo::Id repo_id;
+    if (!Env::DocGet("repo_id", repo_id)) {
+        return OnError("failed to read 'repo_id'");
+    }
+    uint32_t limit = 256;
+    Env::DocGetNum32("limit", &limit);
+    if (limit == 0) {
+        return OnError("'limit' must not be 0");
+    }
+    if (!VarExists(cid, Repo::TombstoneKey(repo_id))) {
+        return OnError("repo is not removed");
+    }
+
+    std::vector<GitObject::Id> objects;
+    std::vector<CleanupRepo::Chunk> chunks;
+    std::vector<GitObject::Id> packs;
+    std::vector<uint8_t> buckets;
+    std::vector<Hash256> refs;
+    std::vector<PubKey> members;
+    uint32_t chunks_limit = 0;
+    uint32_t count = 0;  // of the deleted vars
+    bool more = false;
+    // a record which alone exceeds the limit is still taken
+    auto take = [&](uint32_t vars) {
+        if (count != 0 && count + vars > limit) {
+            more = true;
+            return false;
+        }
+        count += vars;
+        return true;
+    };
+
+    {
+        auto [start, end, key] = PrepareGetObject(cid);
+        GitObject::Meta value;
+        for (Env::VarReader reader(start, end);
+             !more && reader.MoveNext_T(key, value);) {
+            // the meta record and the type key
+            uint32_t vars = GitObject::Meta::IsIndexed(value.type) ? 2 : 1;
+            uint32_t chunks_number = 0;
+            if (VarExists(cid,
+                          GitObject::Shared::MemberKey(repo_id, value.hash))) {
+                ++vars;
+            } else {
+                chunks_number = GetChunksNumber(cid, repo_id, value.hash);
+                vars += chunks_number + 1;  // the data or the marker
             }
-            {
-                Env::DocGroup gr_method("list_project_repos");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("project_id", "Project ID");
+            if (chunks_number != 0 && count + vars > limit) {
+                // the last chunks, the object is deleted by the next calls
+                if (count < limit) {
+                    chunks_limit += limit - count;
+                    count = limit;
+                    objects.push_back(value.id);
+                }
+                more = true;
+            } else if (take(vars)) {
+                chunks_limit += chunks_number;
+                objects.push_back(value.id);
             }
-            {
-                Env::DocGroup gr_method("list_project_members");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("project_id", "Project ID");
+        }
+    }
+    {
+        // the chunks of the objects which were never completed have no meta,
+        // the chunks of the complete ones are deleted with their objects
+        using ChunkKey = Env::Key_T<GitObject::Chunked::ChunkKey>;
+        ChunkKey start{.m_KeyInContract = {repo_id, sourc3::GitOid{}, 0}};
+        _POD_(start.m_KeyInContract.hash).SetZero();
+        start.m_Prefix.m_Cid = cid;
+        ChunkKey end = start;
+        _POD_(end.m_KeyInContract.hash).SetObject(0xff);
+        end.m_KeyInContract.index = std::numeric_limits<uint32_t>::max();
+        ChunkKey key = start;
+        uint32_t key_len = sizeof(key), value_len = 0;
+        for (Env::VarReader reader(start, end);
+             !more && reader.MoveNext(&key, key_len, nullptr, value_len, 0);
+             key_len = sizeof(key), value_len = 0) {
+            const auto& hash = key.m_KeyInContract.hash;
+            if (!VarExists(cid,
+                           GitObject::Chunked::MarkerKey(repo_id, hash)) &&
+                take(1)) {
+                chunks.push_back(
+                    {hash, Utils::FromBE(key.m_KeyInContract.index)});
             }
-            {
-                Env::DocGroup gr_method("list_organizations");
-                Env::DocAddText("cid", "ContractID");
+        }
+    }
+    {
+        using IndexKey = Env::Key_T<Pack::IndexKey>;
+        IndexKey start{.m_KeyInContract = {repo_id, 0}};
+        IndexKey end{.m_KeyInContract = {
+                         repo_id, std::numeric_limits<GitObject::Id>::max()}};
+        start.m_Prefix.m_Cid = cid;
+        end.m_Prefix.m_Cid = cid;
+        IndexKey key = start;
+        uint32_t key_len = sizeof(key), value_len = 0;
+        for (Env::VarReader reader(start, end);
+             !more && reader.MoveNext(&key, key_len, nullptr, value_len, 0);
+             key_len = sizeof(key), value_len = 0) {
+            if (take(2)) {  // the index and the data
+                packs.push_back(Utils::FromBE(key.m_KeyInContract.first_id));
             }
-            {
-                Env::DocGroup gr_method("list_organization_projects");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("organization_id", "Organization ID");
+        }
+    }
+    {
+        using BucketKey = Env::Key_T<Pack::BucketKey>;
+        BucketKey start{.m_KeyInContract = {repo_id, uint8_t{0}}};
+        BucketKey end{.m_KeyInContract = {repo_id, uint8_t{0xff}}};
+        start.m_Prefix.m_Cid = cid;
+        end.m_Prefix.m_Cid = cid;
+        BucketKey key = start;
+        uint32_t key_len = sizeof(key), value_len = 0;
+        for (Env::VarReader reader(start, end);
+             !more && reader.MoveNext(&key, key_len, nullptr, value_len, 0);
+             key_len = sizeof(key), value_len = 0) {
+            if (take(1)) {
+                buckets.push_back(key.m_KeyInContract.prefix);
             }
-            {
-                Env::DocGroup gr_method("list_organization_members");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("organization_id", "Organization ID");
+        }
+    }
+    {
+        using RefKey = Env::Key_T<GitRef::Key>;
+        RefKey start, end;
+        start.m_KeyInContract.repo_id = Utils::FromBE(repo_id);
+        _POD_(start.m_Prefix.m_Cid) = cid;
+        _POD_(start.m_KeyInContract.name_hash).SetZero();
+        _POD_(end) = start;
+        _POD_(end.m_KeyInContract.name_hash).SetObject(0xff);
+        RefKey key;
+        uint32_t key_len = sizeof(key), value_len = 0;
+        for (Env::VarReader reader(start, end);
+             !more && reader.MoveNext(&key, key_len, nullptr, value_len, 0);
+             key_len = sizeof(key), value_len = 0) {
+            if (take(1)) {
+                refs.push_back(key.m_KeyInContract.name_hash);
             }
-            {
-                Env::DocGroup gr_method("add_project_member");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("project_id", "Project ID");
-                Env::DocAddText("member", "Member");
-                Env::DocAddText("permissions", "Permissions");
-                Env::DocAddText("pid", "uint32_t");
+        }
+    }
+    if (!more && repo_id >= LoadLegacyState(cid).last_repo_id) {
+        using IndexKey = Env::Key_T<Repo::MemberKey>;
+        IndexKey start{.m_KeyInContract = {repo_id, PubKey{}}};
+        _POD_(start.m_KeyInContract.user).SetZero();
+        start.m_Prefix.m_Cid = cid;
+        IndexKey end = start;
+        _POD_(end.m_KeyInContract.user).SetObject(0xff);
+        IndexKey key = start;
+        uint8_t value = 0;
+        for (Env::VarReader reader(start, end);
+             !more && reader.MoveNext_T(key, value);) {
+            if (take(2)) {  // the member and the index key
+                members.push_back(key.m_KeyInContract.user);
             }
-            {
-                Env::DocGroup gr_method("modify_project_member");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("project_id", "Project ID");
-                Env::DocAddText("member", "Member");
-                Env::DocAddText("permissions", "Permissions");
-                Env::DocAddText("pid", "uint32_t");
+        }
+    } else if (!more) {
+        using MemberKey = Env::Key_T<Member::Key>;
+        MemberKey start{.m_Prefix = {.m_Cid = cid},
+                        .m_KeyInContract = Member::Key{PubKey{}, 0}};
+        _POD_(start.m_KeyInContract.user).SetZero();
+        MemberKey end = start;
+        _POD_(end.m_KeyInContract.user).SetObject(0xFF);
+        end.m_KeyInContract.id = std::numeric_limits<Repo::Id>::max();
+        if (Env::DocGetBlob("start_key", nullptr, 0) == sizeof(Member::Key)) {
+            Env::DocGetBlob("start_key", &start.m_KeyInContract,
+                            sizeof(Member::Key));
+        }
+        MemberKey key = start;
+        sourc3::UserInfo info;
+        uint32_t scanned = 0;
+        for (Env::VarReader reader(start, end);
+             !more && reader.MoveNext_T(key, info);) {
+            const auto& user = key.m_KeyInContract.user;
+            bool found = key.m_KeyInContract.id == repo_id;
+            uint32_t vars = 1;
+            if (found && VarExists(cid, Repo::MemberKey(repo_id, user))) {
+                ++vars;
             }
-            {
-                Env::DocGroup gr_method("remove_project_member");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("project_id", "Project ID");
-                Env::DocAddText("member", "Member");
-                Env::DocAddText("pid", "uint32_t");
+            if (scanned++ == limit || (found && !take(vars))) {
+                more = true;
+                Env::DocAddBlob_T("next", key.m_KeyInContract);
+            } else if (found) {
+                members.push_back(user);
             }
-            {
-                Env::DocGroup gr_method("add_organization_member");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("organization_id", "Organization ID");
-                Env::DocAddText("member", "Member");
-                Env::DocAddText("permissions", "Permissions");
-                Env::DocAddText("pid", "uint32_t");
+        }
+    }
+    if (!more) {  // the tombstone and the number of the legacy objects
+        count += VarExists(cid, GitObject::Meta::LegacyKey(repo_id)) ? 2 : 1;
+    }
+
+    auto args_size = sizeof(CleanupRepo) +
+                     sizeof(GitObject::Id) * (objects.size() + packs.size()) +
+                     sizeof(CleanupRepo::Chunk) * chunks.size() +
+                     buckets.size() + sizeof(Hash256) * refs.size() +
+                     sizeof(PubKey) * members.size();
+    auto buf = std::make_unique<uint8_t[]>(args_size);
+    auto* params = reinterpret_cast<CleanupRepo*>(buf.get());
+    params->repo_id = repo_id;
+    params->objects_number = objects.size();
+    params->chunks_number = chunks.size();
+    params->packs_number = packs.size();
+    params->buckets_number = buckets.size();
+    params->refs_number = refs.size();
+    params->members_number = members.size();
+    params->chunks_limit = chunks_limit;
+    params->done = more ? 0 : 1;
+    auto* p = reinterpret_cast<uint8_t*>(params + 1);
+    auto append = [&p](const auto& items) {
+        auto size = sizeof(items[0]) * items.size();
+        if (size != 0) {
+            Env::Memcpy(p, items.data(), size);
+            p += size;
+        }
+    };
+    append(objects);
+    append(chunks);
+    append(packs);
+    append(buckets);
+    append(refs);
+    append(members);
+    Env::DocAddNum32("deleted", count);
+    Env::DocAddNum32("done", params->done);
+
+    UserKey user_key(cid);
+    user_key.Get(params->caller);
+    SigRequest sig;
+    user_key.FillSigRequest(sig);
+
+    Env::GenerateKernel(/*pCid=*/&cid,
+                        /*iMethod=*/CleanupRepo::kMethod,
+                        /*pArgs=*/params,
+                        /*nArgs=*/args_size,
+                        /*pFunds=*/nullptr,
+                        /*nFunds=*/0,
+                        /*pSig=*/&sig,
+                        /*nSig=*/1,
+                        /*szComment=*/"cleanup repo",
+                        /*nCharge=*/1000000 + 100000 * count);
+}
+
+// Parameter of an action, the schema shows it as the name and its description
+struct ActionParam {
+    std::string_view name;
+    std::string_view description;
+};
+
+constexpr size_t kMaxActionParams = 10;
+
+struct Action {
+    std::string_view role;
+    std::string_view name;
+    ActionFunc handler;
+    ActionParam params[kMaxActionParams];  // ends with an empty name
+};
+
+constexpr std::string_view kRoles[] = {"manager", "user"};
+
+// Method_0 lists the actions of each role in this order and Method_1
+// dispatches them, add new actions here
+constexpr Action kActions[] = {
+    {"manager", "create_contract", OnActionCreateContract,
+     {{"cid", "ContractID"},
+      {"hUpgradeDelay", "Height"},
+      {"nMinApprovers", "uint32_t"},
+      {"bSkipVerifyVer", "uint32_t"}}},
+    {"manager", "schedule_upgrade", OnActionScheduleUpgrade,
+     {{"cid", "ContractID"},
+      {"hTarget", "Height"},
+      {"bSkipVerifyVer", "uint32_t"},
+      {"iSender", "uint32_t"},
+      {"approve_mask", "uint32_t"}}},
+    {"manager", "explicit_upgrade", OnActionExplicitUpgrade,
+     {{"cid", "ContractID"}}},
+    {"manager", "my_admin_key", OnActionMyAdminKey, {}},
+    {"manager", "destroy_contract", OnActionDestroyContract,
+     {{"cid", "ContractID"}}},
+    {"manager", "view_contracts", OnActionViewContracts, {}},
+    {"manager", "view_contract_params", OnActionViewContractParams,
+     {{"cid", "ContractID"}}},
+    {"user", "create_repo", OnActionCreateRepo,
+     {{"cid", "ContractID"},
+      {"repo_name", "Name of repo"},
+      {"project_id", "Project ID"},
+      {"pid", "uint32_t"}}},
+    {"user", "create_project", OnActionCreateProject,
+     {{"cid", "ContractID"},
+      {"name", "Name of project"},
+      {"organization_id", "Organization ID"},
+      {"pid", "uint32_t"}}},
+    {"user", "modify_project", OnActionModifyProject,
+     {{"cid", "ContractID"},
+      {"name", "Name of project"},
+      {"project_id", "Project ID"},
+      {"organization_id", "Organization ID"},
+      {"pid", "uint32_t"}}},
+    {"user", "remove_project", OnActionRemoveProject,
+     {{"cid", "ContractID"},
+      {"project_id", "Project ID"},
+      {"pid", "uint32_t"}}},
+    {"user", "create_organization", OnActionCreateOrganization,
+     {{"cid", "ContractID"},
+      {"name", "Name of organization"},
+      {"pid", "uint32_t"}}},
+    {"user", "modify_organization", OnActionModifyOrganization,
+     {{"cid", "ContractID"},
+      {"name", "Name of organization"},
+      {"organization_id", "Organization ID"},
+      {"pid", "uint32_t"}}},
+    {"user", "remove_organization", OnActionRemoveOrganization,
+     {{"cid", "ContractID"},
+      {"organization_id", "Organization ID"},
+      {"pid", "uint32_t"}}},
+    {"user", "my_repos", OnActionMyRepos,
+     {{"cid", "ContractID"},
+      {"pid", "uint32_t"},
+      {"start_key", "Key of the first record"},
+      {"limit", "uint32_t"}}},
+    {"user", "all_repos", OnActionAllRepos,
+     {{"cid", "ContractID"},
+      {"start_key", "Key of the first record"},
+      {"limit", "uint32_t"}}},
+    {"user", "modify_repo", OnActionModifyRepo,
+     {{"cid", "ContractID"},
+      {"repo_name", "Name of repo"},
+      {"repo_id", "Repo ID"},
+      {"pid", "uint32_t"}}},
+    {"user", "delete_repo", OnActionDeleteRepo,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"pid", "uint32_t"}}},
+    {"user", "cleanup_repo", OnActionCleanupRepo,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"limit", "uint32_t"},
+      {"start_key", "'next' of the last call"},
+      {"pid", "uint32_t"}}},
+    {"user", "add_user_params", OnActionAddUserParams,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"user", "User PubKey"},
+      {"permissions", "permissions"},
+      {"pid", "uint32_t"}}},
+    {"user", "modify_user_params", OnActionModifyUserParams,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"user", "User PubKey"},
+      {"permissions", "permissions"},
+      {"pid", "uint32_t"}}},
+    {"user", "remove_user_params", OnActionRemoveUserParams,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"user", "User PubKey"},
+      {"pid", "uint32_t"}}},
+    {"user", "push_objects", OnActionPushObjects,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"data", "Push objects"},
+      {"ref", "Objects ref"},
+      {"ref_target", "Objects ref target"},
+      {"skip_existing", "uint32_t"},
+      {"shared", "uint32_t"},
+      {"pack", "uint32_t"},
+      {"pid", "uint32_t"}}},
+    {"user", "push_object_chunk", OnActionPushObjectChunk,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"obj_id", "Object hash"},
+      {"obj_type", "uint32_t"},
+      {"obj_size", "uint32_t"},
+      {"chunks", "Number of chunks"},
+      {"chunk", "Chunk index"},
+      {"data", "Chunk data"},
+      {"pid", "uint32_t"}}},
+    {"user", "push_refs", OnActionPushRefs,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"ref", "Ref name"},
+      {"ref_target", "Ref target"},
+      {"ref_old_target", "Expected ref target"},
+      {"pid", "uint32_t"}}},
+    {"user", "list_refs", OnActionListRefs,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"pid", "uint32_t"},
+      {"start_key", "Key of the first record"},
+      {"limit", "uint32_t"}}},
+    {"user", "get_key", OnActionUserGetKey,
+     {{"cid", "ContractID"},
+      {"pid", "uint32_t"}}},
+    {"user", "repo_id_by_name", OnActionUserGetRepo,
+     {{"cid", "ContractID"},
+      {"repo_name", "Name of repo"},
+      {"repo_owner", "Owner key of repo"}}},
+    {"user", "project_id_by_name", OnActionProjectByName,
+     {{"cid", "ContractID"},
+      {"name", "Name of project"},
+      {"owner", "Owner key of project"}}},
+    {"user", "organization_id_by_name", OnActionOrganizationByName,
+     {{"cid", "ContractID"},
+      {"name", "Name of organization"},
+      {"owner", "Owner key of organization"}}},
+    {"user", "repo_get_data", OnActionGetRepoData,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"obj_id", "Object hash"},
+      {"chunk", "Chunk index of chunked objects"}}},
+    {"user", "repo_get_meta", OnActionGetRepoMeta,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"start_key", "Key of the first record"},
+      {"limit", "uint32_t"}}},
+    {"user", "repo_get_commit", OnActionGetCommit,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"obj_id", "Object hash"}}},
+    {"user", "repo_get_commit_from_data", OnActionGetCommitFromData,
+     {{"cid", "ContractID"},
+      {"data", "Commit data"},
+      {"obj_id", "Object hash"}}},
+    {"user", "repo_get_tree", OnActionGetTree,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"obj_id", "Object hash"}}},
+    {"user", "repo_get_tree_from_data", OnActionGetTreeFromData,
+     {{"cid", "ContractID"},
+      {"data", "Commit data"},
+      {"obj_id", "Object hash"}}},
+    {"user", "repo_negotiate", OnActionNegotiate,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"wants", "Hashes of the wanted commits, ignored with 'pending'"},
+      {"haves", "Hashes of the commits and trees the client has and of "
+                "the ones listed by the earlier calls"},
+      {"pending", "Pending walk of the last call"},
+      {"limit", "uint32_t"}}},
+    {"user", "repo_log", OnActionLog,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"obj_id", "Hash of the first commit"},
+      {"ref", "Ref of the first commit"},
+      {"pending", "Pending walk of the last call"},
+      {"limit", "uint32_t"}}},
+    {"user", "repo_get_path", OnActionGetPath,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"obj_id", "Commit hash"},
+      {"ref", "Ref of the commit"},
+      {"path", "Path of the entry"},
+      {"with_data", "uint32_t"}}},
+    {"user", "repo_diff_trees", OnActionDiffTrees,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"obj_id", "Commit hash"},
+      {"ref", "Ref of the commit"},
+      {"base_id", "Hash of the base commit"},
+      {"pending", "Pending walk of the last call"},
+      {"limit", "uint32_t"}}},
+    {"user", "list_commits", OnActionGetCommits,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"start_key", "Key of the first record"},
+      {"limit", "uint32_t"}}},
+    {"user", "list_trees", OnActionGetTrees,
+     {{"cid", "ContractID"},
+      {"repo_id", "Repo ID"},
+      {"start_key", "Key of the first record"},
+      {"limit", "uint32_t"}}},
+    {"user", "list_projects", OnActionListProjects,
+     {{"cid", "ContractID"},
+      {"start_key", "Key of the first record"},
+      {"limit", "uint32_t"}}},
+    {"user", "list_project_repos", OnActionListProjectRepos,
+     {{"cid", "ContractID"},
+      {"project_id", "Project ID"},
+      {"start_key", "Key of the first record"},
+      {"limit", "uint32_t"}}},
+    {"user", "list_project_members", OnActionListProjectMembers,
+     {{"cid", "ContractID"},
+      {"project_id", "Project ID"},
+      {"start_key", "Key of the first record"},
+      {"limit", "uint32_t"}}},
+    {"user", "list_organizations", OnActionListOrganizations,
+     {{"cid", "ContractID"},
+      {"start_key", "Key of the first record"},
+      {"limit", "uint32_t"}}},
+    {"user", "list_organization_projects", OnActionListOrganizationProjects,
+     {{"cid", "ContractID"},
+      {"organization_id", "Organization ID"},
+      {"start_key", "Key of the first record"},
+      {"limit", "uint32_t"}}},
+    {"user", "list_organization_members", OnActionListOrganizationMembers,
+     {{"cid", "ContractID"},
+      {"organization_id", "Organization ID"},
+      {"start_key", "Key of the first record"},
+      {"limit", "uint32_t"}}},
+    {"user", "add_project_member", OnActionAddProjectMember,
+     {{"cid", "ContractID"},
+      {"project_id", "Project ID"},
+      {"member", "Member"},
+      {"permissions", "Permissions"},
+      {"pid", "uint32_t"}}},
+    {"user", "modify_project_member", OnActionModifyProjectMember,
+     {{"cid", "ContractID"},
+      {"project_id", "Project ID"},
+      {"member", "Member"},
+      {"permissions", "Permissions"},
+      {"pid", "uint32_t"}}},
+    {"user", "remove_project_member", OnActionRemoveProjectMember,
+     {{"cid", "ContractID"},
+      {"project_id", "Project ID"},
+      {"member", "Member"},
+      {"pid", "uint32_t"}}},
+    {"user", "add_organization_member", OnActionAddOrganizationMember,
+     {{"cid", "ContractID"},
+      {"organization_id", "Organization ID"},
+      {"member", "Member"},
+      {"permissions", "Permissions"},
+      {"pid", "uint32_t"}}},
+    {"user", "modify_organization_member", OnActionModifyOrganizationMember,
+     {{"cid", "ContractID"},
+      {"organization_id", "Organization ID"},
+      {"member", "Member"},
+      {"permissions", "Permissions"},
+      {"pid", "uint32_t"}}},
+    {"user", "remove_organization_member", OnActionRemoveOrganizationMember,
+     {{"cid", "ContractID"},
+      {"organization_id", "Organization ID"},
+      {"member", "Member"},
+      {"pid", "uint32_t"}}},
+};
+
+constexpr size_t kActionsNumber = std::size(kActions);
+
+constexpr uint32_t HashAction(std::string_view role, std::string_view name) {
+    uint32_t hash = 2166136261u;  // FNV-1a of "role/name"
+    for (char c : role) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    hash = (hash ^ static_cast<uint8_t>('/')) * 16777619u;
+    for (char c : name) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+constexpr bool IsRole(std::string_view role) {
+    for (auto r : kRoles) {
+        if (r == role) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Names fit the buffers of Method_1, roles are known and actions are unique
+constexpr bool AreActionsValid() {
+    for (size_t i = 0; i < kActionsNumber; ++i) {
+        const auto& action = kActions[i];
+        if (action.name.size() >= kActionBufSize ||
+            action.role.size() >= kRoleBufSize || !IsRole(action.role)) {
+            return false;
+        }
+        for (size_t j = 0; j < i; ++j) {
+            if (kActions[j].role == action.role &&
+                kActions[j].name == action.name) {
+                return false;
             }
-            {
-                Env::DocGroup gr_method("modify_organization_member");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("organization_id", "Organization ID");
-                Env::DocAddText("member", "Member");
-                Env::DocAddText("permissions", "Permissions");
-                Env::DocAddText("pid", "uint32_t");
+        }
+    }
+    return true;
+}
+
+static_assert(AreActionsValid(), "Invalid or duplicate action");
+
+// Open addressing table of the actions by HashAction, a slot holds the
+// index of the action plus one or zero when it is empty
+constexpr size_t kDispatchSize = 128;
+static_assert((kDispatchSize & (kDispatchSize - 1)) == 0 &&
+                  kDispatchSize >= 2 * kActionsNumber &&
+                  kActionsNumber < std::numeric_limits<uint8_t>::max(),
+              "Increase kDispatchSize");
+
+constexpr std::array<uint8_t, kDispatchSize> MakeDispatchTable() {
+    std::array<uint8_t, kDispatchSize> table{};
+    for (size_t i = 0; i < kActionsNumber; ++i) {
+        const auto& action = kActions[i];
+        size_t slot =
+            HashAction(action.role, action.name) & (kDispatchSize - 1);
+        while (table[slot] != 0) {
+            slot = (slot + 1) & (kDispatchSize - 1);
+        }
+        table[slot] = static_cast<uint8_t>(i + 1);
+    }
+    return table;
+}
+
+constexpr auto kDispatchTable = MakeDispatchTable();
+
+const Action* FindAction(std::string_view role, std::string_view name) {
+    size_t slot = HashAction(role, name) & (kDispatchSize - 1);
+    for (; kDispatchTable[slot] != 0; slot = (slot + 1) & (kDispatchSize - 1)) {
+        const auto& action = kActions[kDispatchTable[slot] - 1];
+        if (action.role == role && action.name == name) {
+            return &action;
+        }
+    }
+    return nullptr;
+}
+}  // namespace
+
+BEAM_EXPORT void Method_0() {  // NOLINT
+    Env::DocGroup root("");
+    Env::DocGroup gr("roles");
+    for (auto role : kRoles) {
+        Env::DocGroup gr_role(role.data());
+        for (const auto& action : kActions) {
+            if (action.role != role) {
+                continue;
             }
-            {
-                Env::DocGroup gr_method("remove_organization_member");
-                Env::DocAddText("cid", "ContractID");
-                Env::DocAddText("organization_id", "Organization ID");
-                Env::DocAddText("member", "Member");
-                Env::DocAddText("pid", "uint32_t");
+            Env::DocGroup gr_method(action.name.data());
+            for (const auto& param : action.params) {
+                if (param.name.empty()) {
+                    break;
+                }
+                Env::DocAddText(param.name.data(), param.description.data());
             }
         }
     }
@@ -1779,64 +3840,6 @@ BEAM_EXPORT void Method_0() {  // NOLINT
 
 BEAM_EXPORT void Method_1() {  // NOLINT
     Env::DocGroup root("");
-    ActionsMap valid_user_actions = {
-        {"create_repo", OnActionCreateRepo},
-        {"create_project", OnActionCreateProject},
-        {"modify_project", OnActionModifyProject},
-        {"remove_project", OnActionRemoveProject},
-        {"create_organization", OnActionCreateOrganization},
-        {"modify_organization", OnActionModifyOrganization},
-        {"remove_organization", OnActionRemoveOrganization},
-        {"my_repos", OnActionMyRepos},
-        {"all_repos", OnActionAllRepos},
-        {"modify_repo", OnActionModifyRepo},
-        {"delete_repo", OnActionDeleteRepo},
-        {"add_user_params", OnActionAddUserParams},
-        {"modify_user_params", OnActionModifyUserParams},
-        {"remove_user_params", OnActionRemoveUserParams},
-        {"push_objects", OnActionPushObjects},
-        {"list_refs", OnActionListRefs},
-        {"get_key", OnActionUserGetKey},
-        {"repo_id_by_name", OnActionUserGetRepo},
-        {"project_id_by_name", OnActionProjectByName},
-        {"organization_id_by_name", OnActionOrganizationByName},
-        {"repo_get_data", OnActionGetRepoData},
-        {"repo_get_meta", OnActionGetRepoMeta},
-        {"repo_get_commit", OnActionGetCommit},
-        {"repo_get_commit_from_data", OnActionGetCommitFromData},
-        {"repo_get_tree", OnActionGetTree},
-        {"repo_get_tree_from_data", OnActionGetTreeFromData},
-        {"list_commits", OnActionGetCommits},
-        {"list_trees", OnActionGetTrees},
-        {"list_projects", OnActionListProjects},
-        {"list_project_repos", OnActionListProjectRepos},
-        {"list_project_members", OnActionListProjectMembers},
-        {"list_organizations", OnActionListOrganizations},
-        {"list_organization_projects", OnActionListOrganizationProjects},
-        {"list_organization_members", OnActionListOrganizationMembers},
-        {"add_project_member", OnActionAddProjectMember},
-        {"modify_project_member", OnActionModifyProjectMember},
-        {"remove_project_member", OnActionRemoveProjectMember},
-        {"add_organization_member", OnActionAddOrganizationMember},
-        {"modify_organization_member", OnActionModifyOrganizationMember},
-        {"remove_organization_member", OnActionRemoveOrganizationMember}};
-
-    ActionsMap valid_manager_actions = {
-        {"create_contract", OnActionCreateContract},
-        {"schedule_upgrade", OnActionScheduleUpgrade},
-        {"explicit_upgrade", OnActionExplicitUpgrade},
-        {"my_admin_key", OnActionMyAdminKey},
-        {"destroy_contract", OnActionDestroyContract},
-        {"view_contracts", OnActionViewContracts},
-        {"view_contract_params", OnActionViewContractParams},
-    };
-
-    /* Add your new role's actions here */
-
-    RolesMap valid_roles = {
-        {"user", valid_user_actions}, {"manager", valid_manager_actions},
-        /* Add your new role here */
-    };
 
     char action[kActionBufSize], role[kRoleBufSize];
 
@@ -1844,9 +3847,7 @@ BEAM_EXPORT void Method_1() {  // NOLINT
         return OnError("Role not specified");
     }
 
-    auto it_role = FindIfContains(role, valid_roles);
-
-    if (it_role == valid_roles.end()) {
+    if (!IsRole(role)) {
         return OnError("Invalid role");
     }
 
@@ -1854,12 +3855,12 @@ BEAM_EXPORT void Method_1() {  // NOLINT
         return OnError("Action not specified");
     }
 
-    auto it_action = FindIfContains(action, it_role->second);
+    const auto* found = FindAction(role, action);
 
-    if (it_action != it_role->second.end()) {
+    if (found != nullptr) {
         ContractID cid;
         Env::DocGet("cid", cid);
-        it_action->second(cid);
+        found->handler(cid);
     } else {
         return OnError("Invalid action");
     }
@@ -6,6 +6,7 @@
 
 #include <algorithm>
 #include <memory>
+#include <vector>
 
 using namespace sourc3;
 namespace {
@@ -38,11 +39,240 @@ void SaveNamedObject(const typename T::Key& key,
                  KeyTag::Internal);
 }
 
+// Renames an object with a name index (T::NameKey), the new name must not
+// be taken by another object of the creator
+template <class T>
+void RenameObject(const typename T::Id& id, const T& object, const char* name,
+                  size_t name_len) {
+    typename T::NameKey old_key(object.creator,
+                                GetNameHash(object.name, object.name_len));
+    typename T::NameKey new_key(object.creator, GetNameHash(name, name_len));
+    if (Env::Memcmp(&old_key, &new_key, sizeof(new_key)) != 0) {
+        Env::Halt_if(Env::LoadVar(&new_key, sizeof(new_key), nullptr, 0,
+                                  KeyTag::Internal) != 0u);
+        Env::DelVar_T(old_key);
+    }
+
+    std::unique_ptr<T> renamed(
+        static_cast<T*>(::operator new(sizeof(T) + name_len)));
+    Env::Memcpy(renamed.get(), &object, sizeof(T));
+    renamed->name_len = name_len;
+    Env::Memcpy(renamed->name, name, name_len);
+    SaveNamedObject(typename T::Key(id), renamed);
+    Env::SaveVar_T(new_key, id);
+}
+
 template <class T>
 bool ObjectExists(const typename T::Id& id) {
     typename T::Key key(id);
     return Env::LoadVar(&key, sizeof(key), nullptr, 0, KeyTag::Internal);
 }
+
+// Returns true if the slot refers to the object, the pack index is read up
+// to the entry
+bool IsPackEntry(Repo::Id repo_id, const Pack::Slot& slot,
+                 const GitOid& hash) {
+    Pack::IndexKey key(repo_id, slot.first_id);
+    auto index = std::make_unique<Pack::Entry[]>(slot.entry + 1);
+    uint32_t size = sizeof(Pack::Entry) * (slot.entry + 1);
+    return Env::LoadVar(&key, sizeof(key), index.get(), size,
+                        KeyTag::Internal) >= size &&
+           Env::Memcmp(&index[slot.entry].hash, &hash, sizeof(hash)) == 0;
+}
+
+// The buckets of the packed objects of a repo, each is loaded on the first
+// use. Save() writes the changed ones
+class PackBuckets {
+public:
+    explicit PackBuckets(Repo::Id repo_id) : repo_id_(repo_id) {
+    }
+
+    // Calls is_same(slot) for the slots which may refer to the object
+    template <typename IsSame>
+    bool Find(const GitOid& hash, IsSame&& is_same) {
+        const auto& slots = Get(hash);
+        auto count = static_cast<uint32_t>(slots.size());
+        for (auto i = Pack::FindSlot(slots.data(), count, hash);
+             i < count && Pack::CompareSlot(slots[i], hash) == 0; ++i) {
+            if (is_same(slots[i])) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Find(const GitOid& hash) {
+        return Find(hash, [this, &hash](const Pack::Slot& slot) {
+            return IsPackEntry(repo_id_, slot, hash);
+        });
+    }
+
+    void Add(const GitOid& hash, GitObject::Id first_id, uint32_t entry) {
+        auto& slots = Get(hash);
+        Pack::Slot slot;
+        Env::Memcpy(slot.hash, reinterpret_cast<const uint8_t*>(&hash) + 1,
+                    sizeof(slot.hash));
+        slot.first_id = first_id;
+        slot.entry = entry;
+        auto count = static_cast<uint32_t>(slots.size());
+        slots.insert(slots.begin() + Pack::FindSlot(slots.data(), count, hash),
+                     slot);
+        changed_[Pack::BucketKey(repo_id_, hash).prefix] = true;
+    }
+
+    void Save() const {
+        for (uint32_t prefix = 0; prefix < kBuckets; ++prefix) {
+            if (!changed_[prefix]) {
+                continue;
+            }
+            Pack::BucketKey key(repo_id_, static_cast<uint8_t>(prefix));
+            const auto& slots = *buckets_[prefix];
+            Env::SaveVar(&key, sizeof(key), slots.data(),
+                         sizeof(Pack::Slot) * slots.size(), KeyTag::Internal);
+        }
+    }
+
+private:
+    static constexpr uint32_t kBuckets = 256;
+
+    std::vector<Pack::Slot>& Get(const GitOid& hash) {
+        Pack::BucketKey key(repo_id_, hash);
+        auto& bucket = buckets_[key.prefix];
+        if (bucket == nullptr) {
+            bucket = std::make_unique<std::vector<Pack::Slot>>();
+            auto size = Env::LoadVar(&key, sizeof(key), nullptr, 0,
+                                     KeyTag::Internal);
+            bucket->resize(size / sizeof(Pack::Slot));
+            if (size != 0u) {
+                Env::LoadVar(&key, sizeof(key), bucket->data(), size,
+                             KeyTag::Internal);
+            }
+        }
+        return *bucket;
+    }
+
+    Repo::Id repo_id_;
+    std::unique_ptr<std::vector<Pack::Slot>> buckets_[kBuckets];
+    bool changed_[kBuckets] = {};
+};
+
+// The object is kept by the repo, by the shared store or in chunks
+bool UnpackedObjectExists(Repo::Id repo_id, const GitOid& hash) {
+    GitObject::Data::Key data_key(repo_id, hash);
+    if (Env::LoadVar(&data_key, sizeof(data_key), nullptr, 0,
+                     KeyTag::Internal) != 0u) {
+        return true;
+    }
+    GitObject::Shared::MemberKey member_key(repo_id, hash);
+    if (Env::LoadVar(&member_key, sizeof(member_key), nullptr, 0,
+                     KeyTag::Internal) != 0u) {
+        return true;
+    }
+    GitObject::Chunked::MarkerKey marker_key(repo_id, hash);
+    return Env::LoadVar(&marker_key, sizeof(marker_key), nullptr, 0,
+                        KeyTag::Internal) != 0u;
+}
+
+bool ObjectDataExists(Repo::Id repo_id, const GitOid& hash,
+                      PackBuckets& packed) {
+    return UnpackedObjectExists(repo_id, hash) || packed.Find(hash);
+}
+
+using PackedObject = method::PushObjects::PackedObject;
+
+const PackedObject* NextObject(const PackedObject* obj) {
+    return reinterpret_cast<const PackedObject*>(
+        reinterpret_cast<const uint8_t*>(obj + 1) + obj->data_size);
+}
+
+GitObject::Id SaveObjectMeta(Repo::Id repo_id, Repo& repo_info, int8_t type,
+                             const GitOid& hash, uint32_t data_size) {
+    GitObject::Meta meta;
+    meta.type = GitObject::Meta::Type(type);
+    meta.hash = hash;
+    meta.id = repo_info.cur_objs_number++;
+    meta.data_size = data_size;
+    GitObject::Meta::Key meta_key(repo_id, meta.id);
+    Env::SaveVar(&meta_key, sizeof(meta_key), &meta, sizeof(meta),
+                 KeyTag::Internal);
+    if (GitObject::Meta::IsIndexed(type)) {
+        Env::SaveVar_T(GitObject::Meta::TypeKey(repo_id, type, meta.id), meta);
+    }
+    return meta.id;
+}
+
+// Called by the push methods before any object is saved
+void SaveLegacyObjectsNumber(Repo::Id repo_id, const Repo& repo_info) {
+    LegacyState legacy;
+    if (!Env::LoadVar_T(LegacyState::Key(), legacy) ||
+        repo_id >= legacy.last_repo_id) {
+        return;
+    }
+    GitObject::Meta::LegacyKey key(repo_id);
+    if (Env::LoadVar(&key, sizeof(key), nullptr, 0, KeyTag::Internal) == 0u) {
+        Env::SaveVar_T(key,
+                       static_cast<GitObject::Id>(repo_info.cur_objs_number));
+    }
+}
+
+void SaveObject(Repo::Id repo_id, Repo& repo_info, const PackedObject* obj) {
+    GitObject::Data::Key data_key(repo_id, obj->hash);
+    Env::SaveVar(&data_key, sizeof(data_key), obj + 1, obj->data_size,
+                 KeyTag::Internal);
+    SaveObjectMeta(repo_id, repo_info, obj->type, obj->hash, obj->data_size);
+}
+
+using SharedObject = method::PushSharedObjects::PackedObject;
+
+const SharedObject* NextObject(const SharedObject* obj) {
+    return reinterpret_cast<const SharedObject*>(
+        reinterpret_cast<const uint8_t*>(obj + 1) +
+        (obj->has_data != 0u ? obj->data_size : 0u));
+}
+
+// Drops a reference of a repo, the data is deleted with the last one
+void ReleaseSharedObject(const GitOid& hash) {
+    GitObject::Shared::RefsKey refs_key(hash);
+    GitObject::Shared::RefCount refs = 0;
+    Env::LoadVar_T(refs_key, refs);
+    if (refs > 1u) {
+        --refs;
+        Env::SaveVar_T(refs_key, refs);
+    } else {
+        Env::DelVar_T(refs_key);
+        Env::DelVar_T(GitObject::Shared::DataKey(hash));
+    }
+}
+
+// The data is saved by the first repo only, the others take a reference if
+// they push the same bytes. The contract can't hash the data, so a repo
+// which pushes different bytes under the oid keeps them on its own and
+// nobody can poison the copy of another repo. Returns false in that case
+bool AddSharedObjectRef(Repo::Id repo_id, const SharedObject* obj) {
+    Env::Halt_if(obj->has_data == 0u);
+    GitObject::Shared::RefsKey refs_key(obj->hash);
+    GitObject::Shared::RefCount refs = 0;
+    Env::LoadVar_T(refs_key, refs);
+    GitObject::Shared::DataKey data_key(obj->hash);
+    if (refs == 0u) {
+        Env::SaveVar(&data_key, sizeof(data_key), obj + 1, obj->data_size,
+                     KeyTag::Internal);
+    } else {
+        auto data = std::make_unique<uint8_t[]>(obj->data_size + 1);
+        if (Env::LoadVar(&data_key, sizeof(data_key), data.get(),
+                         obj->data_size + 1,
+                         KeyTag::Internal) != obj->data_size ||
+            Env::Memcmp(data.get(), obj + 1, obj->data_size) != 0) {
+            GitObject::Data::Key repo_key(repo_id, obj->hash);
+            Env::SaveVar(&repo_key, sizeof(repo_key), obj + 1, obj->data_size,
+                         KeyTag::Internal);
+            return false;
+        }
+    }
+    ++refs;
+    Env::SaveVar_T(refs_key, refs);
+    return true;
+}
 }  // namespace 
 
 BEAM_EXPORT void Ctor(const method::Initial& params) {
@@ -60,11 +290,17 @@ BEAM_EXPORT void Dtor(void*) {
 }
 
 namespace Upgradable3 { // NOLINT
-void OnUpgraded(uint32_t /*nPrevVersion*/) {
+void OnUpgraded(uint32_t nPrevVersion) {
+    // version 1 had no index keys
+    if (nPrevVersion < 2) {
+        LegacyState legacy;
+        Env::LoadVar_T(0, static_cast<ContractState&>(legacy));
+        Env::SaveVar_T(LegacyState::Key(), legacy);
+    }
 }
 
 uint32_t get_CurrentVersion() {  // NOLINT
-    return 1;
+    return 2;
 }
 }
 
@@ -73,30 +309,14 @@ BEAM_EXPORT void Method_3(const method::PushObjects& params) {  // NOLINT
 
     CheckPermissions<Tag::kRepoMember, Repo>(params.user, repo_info->repo_id,
                                              Repo::Permissions::kPush);
+    SaveLegacyObjectsNumber(params.repo_id, *repo_info);
 
-    auto* obj =
-        reinterpret_cast<const method::PushObjects::PackedObject*>(&params + 1);
+    PackBuckets packed(params.repo_id);
+    auto* obj = reinterpret_cast<const PackedObject*>(&params + 1);
     for (uint32_t i = 0; i < params.objects_number; ++i) {
-        GitObject::Meta meta;
-        meta.type = GitObject::Meta::Type(obj->type);
-        meta.hash = obj->hash;
-        meta.id = repo_info->cur_objs_number++;
-        meta.data_size = obj->data_size;
-        GitObject::Meta::Key meta_key(params.repo_id, meta.id);
-        GitObject::Data::Key data_key(params.repo_id, obj->hash);
-        Env::Halt_if(Env::LoadVar(&data_key, sizeof(data_key), nullptr, 0,
-                                  KeyTag::Internal) !=
-                     0u);  // halt if object exists
-        Env::SaveVar(&data_key, sizeof(data_key), obj + 1, obj->data_size,
-                     KeyTag::Internal);
-
-        Env::SaveVar(&meta_key, sizeof(meta_key), &meta, sizeof(meta),
-                     KeyTag::Internal);
-        auto size = obj->data_size;
-        ++obj;  // skip header
-        obj = reinterpret_cast<const method::PushObjects::PackedObject*>(
-            reinterpret_cast<const uint8_t*>(obj) +
-            size);  // move to next object
+        Env::Halt_if(ObjectDataExists(params.repo_id, obj->hash, packed));
+        SaveObject(params.repo_id, *repo_info, obj);
+        obj = NextObject(obj);
     }
 
     Repo::Key key_repo(repo_info->repo_id);
@@ -133,11 +353,17 @@ BEAM_EXPORT void Method_5(const method::CreateOrganization& params) {  // NOLINT
     org->name_len = params.name_len;
     Env::Memcpy(org->name, params.name, params.name_len);
 
+    Organization::NameKey name_key(
+        org->creator, GetNameHash(params.name, params.name_len));
+    Env::Halt_if(Env::LoadVar(&name_key, sizeof(name_key), nullptr, 0,
+                              KeyTag::Internal) != 0u);
+
     ContractState cs;
     Env::LoadVar_T(0, cs);
     Organization::Key org_key(cs.last_organization_id++);
     Env::SaveVar_T(0, cs);
     SaveNamedObject(org_key, org);
+    Env::SaveVar_T(name_key, org_key.id);
 
     Members<Tag::kOrganizationMember, Organization>::Key member_key(
         org->creator, org_key.id);
@@ -148,7 +374,15 @@ BEAM_EXPORT void Method_5(const method::CreateOrganization& params) {  // NOLINT
 }
 
 BEAM_EXPORT void Method_6(const method::ModifyOrganization& params) {  // NOLINT
-    // TODO
+    std::unique_ptr<Organization> org =
+        LoadNamedObject<Organization>(params.id);
+    CheckPermissions<Tag::kOrganizationMember, Organization>(
+        params.caller, params.id,
+        Organization::Permissions::kModifyOrganization);
+
+    RenameObject(params.id, *org, params.name, params.name_len);
+
+    Env::AddSig(params.caller);
 }
 
 BEAM_EXPORT void Method_7(const method::RemoveOrganization& params) {  // NOLINT
@@ -189,8 +423,14 @@ BEAM_EXPORT void Method_8(const method::CreateRepo& params) {  // NOLINT
     Members<Tag::kRepoMember, Repo>::Key key_user(params.caller,
                                                   repo_info->repo_id);
     Env::SaveVar_T(key_user, UserInfo{.permissions = Repo::Permissions::kAll});
+    Env::SaveVar_T(Repo::MemberKey(repo_info->repo_id, params.caller),
+                   uint8_t{1});
 
     SaveNamedObject(Repo::Key(repo_info->repo_id), repo_info);
+    Env::SaveVar_T(Repo::ProjectKey(repo_info->project_id, repo_info->repo_id),
+                   repo_info->repo_id);
+    Env::SaveVar_T(Repo::OwnerKey(repo_info->owner, repo_info->repo_id),
+                   repo_info->repo_id);
 
     Env::AddSig(repo_info->owner);
 }
@@ -228,9 +468,12 @@ BEAM_EXPORT void Method_10(const method::RemoveRepo& params) {  // NOLINT
     Env::DelVar_T(Repo::NameKey(repo_info->owner, repo_info->name_hash));
     Env::DelVar_T(Members<Tag::kRepoMember, Repo>::Key(repo_info->owner,
                                                        repo_info->repo_id));
+    Env::DelVar_T(Repo::MemberKey(repo_info->repo_id, repo_info->owner));
     Env::DelVar_T(Repo::Key(repo_info->repo_id));
-    // TODO: delete all repo members
-    // TODO: delete all git refs and objects
+    Env::DelVar_T(Repo::ProjectKey(repo_info->project_id, repo_info->repo_id));
+    Env::DelVar_T(Repo::OwnerKey(repo_info->owner, repo_info->repo_id));
+    // members, refs and objects are deleted by CleanupRepo
+    Env::SaveVar_T(Repo::TombstoneKey(repo_info->repo_id), params.caller);
 }
 
 BEAM_EXPORT void Method_11(const method::CreateProject& params) {  // NOLINT
@@ -246,11 +489,17 @@ BEAM_EXPORT void Method_11(const method::CreateProject& params) {  // NOLINT
     project->organization_id = params.organization_id;
     Env::Memcpy(project->name, params.name, params.name_len);
 
+    Project::NameKey name_key(project->creator,
+                              GetNameHash(params.name, params.name_len));
+    Env::Halt_if(Env::LoadVar(&name_key, sizeof(name_key), nullptr, 0,
+                              KeyTag::Internal) != 0u);
+
     ContractState cs;
     Env::LoadVar_T(0, cs);
     Project::Key project_key(cs.last_project_id++);
     Env::SaveVar_T(0, cs);
     SaveNamedObject(project_key, project);
+    Env::SaveVar_T(name_key, project_key.id);
 
     Members<Tag::kProjectMember, Project>::Key member_key(project->creator,
                                                           project_key.id);
@@ -261,7 +510,16 @@ BEAM_EXPORT void Method_11(const method::CreateProject& params) {  // NOLINT
 }
 
 BEAM_EXPORT void Method_12(const method::ModifyProject& params) {  // NOLINT
-    // TODO
+    std::unique_ptr<Project> project =
+        LoadNamedObject<Project>(params.project_id);
+    CheckPermissions<Tag::kProjectMember, Project>(
+        params.caller, params.project_id, Project::Permissions::kModifyProject);
+    // moving to another organization is not supported
+    Env::Halt_if(project->organization_id != params.organization_id);
+
+    RenameObject(params.project_id, *project, params.name, params.name_len);
+
+    Env::AddSig(params.caller);
 }
 
 BEAM_EXPORT void Method_13(const method::RemoveProject& params) {  // NOLINT
@@ -276,6 +534,8 @@ BEAM_EXPORT void Method_14(const method::AddRepoMember& params) {  // NOLINT
     CheckPermissions<Tag::kRepoMember, Repo>(params.caller, params.repo_id,
                                              Repo::Permissions::kAddMember);
     Env::SaveVar_T(member_key, UserInfo{.permissions = params.permissions});
+    Env::SaveVar_T(Repo::MemberKey(params.repo_id, params.member),
+                   uint8_t{1});
     Env::AddSig(params.caller);
 }
 
@@ -298,6 +558,7 @@ BEAM_EXPORT void Method_16(const method::RemoveRepoMember& params) {  // NOLINT
     CheckPermissions<Tag::kRepoMember, Repo>(params.caller, params.repo_id,
                                              Repo::Permissions::kRemoveMember);
     Env::DelVar_T(member_key);
+    Env::DelVar_T(Repo::MemberKey(params.repo_id, params.member));
     Env::AddSig(params.caller);
 }
 
@@ -369,3 +630,313 @@ BEAM_EXPORT void Method_22(const method::RemoveOrganizationMember& params) {  //
     Env::DelVar_T(member_key);
     Env::AddSig(params.caller);
 }
+
+BEAM_EXPORT void Method_23(const method::PushObjectsIfMissing& params) {  // NOLINT
+    std::unique_ptr<Repo> repo_info = LoadNamedObject<Repo>(params.repo_id);
+
+    CheckPermissions<Tag::kRepoMember, Repo>(params.user, repo_info->repo_id,
+                                             Repo::Permissions::kPush);
+    SaveLegacyObjectsNumber(params.repo_id, *repo_info);
+
+    // retried and concurrent pushes may contain objects which are already
+    // stored, they are skipped
+    PackBuckets packed(params.repo_id);
+    auto* obj = reinterpret_cast<const PackedObject*>(&params + 1);
+    for (uint32_t i = 0; i < params.objects_number; ++i) {
+        if (!ObjectDataExists(params.repo_id, obj->hash, packed)) {
+            SaveObject(params.repo_id, *repo_info, obj);
+        }
+        obj = NextObject(obj);
+    }
+
+    Repo::Key key_repo(repo_info->repo_id);
+    SaveNamedObject(key_repo, repo_info);
+
+    Env::AddSig(params.user);
+}
+
+BEAM_EXPORT void Method_24(const method::PushSharedObjects& params) {  // NOLINT
+    std::unique_ptr<Repo> repo_info = LoadNamedObject<Repo>(params.repo_id);
+
+    CheckPermissions<Tag::kRepoMember, Repo>(params.user, repo_info->repo_id,
+                                             Repo::Permissions::kPush);
+    SaveLegacyObjectsNumber(params.repo_id, *repo_info);
+
+    PackBuckets packed(params.repo_id);
+    auto* obj = reinterpret_cast<const SharedObject*>(&params + 1);
+    for (uint32_t i = 0; i < params.objects_number; ++i) {
+        if (!ObjectDataExists(params.repo_id, obj->hash, packed)) {
+            bool shared = AddSharedObjectRef(params.repo_id, obj);
+            auto id = SaveObjectMeta(params.repo_id, *repo_info, obj->type,
+                                     obj->hash, obj->data_size);
+            if (shared) {
+                Env::SaveVar_T(
+                    GitObject::Shared::MemberKey(params.repo_id, obj->hash),
+                    id);
+            }
+        }
+        obj = NextObject(obj);
+    }
+
+    Repo::Key key_repo(repo_info->repo_id);
+    SaveNamedObject(key_repo, repo_info);
+
+    Env::AddSig(params.user);
+}
+
+BEAM_EXPORT void Method_25(const method::PushObjectPack& params) {  // NOLINT
+    Env::Halt_if(params.objects_number == 0u);
+    std::unique_ptr<Repo> repo_info = LoadNamedObject<Repo>(params.repo_id);
+
+    CheckPermissions<Tag::kRepoMember, Repo>(params.user, repo_info->repo_id,
+                                             Repo::Permissions::kPush);
+    SaveLegacyObjectsNumber(params.repo_id, *repo_info);
+    Env::AddSig(params.user);
+
+    auto* index = reinterpret_cast<const Pack::Entry*>(&params + 1);
+    uint32_t total_size = 0;
+    for (uint32_t i = 0; i < params.objects_number; ++i) {
+        Env::Halt_if(total_size + index[i].data_size < total_size);
+        total_size += index[i].data_size;
+    }
+
+    // objects stored by an interrupted or a concurrent push are left out,
+    // the buckets catch the repeated objects of the pack too
+    const auto* data =
+        reinterpret_cast<const uint8_t*>(index + params.objects_number);
+    auto kept = std::make_unique<Pack::Entry[]>(params.objects_number);
+    auto pack_data = std::make_unique<uint8_t[]>(total_size);
+    GitObject::Id first_id = repo_info->cur_objs_number;
+    uint32_t kept_number = 0;
+    uint32_t data_size = 0;
+    PackBuckets packed(params.repo_id);
+    for (uint32_t i = 0; i < params.objects_number;
+         data += index[i].data_size, ++i) {
+        const auto& hash = index[i].hash;
+        // the index of this pack isn't saved yet
+        auto is_same = [&](const Pack::Slot& slot) {
+            if (slot.first_id == first_id) {
+                return Env::Memcmp(&kept[slot.entry].hash, &hash,
+                                   sizeof(hash)) == 0;
+            }
+            return IsPackEntry(params.repo_id, slot, hash);
+        };
+        if (UnpackedObjectExists(params.repo_id, hash) ||
+            packed.Find(hash, is_same)) {
+            continue;
+        }
+        packed.Add(hash, first_id, kept_number);
+        Env::Memcpy(pack_data.get() + data_size, data, index[i].data_size);
+        data_size += index[i].data_size;
+        kept[kept_number++] = index[i];
+    }
+    if (kept_number == 0u) {
+        return;
+    }
+
+    Pack::IndexKey index_key(params.repo_id, first_id);
+    Env::SaveVar(&index_key, sizeof(index_key), kept.get(),
+                 sizeof(Pack::Entry) * kept_number, KeyTag::Internal);
+    Pack::DataKey data_key(params.repo_id, first_id);
+    Env::SaveVar(&data_key, sizeof(data_key), pack_data.get(), data_size,
+                 KeyTag::Internal);
+    packed.Save();
+    repo_info->cur_objs_number += kept_number;
+
+    Repo::Key key_repo(repo_info->repo_id);
+    SaveNamedObject(key_repo, repo_info);
+}
+
+BEAM_EXPORT void Method_26(const method::PushRefsIfUnchanged& params) {  // NOLINT
+    using RefUpdate = method::PushRefsIfUnchanged::RefUpdate;
+    std::unique_ptr<Repo> repo_info = LoadNamedObject<Repo>(params.repo_id);
+
+    CheckPermissions<Tag::kRepoMember, Repo>(params.user, repo_info->repo_id,
+                                             Repo::Permissions::kPush);
+
+    auto* update = reinterpret_cast<const RefUpdate*>(&params + 1);
+    for (size_t i = 0; i < params.refs_number; ++i) {
+        auto* ref = reinterpret_cast<const GitRef*>(update + 1);
+        GitRef::Key key(params.repo_id, ref->name, ref->name_length);
+        GitRef current;
+        if (Env::LoadVar(&key, sizeof(key), &current, sizeof(current),
+                         KeyTag::Internal) == 0u) {
+            _POD_(current.commit_hash).SetZero();
+        }
+        Env::Halt_if(Env::Memcmp(&current.commit_hash,
+                                 &update->old_commit_hash,
+                                 sizeof(GitOid)) != 0);
+        Env::SaveVar(&key, sizeof(key), ref, sizeof(GitRef) + ref->name_length,
+                     KeyTag::Internal);
+        update = reinterpret_cast<const RefUpdate*>(
+            reinterpret_cast<const uint8_t*>(ref + 1) + ref->name_length);
+    }
+
+    Env::AddSig(params.user);
+}
+
+BEAM_EXPORT void Method_27(const method::CleanupRepo& params) {  // NOLINT
+    PubKey remover;
+    Env::Halt_if(!Env::LoadVar_T(Repo::TombstoneKey(params.repo_id), remover));
+    Env::Halt_if(!(_POD_(remover) == params.caller));  // NOLINT
+    Env::AddSig(params.caller);
+
+    auto chunks_left = params.chunks_limit;
+    auto* object_id = reinterpret_cast<const GitObject::Id*>(&params + 1);
+    for (size_t i = 0; i < params.objects_number; ++i, ++object_id) {
+        GitObject::Meta::Key meta_key(params.repo_id, *object_id);
+        GitObject::Meta meta;
+        if (!Env::LoadVar_T(meta_key, meta)) {
+            continue;
+        }
+        GitObject::Shared::MemberKey member_key(params.repo_id, meta.hash);
+        GitObject::Chunked::MarkerKey marker_key(params.repo_id, meta.hash);
+        GitObject::Id member_id;
+        uint32_t chunks_number = 0;
+        if (Env::LoadVar_T(member_key, member_id)) {
+            ReleaseSharedObject(meta.hash);
+            Env::DelVar_T(member_key);
+        } else if (Env::LoadVar_T(marker_key, chunks_number)) {
+            // the last chunks first, the marker keeps the number of the rest
+            for (; chunks_number != 0 && chunks_left != 0; --chunks_left) {
+                Env::DelVar_T(GitObject::Chunked::ChunkKey(
+                    params.repo_id, meta.hash, --chunks_number));
+            }
+            if (chunks_number != 0) {
+                Env::SaveVar_T(marker_key, chunks_number);
+                continue;
+            }
+            Env::DelVar_T(marker_key);
+        } else {
+            Env::DelVar_T(GitObject::Data::Key(params.repo_id, meta.hash));
+        }
+        if (GitObject::Meta::IsIndexed(meta.type)) {
+            Env::DelVar_T(
+                GitObject::Meta::TypeKey(params.repo_id, meta.type, meta.id));
+        }
+        Env::DelVar_T(meta_key);
+    }
+
+    using Chunk = method::CleanupRepo::Chunk;
+    auto* chunk = reinterpret_cast<const Chunk*>(object_id);
+    for (size_t i = 0; i < params.chunks_number; ++i, ++chunk) {
+        Env::DelVar_T(GitObject::Chunked::ChunkKey(params.repo_id, chunk->hash,
+                                                   chunk->index));
+    }
+
+    auto* pack_id = reinterpret_cast<const GitObject::Id*>(chunk);
+    for (size_t i = 0; i < params.packs_number; ++i, ++pack_id) {
+        Env::DelVar_T(Pack::IndexKey(params.repo_id, *pack_id));
+        Env::DelVar_T(Pack::DataKey(params.repo_id, *pack_id));
+    }
+
+    auto* prefix = reinterpret_cast<const uint8_t*>(pack_id);
+    for (size_t i = 0; i < params.buckets_number; ++i, ++prefix) {
+        Env::DelVar_T(Pack::BucketKey(params.repo_id, *prefix));
+    }
+
+    auto* ref_hash = reinterpret_cast<const Hash256*>(prefix);
+    for (size_t i = 0; i < params.refs_number; ++i, ++ref_hash) {
+        Env::DelVar_T(GitRef::Key(params.repo_id, *ref_hash));
+    }
+
+    auto* member = reinterpret_cast<const PubKey*>(ref_hash);
+    for (size_t i = 0; i < params.members_number; ++i, ++member) {
+        Env::DelVar_T(
+            Members<Tag::kRepoMember, Repo>::Key(*member, params.repo_id));
+        Env::DelVar_T(Repo::MemberKey(params.repo_id, *member));
+    }
+
+    if (params.done != 0u) {
+        Env::DelVar_T(GitObject::Meta::LegacyKey(params.repo_id));
+        Env::DelVar_T(Repo::TombstoneKey(params.repo_id));
+    }
+}
+
+BEAM_EXPORT void Method_28(const method::PushObjectChunk& params) {  // NOLINT
+    using Chunked = GitObject::Chunked;
+    Env::Halt_if(params.chunk_index >= params.chunks_number);
+    Env::Halt_if(params.chunk_size == 0u ||
+                 params.chunk_size > Chunked::kMaxChunkSize);
+    std::unique_ptr<Repo> repo_info = LoadNamedObject<Repo>(params.repo_id);
+
+    CheckPermissions<Tag::kRepoMember, Repo>(params.user, repo_info->repo_id,
+                                             Repo::Permissions::kPush);
+    SaveLegacyObjectsNumber(params.repo_id, *repo_info);
+    Env::AddSig(params.user);
+
+    // the object is completed by a concurrent or an interrupted push
+    PackBuckets packed(params.repo_id);
+    if (ObjectDataExists(params.repo_id, params.hash, packed)) {
+        return;
+    }
+
+    Chunked::ChunkKey chunk_key(params.repo_id, params.hash,
+                                params.chunk_index);
+    Env::SaveVar(&chunk_key, sizeof(chunk_key), &params + 1, params.chunk_size,
+                 KeyTag::Internal);
+    if (params.chunk_index + 1 != params.chunks_number) {
+        return;
+    }
+
+    uint32_t data_size = 0;
+    for (uint32_t i = 0; i < params.chunks_number; ++i) {
+        Chunked::ChunkKey key(params.repo_id, params.hash, i);
+        auto size =
+            Env::LoadVar(&key, sizeof(key), nullptr, 0, KeyTag::Internal);
+        Env::Halt_if(size == 0u);
+        data_size += size;
+    }
+    Env::Halt_if(data_size != params.data_size);
+
+    Env::SaveVar_T(Chunked::MarkerKey(params.repo_id, params.hash),
+                   params.chunks_number);
+    SaveObjectMeta(params.repo_id, *repo_info, params.type, params.hash,
+                   params.data_size);
+
+    Repo::Key key_repo(repo_info->repo_id);
+    SaveNamedObject(key_repo, repo_info);
+}
+
+BEAM_EXPORT void Method_29(
+    const method::RemoveOrganizationWithMembers& params) {  // NOLINT
+    std::unique_ptr<Organization> org =
+        LoadNamedObject<Organization>(params.id);
+    Env::Halt_if(!(_POD_(org->creator) == params.caller));  // NOLINT
+    Env::AddSig(params.caller);
+
+    Env::DelVar_T(Organization::NameKey(
+        org->creator, GetNameHash(org->name, org->name_len)));
+    Env::DelVar_T(Members<Tag::kOrganizationMember, Organization>::Key(
+        org->creator, params.id));
+    Env::DelVar_T(Organization::Key(params.id));
+    // the projects stay, the app doesn't remove an organization which has
+    // them
+    const auto* member = reinterpret_cast<const PubKey*>(&params + 1);
+    for (uint32_t i = 0; i < params.members_number; ++i, ++member) {
+        Env::DelVar_T(Members<Tag::kOrganizationMember, Organization>::Key(
+            *member, params.id));
+    }
+}
+
+BEAM_EXPORT void Method_30(
+    const method::RemoveProjectWithMembers& params) {  // NOLINT
+    std::unique_ptr<Project> project =
+        LoadNamedObject<Project>(params.project_id);
+    CheckPermissions<Tag::kOrganizationMember, Organization>(
+        params.caller, project->organization_id,
+        Organization::Permissions::kRemoveProject);
+    Env::AddSig(params.caller);
+
+    Env::DelVar_T(Project::NameKey(
+        project->creator, GetNameHash(project->name, project->name_len)));
+    Env::DelVar_T(Members<Tag::kProjectMember, Project>::Key(
+        project->creator, params.project_id));
+    Env::DelVar_T(Project::Key(params.project_id));
+    // the repos stay, the app doesn't remove a project which has them
+    const auto* member = reinterpret_cast<const PubKey*>(&params + 1);
+    for (uint32_t i = 0; i < params.members_number; ++i, ++member) {
+        Env::DelVar_T(Members<Tag::kProjectMember, Project>::Key(
+            *member, params.project_id));
+    }
+}
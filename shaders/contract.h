@@ -14,6 +14,23 @@ enum Tag : uint8_t {
     kRepoMember,
     kOrganizationMember,
     kProjectMember,
+    kSharedObjectData,
+    kSharedObjectRefs,
+    kSharedObjectMember,
+    kPackIndex,
+    kPackData,
+    kProjectRepo,
+    kOwnerRepo,
+    kOrganizationName,
+    kProjectName,
+    kRemovedRepo,
+    kObjectChunk,
+    kChunkedObject,
+    kObjectType,
+    kLegacyState,
+    kLegacyObjects,
+    kPackedObject,
+    kRepoMemberIndex,
 };
 
 #pragma pack(push, 1)
@@ -29,12 +46,28 @@ inline Hash256 GetNameHash(const char* name, size_t len) {
     return res;
 }
 
+// SID of version 1 of the contract, the deployed one without the index
+// keys. The app shader upgrades the contracts which run it
+static const ShaderID s_SID_1 = {
+    0x5c, 0xa7, 0xc7, 0xe3, 0x0f, 0x06, 0x69, 0x42, 0xe4, 0x7d, 0x80,
+    0x3a, 0x4e, 0x01, 0x6c, 0xa9, 0xff, 0x08, 0xcc, 0xbc, 0xb8, 0x43,
+    0x84, 0x66, 0x25, 0x25, 0xb8, 0xbf, 0xe0, 0x72, 0x46, 0xeb};
+
 struct ContractState {
     uint64_t last_repo_id;
     uint64_t last_organization_id;
     uint64_t last_project_id;
 };
 
+// The counters of the version without the index keys, saved by the upgrade.
+// Records with smaller ids have no index keys and are found by scanning. A
+// contract deployed with the indexes has no such var
+struct LegacyState : ContractState {
+    struct Key {
+        Tag tag = Tag::kLegacyState;
+    };
+};
+
 struct Organization {
     using Id = uint64_t;
     struct Key {
@@ -43,6 +76,15 @@ struct Organization {
         explicit Key(const Id& id) : id(id) {
         }
     };
+    // creator and the name hash, the value is the id
+    struct NameKey {
+        Tag tag = Tag::kOrganizationName;
+        PubKey creator;
+        Hash256 name_hash;
+        NameKey(const PubKey& c, const Hash256& h) : creator(c) {
+            Env::Memcpy(&name_hash, &h, sizeof(name_hash));
+        }
+    };
     enum Permissions : uint8_t {
         kAddProject = 0b000001,
         kAddMember = 0b000010,
@@ -67,6 +109,15 @@ struct Project {
         explicit Key(const Id& id) : id(id) {
         }
     };
+    // creator and the name hash, the value is the id
+    struct NameKey {
+        Tag tag = Tag::kProjectName;
+        PubKey creator;
+        Hash256 name_hash;
+        NameKey(const PubKey& c, const Hash256& h) : creator(c) {
+            Env::Memcpy(&name_hash, &h, sizeof(name_hash));
+        }
+    };
     enum Permissions : uint8_t {
         kAddRepo = 0b000001,
         kAddMember = 0b000010,
@@ -117,6 +168,40 @@ struct Repo {
         Key() : Key(0) {
         }
     };
+    // Left by RemoveRepo until the storage of the repo is cleaned up, the
+    // value is the key of the remover
+    struct TombstoneKey : BaseKey {
+        explicit TombstoneKey(Repo::Id id) : BaseKey(kRemovedRepo, id) {
+        }
+    };
+
+    // Index keys to list the repos of a project or an owner, the value is
+    // the repo id
+    struct ProjectKey {
+        Tag tag = Tag::kProjectRepo;
+        Project::Id project_id;
+        Id repo_id;  // big-endian
+        ProjectKey(Project::Id pid, Repo::Id id)
+            : project_id(pid), repo_id(Utils::FromBE(id)) {
+        }
+    };
+    struct OwnerKey {
+        Tag tag = Tag::kOwnerRepo;
+        PubKey owner;
+        Id repo_id;  // big-endian
+        OwnerKey(const PubKey& o, Repo::Id id)
+            : owner(o), repo_id(Utils::FromBE(id)) {
+        }
+    };
+
+    // Index key to list the members of a repo, the value is unused. The
+    // members added before the index have none
+    struct MemberKey : BaseKey {
+        PubKey user;
+        MemberKey(Repo::Id id, const PubKey& u)
+            : BaseKey(kRepoMemberIndex, id), user(u) {
+        }
+    };
 
     Project::Id project_id;
     Hash256 name_hash;
@@ -158,6 +243,33 @@ struct GitObject {
         Id id;
         GitOid hash;
         uint32_t data_size;
+
+        // Commits and trees by type, in the order of the ids. The value is
+        // the meta, blobs and tags are not indexed. The packed objects are
+        // listed from the pack indexes
+        struct TypeKey : Repo::BaseKey {
+            int8_t type;
+            Id obj_id;  // big-endian
+            TypeKey(Repo::Id rid, int8_t t, const Id& oid)
+                : Repo::BaseKey(kObjectType, rid),
+                  type(t & 0x7f),  // clear first bit
+                  obj_id(Utils::FromBE(oid)) {
+            }
+        };
+
+        // The objects of a repo created before the type index have no type
+        // keys. The first push after the upgrade saves their number, it is
+        // cur_objs_number until then
+        struct LegacyKey : Repo::BaseKey {
+            explicit LegacyKey(Repo::Id rid)
+                : Repo::BaseKey(kLegacyObjects, rid) {
+            }
+        };
+
+        static bool IsIndexed(int8_t type) {
+            type &= 0x7f;
+            return type == kGitObjectCommit || type == kGitObjectTree;
+        }
     } meta;
 
     struct Data {
@@ -172,6 +284,60 @@ struct GitObject {
         char data[];
     } data;
 
+    // Content addressed store shared by all repos. The data of an object is
+    // saved once and counts the repos which reference it, a repo keeps the
+    // usual meta and a membership record with the meta id
+    struct Shared {
+        using RefCount = uint32_t;
+
+        struct DataKey {
+            Tag tag = Tag::kSharedObjectData;
+            GitOid hash;
+            explicit DataKey(const GitOid& oid) {
+                Env::Memcpy(&hash, &oid, sizeof(oid));
+            }
+        };
+        struct RefsKey {
+            Tag tag = Tag::kSharedObjectRefs;
+            GitOid hash;
+            explicit RefsKey(const GitOid& oid) {
+                Env::Memcpy(&hash, &oid, sizeof(oid));
+            }
+        };
+        struct MemberKey : Repo::BaseKey {
+            GitOid hash;
+            MemberKey(Repo::Id rid, const GitOid& oid)
+                : Repo::BaseKey(kSharedObjectMember, rid) {
+                Env::Memcpy(&hash, &oid, sizeof(oid));
+            }
+        };
+    };
+
+    // Objects larger than a transaction are pushed in chunks by several
+    // transactions. The last chunk completes the object, only then the meta
+    // and the marker with the number of chunks are saved, so readers never
+    // see partial objects
+    struct Chunked {
+        static constexpr uint32_t kMaxChunkSize = 100000;
+
+        struct ChunkKey : Repo::BaseKey {
+            GitOid hash;
+            uint32_t index;  // big-endian
+            ChunkKey(Repo::Id rid, const GitOid& oid, uint32_t i)
+                : Repo::BaseKey(kObjectChunk, rid), index(Utils::FromBE(i)) {
+                Env::Memcpy(&hash, &oid, sizeof(oid));
+            }
+        };
+        // the value is the number of chunks
+        struct MarkerKey : Repo::BaseKey {
+            GitOid hash;
+            MarkerKey(Repo::Id rid, const GitOid& oid)
+                : Repo::BaseKey(kChunkedObject, rid) {
+                Env::Memcpy(&hash, &oid, sizeof(oid));
+            }
+        };
+    };
+
     /*
     GitObject& operator=(const GitObject& from)
     {
@@ -184,6 +350,77 @@ struct GitObject {
     */
 };
 
+// Objects pushed in one batch stored as a single data var. The index lists
+// the objects in the order of their data, the object ids of a pack start
+// with the id of its first object. A packed object has no var of its own,
+// it is found through the bucket of its oid
+struct Pack {
+    struct IndexKey : Repo::BaseKey {
+        GitObject::Id first_id;  // big-endian
+        IndexKey(Repo::Id rid, GitObject::Id id)
+            : Repo::BaseKey(kPackIndex, rid), first_id(Utils::FromBE(id)) {
+        }
+    };
+    struct DataKey : Repo::BaseKey {
+        GitObject::Id first_id;  // big-endian
+        DataKey(Repo::Id rid, GitObject::Id id)
+            : Repo::BaseKey(kPackData, rid), first_id(Utils::FromBE(id)) {
+        }
+    };
+    struct Entry {
+        int8_t type;
+        GitOid hash;
+        uint32_t data_size;
+    };
+
+    // The packed objects of a repo by the first byte of the oid, a repo has
+    // at most 256 buckets. The value is Slot[] sorted by the next bytes of
+    // the oid, the oid and the size are kept only by the pack index
+    struct BucketKey : Repo::BaseKey {
+        uint8_t prefix;
+        BucketKey(Repo::Id rid, uint8_t p)
+            : Repo::BaseKey(kPackedObject, rid), prefix(p) {
+        }
+        BucketKey(Repo::Id rid, const GitOid& oid)
+            : BucketKey(rid, reinterpret_cast<const uint8_t*>(&oid)[0]) {
+        }
+    };
+    static constexpr size_t kSlotHashSize = 4;
+    struct Slot {
+        uint8_t hash[kSlotHashSize];  // the oid bytes after the prefix
+        GitObject::Id first_id;       // of the pack
+        uint32_t entry;               // in the pack index
+    };
+
+    static int CompareSlot(const Slot& slot, const GitOid& oid) {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(&oid);
+        return Env::Memcmp(slot.hash, bytes + 1, kSlotHashSize);
+    }
+
+    // Returns the first slot which isn't less than the oid, the slots of
+    // the objects which may have the oid follow it
+    static uint32_t FindSlot(const Slot* slots, uint32_t count,
+                             const GitOid& oid) {
+        uint32_t begin = 0, end = count;
+        while (begin < end) {
+            auto middle = begin + (end - begin) / 2;
+            if (CompareSlot(slots[middle], oid) < 0) {
+                begin = middle + 1;
+            } else {
+                end = middle;
+            }
+        }
+        return begin;
+    }
+
+    // Where a packed object is
+    struct Location {
+        GitObject::Id first_id;  // of the pack
+        uint32_t offset;         // in the pack data
+        uint32_t data_size;
+    };
+};
+
 struct GitRef {
     static constexpr size_t kMaxNameSize = 256;
     struct Key : Repo::BaseKey {
@@ -390,6 +627,121 @@ struct RemoveOrganizationMember {
     PubKey caller;
 };
 
+// Same as PushObjects, but objects which already exist are skipped instead
+// of failing the transaction
+struct PushObjectsIfMissing {
+    static const uint32_t kMethod = 23;
+    using PackedObject = PushObjects::PackedObject;
+    uint64_t repo_id;
+    PubKey user;
+    size_t objects_number;
+    // packed objects after this
+};
+
+// Pushes objects to the shared store. The data is always sent, an object
+// shares the stored copy only if the bytes are the same. Objects which the
+// repo already has are skipped
+struct PushSharedObjects {
+    static const uint32_t kMethod = 24;
+    struct PackedObject {
+        int8_t type;
+        GitOid hash;
+        uint32_t data_size;
+        // must be 1. The data can't be omitted until the contract is able
+        // to verify the content against the oid
+        uint8_t has_data;
+        // followed by data
+    };
+    uint64_t repo_id;
+    PubKey user;
+    size_t objects_number;
+    // packed objects after this
+};
+
+// Stores the objects as one pack, two vars per push and the buckets of the
+// oids (at most 256 per repo) instead of two vars per object. Objects which
+// the repo has already are left out
+struct PushObjectPack {
+    static const uint32_t kMethod = 25;
+    uint64_t repo_id;
+    PubKey user;
+    size_t objects_number;
+    // Pack::Entry index[objects_number] and the data of the objects after
+    // this
+};
+
+// Updates refs only if their targets are the expected ones, otherwise the
+// transaction fails and the pusher has to fetch first
+struct PushRefsIfUnchanged {
+    static const uint32_t kMethod = 26;
+    struct RefUpdate {
+        GitOid old_commit_hash;  // zero if the ref must not exist
+        // followed by GitRef
+    };
+    uint64_t repo_id;
+    PubKey user;
+    size_t refs_number;
+    // ref updates after this
+};
+
+// Deletes a part of the storage of a removed repo, the app collects the
+// keys. The last call sets done to drop the tombstone
+struct CleanupRepo {
+    static const uint32_t kMethod = 27;
+    // a chunk of an upload which was never completed, no meta refers to it
+    struct Chunk {
+        GitOid hash;
+        uint32_t index;
+    };
+    Repo::Id repo_id;
+    PubKey caller;
+    size_t objects_number;  // GitObject::Id of the meta records
+    size_t chunks_number;   // Chunk
+    size_t packs_number;    // Pack first ids
+    size_t buckets_number;  // Pack::BucketKey prefixes, one byte each
+    size_t refs_number;     // GitRef name hashes
+    size_t members_number;  // PubKey of the repo members
+    // chunks to delete, the object which doesn't fit keeps the rest of them
+    uint32_t chunks_limit;
+    uint8_t done;
+    // the ids, hashes and keys follow in the same order
+};
+
+// Saves a chunk of an object which doesn't fit a transaction. The last
+// chunk must be pushed after the others are stored, it checks that all of
+// them are present and completes the object
+struct PushObjectChunk {
+    static const uint32_t kMethod = 28;
+    uint64_t repo_id;
+    PubKey user;
+    int8_t type;
+    GitOid hash;
+    uint32_t data_size;  // of the whole object
+    uint32_t chunks_number;
+    uint32_t chunk_index;
+    uint32_t chunk_size;
+    // followed by the chunk data
+};
+
+// Removes an organization with its name key and its members. The members
+// are listed by the app, the contract can't enumerate them
+struct RemoveOrganizationWithMembers {
+    static const uint32_t kMethod = 29;
+    PubKey caller;
+    Organization::Id id;
+    uint32_t members_number;
+    // PubKey members[members_number] after this
+};
+
+// Same as RemoveOrganizationWithMembers for a project
+struct RemoveProjectWithMembers {
+    static const uint32_t kMethod = 30;
+    Project::Id project_id;
+    PubKey caller;
+    uint32_t members_number;
+    // PubKey members[members_number] after this
+};
+
 #pragma pack(pop)
 }  // namespace method
 }  // namespace sourc3
@@ -1,7 +1,9 @@
 import { CustomAntdSelect } from '@components/shared/select';
 import { clipString, setBranchAndCommit } from '@libs/utils';
 import { BranchCommit } from '@types';
-import { Row, Col, Select } from 'antd';
+import {
+  Row, Col, Select, Button
+} from 'antd';
 import { NavigateFunction } from 'react-router-dom';
 import {
   BreadCrumbMenu,
@@ -17,7 +19,9 @@ type UpperMenuProps = {
   pathname:string,
   commit: BranchCommit,
   prevReposHref: string | null,
-  navigate:NavigateFunction
+  navigate:NavigateFunction,
+  hasOlderCommits: boolean,
+  getOlderCommits: () => void
 };
 
 const selectBranchOptionMap = (el: string, i:number) => (
@@ -45,7 +49,9 @@ function UpperMenu({
   pathname,
   prevReposHref,
   baseUrl,
-  navigate
+  navigate,
+  hasOlderCommits,
+  getOlderCommits
 }:UpperMenuProps) {
   const { commit_oid } = commit;
   const keys = Array.from(repoMap.keys());
@@ -105,6 +111,14 @@ function UpperMenu({
             {commits.map(selectCommitOptionMap)}
           </CustomAntdSelect>
         </Col>
+
+        {hasOlderCommits && (
+          <Col span={4}>
+            <Button type="link" onClick={getOlderCommits}>
+              Older commits
+            </Button>
+          </Col>
+        )}
       </Row>
 
       <Row style={{ marginTop: '1rem' }}>
@@ -21,6 +21,7 @@ export type UpperMenuProps = {
   repoName: string;
   tree: DataNode[] | null;
   repoMap: Map<BranchName, BranchCommit[]>;
+  logPending: Map<BranchName, string>;
   filesMap: Map<MetaHash, string>;
   prevReposHref: string | null;
   updateTree: (
@@ -28,6 +29,8 @@ export type UpperMenuProps = {
   killTree: () => void;
   getFileData: (
     repoId: RepoId, oid: string, errorHandler: ErrorHandler) => void;
+  getOlderCommits: (
+    repoId: RepoId, branch: BranchName, errorHandler: ErrorHandler) => void;
 };
 
 const splitUrl = (routes: string[], fullUrl: string) => {
@@ -58,12 +61,14 @@ const setBranchCommit = (repoMap:Map<BranchName, BranchCommit[]>, tree:string) =
 function RepoContent({
   id,
   repoMap,
+  logPending,
   filesMap,
   tree,
   prevReposHref,
   killTree,
   updateTree,
-  getFileData
+  getFileData,
+  getOlderCommits
 }: UpperMenuProps) {
   const setError = useAsyncError();
   const navigate = useNavigate();
@@ -100,6 +105,8 @@ function RepoContent({
         repoMap={repoMap}
         commit={commit}
         navigate={navigate}
+        hasOlderCommits={logPending.has(branch)}
+        getOlderCommits={() => getOlderCommits(id, branch, setError)}
       />
       <Routes>
         <Route
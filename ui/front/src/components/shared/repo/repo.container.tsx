@@ -16,6 +16,7 @@ import styles from './repo.module.scss';
 type RepoProps = {
   currentId: RepoId | null;
   repoMap: Map<string, BranchCommit[]> | null;
+  logPending: Map<string, string>;
   filesMap: Map<MetaHash, string>;
   tree: DataNode[] | null;
   fileText: string | null;
@@ -30,18 +31,23 @@ type RepoProps = {
   getFileData: (
     repoId: RepoId, oid: string, errHandler: ErrorHandler
   ) => void;
+  getOlderCommits: (
+    repoId: RepoId, branch: string, errHandler: ErrorHandler
+  ) => void;
 };
 
 function UserRepos({
   currentId,
   repoMap,
+  logPending,
   filesMap,
   tree,
   prevReposHref,
   getRepoData,
   updateTree,
   killTree,
-  getFileData
+  getFileData,
+  getOlderCommits
 }:RepoProps) {
   const talonProps = useUserRepos({ currentId, getRepoData, updateTree });
 
@@ -62,11 +68,13 @@ function UserRepos({
   const props = {
     ...talonProps,
     repoMap: repoMap as NonNullable<typeof repoMap>,
+    logPending,
     tree,
     filesMap,
     prevReposHref,
     killTree,
-    getFileData
+    getFileData,
+    getOlderCommits
   };
 
   return (
@@ -87,11 +95,12 @@ function UserRepos({
 
 const mapState = ({
   repo: {
-    id, repoMap, filesMap, tree, fileText, prevReposHref
+    id, repoMap, logPending, filesMap, tree, fileText, prevReposHref
   }
 }:RootState) => ({
   currentId: id,
   repoMap,
+  logPending,
   filesMap,
   tree,
   fileText,
@@ -113,6 +122,9 @@ const mapDispatch = (dispatch: AppThunkDispatch) => ({
   },
   getFileData: (repoId: RepoId, oid: TreeElementOid, errHandler: ErrorHandler) => {
     dispatch(thunks.getTextData(repoId, oid, errHandler));
+  },
+  getOlderCommits: (repoId: RepoId, branch: string, errHandler: ErrorHandler) => {
+    dispatch(thunks.getOlderCommits(repoId, branch, errHandler));
   }
 });
 
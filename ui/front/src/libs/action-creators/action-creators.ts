@@ -134,6 +134,11 @@ export const AC = {
     payload
   } as const),
 
+  setLogPending: (payload: Map<BranchName, string>) => ({
+    type: ACTIONS.SET_LOG_PENDING,
+    payload
+  } as const),
+
   setRepoId: (payload: RepoId) => ({
     type: ACTIONS.SET_REPO_ID,
     payload
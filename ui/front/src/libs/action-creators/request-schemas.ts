@@ -90,39 +90,42 @@ export const RC = {
     params: { create_tx: false }
   } as const),
 
-  getAllRepos: (type:string) => ({
+  getAllRepos: (type:string, start_key?: string) => ({
     callID: 'all_repos',
     method: 'invoke_contract',
     params: {
       args: {
         role: 'user',
-        action: `${type}_repos`
+        action: `${type}_repos`,
+        ...(start_key ? { start_key } : {})
       },
       create_tx: false
     }
   } as const),
 
-  repoGetMeta: (repo_id:number) => ({
+  repoGetMeta: (repo_id:number, start_key?: string) => ({
     callID: 'repo_get_meta',
     method: 'invoke_contract',
     params: {
       args: {
         role: 'user',
         action: 'repo_get_meta',
-        repo_id
+        repo_id,
+        ...(start_key ? { start_key } : {})
       },
       create_tx: false
     }
   } as const),
 
-  repoGetRefs: (repo_id:number) => ({
+  repoGetRefs: (repo_id:number, start_key?: string) => ({
     callID: 'repo_get_refs',
     method: 'invoke_contract',
     params: {
       args: {
         role: 'user',
         action: 'list_refs',
-        repo_id
+        repo_id,
+        ...(start_key ? { start_key } : {})
       },
       create_tx: false
     }
@@ -142,6 +145,22 @@ export const RC = {
     }
   } as const),
 
+  repoLog: (
+    repo_id: RepoId, start: { obj_id: CommitHash } | { pending: string }
+  ) => ({
+    callID: 'repo_log',
+    method: 'invoke_contract',
+    params: {
+      args: {
+        role: 'user',
+        action: 'repo_log',
+        repo_id,
+        ...start
+      },
+      create_tx: false
+    }
+  } as const),
+
   repoGetTree: (repo_id: RepoId, obj_id: TreeOid) => ({
     callID: 'repo_get_tree',
     method: 'invoke_contract',
@@ -169,7 +188,21 @@ export const RC = {
     }
   } as const),
 
-  getData: (repo_id:RepoId, obj_id: TreeElementOid) => ({
+  cleanupRepo: (repo_id:RepoId, start_key?: string) => ({
+    callID: 'cleanup_repo',
+    method: 'invoke_contract',
+    params: {
+      args: {
+        role: 'user',
+        action: 'cleanup_repo',
+        repo_id,
+        ...(start_key ? { start_key } : {})
+      },
+      create_tx: false
+    }
+  } as const),
+
+  getData: (repo_id:RepoId, obj_id: TreeElementOid, chunk = 0) => ({
     callID: 'repo_get_data',
     method: 'invoke_contract',
     params: {
@@ -177,20 +210,22 @@ export const RC = {
         role: 'user',
         action: 'repo_get_data',
         repo_id,
-        obj_id
+        obj_id,
+        chunk
       },
       create_tx: false
     }
   } as const),
 
-  getCommitList: (repo_id:RepoId) => ({
+  getCommitList: (repo_id:RepoId, start_key?: string) => ({
     callID: 'repo_get_data',
     method: 'invoke_contract',
     params: {
       args: {
         role: 'user',
         action: 'list_commits',
-        repo_id
+        repo_id,
+        ...(start_key ? { start_key } : {})
       },
       create_tx: false
     }
@@ -254,26 +289,28 @@ export const RC = {
     }
   } as const),
 
-  getOrganizations: () => ({
+  getOrganizations: (start_key?: string) => ({
     callID: 'list_organizations',
     method: 'invoke_contract',
     params: {
       create_tx: false,
       args: {
         role: 'user',
-        action: 'list_organizations'
+        action: 'list_organizations',
+        ...(start_key ? { start_key } : {})
       }
     }
   }),
 
-  getProjects: () => ({
+  getProjects: (start_key?: string) => ({
     callID: 'list_projects',
     method: 'invoke_contract',
     params: {
       create_tx: false,
       args: {
         role: 'user',
-        action: 'list_projects'
+        action: 'list_projects',
+        ...(start_key ? { start_key } : {})
       }
     }
   }),
@@ -6,16 +6,19 @@ import {
   TreeBlobParser,
   TreeListParser
 } from '@libs/core';
-import { CONTRACT, ToastMessages } from '@libs/constants';
+import { CONTRACT, STATUS, ToastMessages } from '@libs/constants';
 import { AppThunkDispatch, RootState } from '@libs/redux';
 import {
   BeamApiRes,
+  BranchName,
   CallApiProps,
+  CleanupRepoResp,
   ContractsResp,
   IPCResult,
   MetaHash,
   NotificationPlacement,
   OrganizationsResp,
+  PageResp,
   PKeyRes,
   ProjectsResp,
   PromiseArg,
@@ -73,6 +76,52 @@ async function getOutput<T>(
   return outputParser<T>(res, dispatch);
 }
 
+// requests the pages of a listing one by one, returns false on failure
+async function getPages<T extends PageResp>(
+  request: (startKey?: string) => CallApiProps<RequestSchema['params']>,
+  dispatch: AppThunkDispatch,
+  onPage: (output: T) => void
+) {
+  let startKey: string | undefined;
+  do {
+    const output = await getOutput<T>(request(startKey), dispatch);
+    if (!output) return false;
+    onPage(output);
+    startKey = output.next;
+  } while (startKey);
+  return true;
+}
+
+const TX_POLL_INTERVAL = 5000;
+
+// waits until a transaction completes, returns false if it doesn't
+async function waitTx(txId: string) {
+  for (;;) {
+    const res = await callApi(RC.getTxStatus(txId));
+    const status = res.result?.status_string;
+    if (status === STATUS.COMPLETED) return true;
+    if (!status || status === STATUS.FAILED || status === STATUS.CANCELED) {
+      return false;
+    }
+    await new Promise((resolve) => { setTimeout(resolve, TX_POLL_INTERVAL); });
+  }
+}
+
+// deletes the storage of a removed repo, a transaction per call of
+// cleanup_repo until it reports done
+async function cleanupRepo(repo_id: RepoId, dispatch: AppThunkDispatch) {
+  let startKey: string | undefined;
+  for (;;) {
+    const res = await callApi(RC.cleanupRepo(repo_id, startKey));
+    const output = outputParser<CleanupRepoResp>(res, dispatch);
+    if (!output || !res.result?.raw_data) return false;
+    const tx = await callApi(RC.startTx(res.result.raw_data));
+    if (!tx.result?.txid || !await waitTx(tx.result.txid)) return false;
+    if (output.done) return true;
+    startKey = output.next;
+  }
+}
+
 export const thunks:ThunkObject = {
   connectExtension: () => async (dispatch) => {
     try {
@@ -213,9 +262,13 @@ export const thunks:ThunkObject = {
   },
   getAllRepos: (type:RepoListType, resolve?: () => void) => async (dispatch) => {
     try {
-      const action = RC.getAllRepos(type);
-      const output = await getOutput<ReposResp>(action, dispatch);
-      if (output) dispatch(AC.setRepos(output.repos));
+      const repos: ReposResp['repos'] = [];
+      const done = await getPages<ReposResp>(
+        (startKey) => RC.getAllRepos(type, startKey),
+        dispatch,
+        (output) => repos.push(...output.repos)
+      );
+      if (done) dispatch(AC.setRepos(repos));
       if (resolve) resolve();
     } catch (error) { thunkCatch(error, dispatch); }
   },
@@ -258,13 +311,14 @@ export const thunks:ThunkObject = {
     try {
       const { pathname } = window.location;
       const metas = new Map<MetaHash, RepoMeta>();
-      const metaArray = await getOutput<RepoMetaResp>(RC.repoGetMeta(id), dispatch);
-      if (metaArray) {
-        metaArray.objects.forEach((el) => {
+      await getPages<RepoMetaResp>(
+        (startKey) => RC.repoGetMeta(id, startKey),
+        dispatch,
+        (output) => output.objects.forEach((el) => {
           metas.set(el.object_hash, el);
-        });
-      }
-      const commitTree = await new CommitMapParser({
+        })
+      );
+      const { repoMap, logPending } = await new CommitMapParser({
         id, metas, api, pathname, expect: 'commit'
       })
         .buildCommitTree();
@@ -272,7 +326,8 @@ export const thunks:ThunkObject = {
       batcher(dispatch, [
         AC.setRepoMeta(metas),
         AC.setRepoId(id),
-        AC.setRepoMap(commitTree),
+        AC.setRepoMap(repoMap),
+        AC.setLogPending(logPending),
         AC.setTreeData(null)
       ]);
       if (resolve) resolve();
@@ -314,7 +369,9 @@ export const thunks:ThunkObject = {
       if (res.result?.raw_data) {
         const tx = await callApi(RC.startTx(res.result.raw_data));
         if (tx.result?.txid) {
-          return dispatch(AC.setTx(tx.result.txid));
+          dispatch(AC.setTx(tx.result.txid));
+          if (!await waitTx(tx.result.txid)) return undefined;
+          return await cleanupRepo(delete_repo, dispatch);
         }
       }
       throw new Error('repo delete failed');
@@ -345,6 +402,36 @@ export const thunks:ThunkObject = {
     } catch (error) { thunkCatch(error, dispatch); }
   },
 
+  getOlderCommits: (
+    id: RepoId,
+    branch: BranchName,
+    errHandler: (err: Error) => void
+  ) => async (dispatch, getState) => {
+    try {
+      const { pathname } = window.location;
+      const {
+        repo: { repoMetas: metas, repoMap, logPending }
+      } = getState();
+      const listed = repoMap?.get(branch);
+      const pending = logPending.get(branch);
+      if (!repoMap || !listed || !pending) return;
+      const { commits, pending: next } = await new CommitMapParser({
+        id, metas, api, pathname, expect: 'commit'
+      })
+        .getOlderCommits(listed, pending);
+
+      const newMap = new Map(repoMap);
+      newMap.set(branch, commits);
+      const newPending = new Map(logPending);
+      if (next) newPending.set(branch, next);
+      else newPending.delete(branch);
+      batcher(dispatch, [
+        AC.setRepoMap(newMap),
+        AC.setLogPending(newPending)
+      ]);
+    } catch (error) { errHandler(error as Error); }
+  },
+
   getTextData: (
     repoId: RepoId,
     oid: TreeElementOid,
@@ -443,15 +530,25 @@ export const thunks:ThunkObject = {
   },
   getOrganizations: () => async (dispatch) => {
     try {
-      const output = await getOutput<OrganizationsResp>(RC.getOrganizations(), dispatch);
-      if (output) dispatch(AC.setOrganizationsList(output.organizations));
+      const organizations: OrganizationsResp['organizations'] = [];
+      const done = await getPages<OrganizationsResp>(
+        RC.getOrganizations,
+        dispatch,
+        (output) => organizations.push(...output.organizations)
+      );
+      if (done) dispatch(AC.setOrganizationsList(organizations));
     } catch (error) { thunkCatch(error, dispatch); }
   },
 
   getProjects: () => async (dispatch) => {
     try {
-      const output = await getOutput<ProjectsResp>(RC.getProjects(), dispatch);
-      if (output) dispatch(AC.setProjectsList(output.projects));
+      const projects: ProjectsResp['projects'] = [];
+      const done = await getPages<ProjectsResp>(
+        RC.getProjects,
+        dispatch,
+        (output) => projects.push(...output.projects)
+      );
+      if (done) dispatch(AC.setProjectsList(projects));
     } catch (error) { thunkCatch(error, dispatch); }
   }
 };
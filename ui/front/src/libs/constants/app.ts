@@ -17,6 +17,7 @@ export enum ACTIONS {
   SET_COMMITS_LIST = 'SET_COMMITS_LIST',
   SET_BRANCH_REF_LIST = 'SET_BRANCH_REF_LIST',
   SET_REPO_MAP = 'SET_REPO_MAP',
+  SET_LOG_PENDING = 'SET_LOG_PENDING',
   SET_REPO_ID = 'SET_REPO_ID',
   SET_PREV_REPO_HREF = 'SET_PREV_REPO_HREF',
   SET_WALLET_STATUS = 'SET_WALLET_STATUS',
@@ -2,13 +2,21 @@ import { clipString } from '@libs/utils';
 import {
   Branch,
   BranchCommit,
+  CommitHash,
   RepoCommitResp,
+  RepoLogResp,
   RepoRefsResp,
   BranchName
 } from '@types';
 import { RC } from '@libs/action-creators';
 import AbstractParser from './abstract-parser';
 
+// the commits of a branch, oldest first, and the cursor of the older ones
+export type CommitPage = {
+  commits: BranchCommit[];
+  pending?: string;
+};
+
 export default class CommitMapParser extends AbstractParser {
   private readonly getCommitParent = async (oid: string) => {
     const res = this.isIpfsHash(oid)
@@ -38,28 +46,79 @@ export default class CommitMapParser extends AbstractParser {
     } return commitList.reverse();
   };
 
+  // one page of the log, the next page is asked for with its 'pending'
+  private readonly getLog = async (
+    start: { obj_id: CommitHash } | { pending: string }
+  ) => this.call<RepoLogResp>(RC.repoLog(this.id, start));
+
+  private readonly addPage = async (
+    page: RepoLogResp,
+    listed: BranchCommit[] = []
+  ):Promise<CommitPage> => {
+    const listedIds = new Set(listed.map((el) => el.commit_oid));
+    const commits = [
+      ...page.commits.filter((el) => !listedIds.has(el.commit_oid)).reverse(),
+      ...listed
+    ];
+    if (page.pending) return { commits, pending: page.pending };
+    const commitIds = new Set(commits.map((el) => el.commit_oid));
+    // the log stops at the commits kept in IPFS, they are walked one by one
+    const missing = new Set(
+      commits.flatMap((el) => el.parents.map(({ oid }) => oid))
+        .filter((oid) => !commitIds.has(oid))
+    );
+    const ipfsCommits = await Promise.all(
+      [...missing].map(this.getCommitParent)
+    );
+    const olderList = await this.buildCommitList(
+      ipfsCommits, [], commitIds
+    );
+    return { commits: [...olderList, ...commits] };
+  };
+
   private readonly getCommit = async (
     branch: Branch
-  ):Promise<BranchCommit[]> => {
-    const commitResp = this.isIpfsHash(branch.commit_hash)
-      ? await this.getIpfsData(branch.commit_hash) as RepoCommitResp
-      : await this.call<RepoCommitResp>(
-        RC.repoGetCommit(this.id, branch.commit_hash)
-      );
-    const commitList = await this.buildCommitList([commitResp.commit]);
-    return commitList;
+  ):Promise<CommitPage> => {
+    if (this.isIpfsHash(branch.commit_hash)) {
+      const commitResp = await this.getIpfsData(
+        branch.commit_hash
+      ) as RepoCommitResp;
+      return { commits: await this.buildCommitList([commitResp.commit]) };
+    }
+    const page = await this.getLog({ obj_id: branch.commit_hash });
+    return this.addPage(page);
   };
 
   private readonly buildRepoMap = async () => {
-    const branches = await this.call<RepoRefsResp>(RC.repoGetRefs(this.id));
+    const refs: Branch[] = [];
+    let startKey: string | undefined;
+    do {
+      const page = await this.call<RepoRefsResp>(
+        RC.repoGetRefs(this.id, startKey)
+      );
+      refs.push(...page.refs);
+      startKey = page.next;
+    } while (startKey);
     const branchMap = new Map<BranchName, BranchCommit[]>();
-    const promises = branches.refs.map(this.getCommit);
-    const commits = await Promise.all(promises);
+    const logPending = new Map<BranchName, string>();
+    const promises = refs.map(this.getCommit);
+    const pages = await Promise.all(promises);
 
-    branches.refs.forEach((el, i) => {
-      if (commits[i]) branchMap.set(clipString(el.name), commits[i]);
+    refs.forEach((el, i) => {
+      const name = clipString(el.name);
+      branchMap.set(name, pages[i].commits);
+      if (pages[i].pending) logPending.set(name, pages[i].pending as string);
     });
-    return branchMap.size ? branchMap : null;
+    return { repoMap: branchMap.size ? branchMap : null, logPending };
+  };
+
+  // lists the page of a branch older than the listed commits
+  public readonly getOlderCommits = async (
+    listed: BranchCommit[],
+    pending: string
+  ) => {
+    const page = await this.getLog({ pending });
+    return this.addPage(page, listed);
   };
 
   public readonly buildCommitTree = async () => {
@@ -14,7 +14,17 @@ export default class TreeBlobParser extends AbstractParser {
   private readonly getDataFromBC = async (oid: string) => {
     const output = await this.call<ObjectDataResp>(RC.getData(this.id, oid));
     if (output.error) throw new Error(output.error);
-    const str = hexParser(output.object_data);
+    // large objects are stored in chunks and returned one at a time
+    const rest = await Promise.all(
+      Array.from({ length: (output.chunks_number || 1) - 1 }, (_, i) => (
+        this.call<ObjectDataResp>(RC.getData(this.id, oid, i + 1))
+      ))
+    );
+    const failed = rest.find((chunk) => chunk.error);
+    if (failed?.error) throw new Error(failed.error);
+    const str = hexParser(
+      [output, ...rest].map((chunk) => chunk.object_data).join('')
+    );
     return str;
   };
 }
@@ -8,6 +8,7 @@ interface IRepo {
   id: RepoId | null,
   repoMetas: Map<MetaHash, RepoMeta>,
   repoMap: Map<BranchName, BranchCommit[]> | null,
+  logPending: Map<BranchName, string>,
   tree: DataNode[] | null,
   filesMap: Map<MetaHash, string>,
   fileText: string | null,
@@ -19,6 +20,7 @@ export const initialState:IRepo = {
   repoMetas: new Map(),
   filesMap: new Map(),
   repoMap: null,
+  logPending: new Map(),
   tree: null,
   fileText: null,
   prevReposHref: null
@@ -57,6 +59,10 @@ const reducer = (
       newState.repoMap = action.payload as IRepo['repoMap'];
       return newState;
     }
+    case ACTIONS.SET_LOG_PENDING: {
+      newState.logPending = action.payload as IRepo['logPending'];
+      return newState;
+    }
     case ACTIONS.SET_PREV_REPO_HREF: {
       newState.prevReposHref = action.payload as IRepo['prevReposHref'];
       return newState;
@@ -4,6 +4,11 @@ export interface ContractResp {
   error?: string
 }
 
+// listings return the cursor of the next page if there are more items
+export interface PageResp extends ContractResp {
+  next?: string
+}
+
 export type RepoName = string;
 export type RepoId = number;
 export type BranchName = string;
@@ -30,7 +35,7 @@ export type RepoType = {
   cur_objects: number;
 };
 
-export interface ReposResp extends ContractResp {
+export interface ReposResp extends PageResp {
   repos: RepoType[]
 }
 
@@ -40,7 +45,7 @@ export type RepoMeta = {
   object_size: MetaObjectSize
 };
 
-export interface RepoMetaResp extends ContractResp {
+export interface RepoMetaResp extends PageResp {
   objects: RepoMeta[]
 }
 
@@ -65,7 +70,7 @@ export type Branch = {
   commit_hash: CommitHash
 };
 
-export interface RepoRefsResp extends ContractResp {
+export interface RepoRefsResp extends PageResp {
   refs: Branch[]
 }
 
@@ -90,6 +95,16 @@ export interface RepoCommitResp extends ContractResp {
   commit: BranchCommit;
 }
 
+export interface CleanupRepoResp extends PageResp {
+  deleted: number;
+  done: number;
+}
+
+export interface RepoLogResp extends ContractResp {
+  commits: BranchCommit[];
+  pending?: string;
+}
+
 export type TreeElement = {
   filename: TreeElementFilename;
   attributes: number;
@@ -111,7 +126,7 @@ export type Organization = {
   organization_creator: string
 };
 
-export interface OrganizationsResp extends ContractResp {
+export interface OrganizationsResp extends PageResp {
   organizations: Organization[]
 }
 
@@ -135,12 +150,13 @@ export type Project = {
   project_creator:string;
 };
 
-export interface ProjectsResp extends ContractResp {
+export interface ProjectsResp extends PageResp {
   projects : Project[]
 }
 
 export interface ObjectDataResp extends ContractResp {
   object_data: ObjectData
+  chunks_number?: number
 }
 
 export type Commit = {